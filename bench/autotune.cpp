@@ -0,0 +1,57 @@
+/*
+ * Calibrate the schedule of Neurogram::create for this machine, and save it as the tuning profile that later runs
+ * load automatically (see tuning.h).
+ *
+ *	bruce_autotune [--output FILE] [--repetitions N] [--threads 1,2,4,...] [--quick] [--verbose]
+ *
+ * Without --output, the profile is written to tuning::default_path().
+ */
+
+#include <sstream>
+
+#include "bruce.h"
+
+int main(const int argc, char **argv)
+{
+	tuning::Options options;
+	std::string output = tuning::default_path();
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const bool has_value = i + 1 < argc;
+		if (arg == "--output" && has_value)
+			output = argv[++i];
+		else if (arg == "--repetitions" && has_value)
+			options.repetitions = std::stoul(argv[++i]);
+		else if (arg == "--threads" && has_value)
+		{
+			std::stringstream ss(argv[++i]);
+			for (std::string item; std::getline(ss, item, ',');)
+				options.thread_counts.push_back(std::max<size_t>(1, std::stoul(item)));
+		}
+		else if (arg == "--quick")
+			options.shapes = {{4, 2, 2000, 1}, {2, 2, 2000, 4}};
+		else if (arg == "--verbose")
+			options.verbose = true;
+		else
+		{
+			std::cout << "usage: " << argv[0] << " [--output FILE] [--repetitions N] [--threads 1,2,4,...] [--quick] [--verbose]\n";
+			return arg == "--help" ? 0 : 1;
+		}
+	}
+	if (output.empty())
+	{
+		std::cerr << "no location for the profile, pass --output or set BRUCE_TUNING_PROFILE\n";
+		return 1;
+	}
+
+	const auto profile = tuning::autotune(options);
+	std::cout << "machine: " << profile.machine() << "\n";
+	for (const auto &e : profile.entries())
+		std::cout << "n_cf=" << e.shape.n_cf << " n_fibers=" << e.shape.n_fibers << " n_samples=" << e.shape.n_samples
+				  << " n_trials=" << e.shape.n_trials << " -> n_threads=" << e.schedule.n_threads << " cf_block=" << e.schedule.cf_block
+				  << " trials_per_task=" << e.schedule.trials_per_task << " (" << e.seconds * 1e3 << " ms)\n";
+	profile.save(output);
+	std::cout << "saved to " << output << std::endl;
+	return 0;
+}
@@ -0,0 +1,174 @@
+/*
+ * End-to-end benchmark of Neurogram::create, reporting the real-time factor (seconds of audio per second),
+ * the throughput per core (seconds of audio per core-second) and the peak RSS for standard configurations.
+ *
+ *	bruce_bench_rtf [--repetitions N] [--output FILE.json] [--baseline FILE.json] [--threshold FRACTION]
+ *	                [--rss-threshold FRACTION] [--max-duration SECONDS] [--quick] [--counters] [--allocations]
+ *
+ * With --counters, hardware counters are read around every stage by the stage timers (see profiler.h), on all
+ * threads, and reported per stage as i.e. ihc_ipc and spike_generation_branch_misses_per_sample. Likewise,
+ * --allocations reports the allocations per stage as i.e. mapping_allocations and mapping_allocated_mb.
+ *
+ * With --baseline, the real-time factor and peak RSS are compared against an earlier run (written with --output
+ * on the same machine), and the exit code is 2 when either regressed by more than the given threshold.
+ */
+
+#include <ctime>
+#include <filesystem>
+#include <limits>
+
+#include "bruce.h"
+#include "harness.h"
+
+namespace
+{
+	struct Configuration
+	{
+		std::string name;
+		size_t n_cf;
+		size_t n_low;
+		size_t n_med;
+		size_t n_high;
+		int n_trials;
+		PowerLaw power_law;
+	};
+
+	std::vector<Configuration> configurations(const bool quick)
+	{
+		if (quick)
+			return {{"small", 10, 1, 1, 3, 1, APPROXIMATED}};
+		return {
+			{"small", 10, 1, 1, 3, 1, APPROXIMATED},
+			{"standard", 40, 10, 10, 30, 1, APPROXIMATED},
+			{"standard_actual", 40, 10, 10, 30, 1, ACTUAL},
+			{"trials", 20, 2, 2, 6, 10, APPROXIMATED},
+		};
+	}
+
+	//! The first max_duration seconds of a stimulus
+	stimulus::Stimulus truncate(const stimulus::Stimulus &stim, const double max_duration)
+	{
+		const auto n = std::min(stim.data.size(), static_cast<size_t>(max_duration * static_cast<double>(stim.sampling_rate)));
+		if (n == stim.data.size())
+			return stim;
+		return {std::vector<double>(stim.data.begin(), stim.data.begin() + static_cast<std::ptrdiff_t>(n)),
+				stim.sampling_rate, static_cast<double>(n) / static_cast<double>(stim.sampling_rate)};
+	}
+
+	std::vector<std::pair<std::string, stimulus::Stimulus>> stimuli(const double max_duration)
+	{
+		const std::filesystem::path data = std::filesystem::path(PROJECT_ROOT) / "data";
+
+		std::vector<std::pair<std::string, stimulus::Stimulus>> result;
+		for (const auto *name : {"defineit.wav", "violin.wav"})
+			result.emplace_back(name, truncate(stimulus::from_file((data / name).string(), false), max_duration));
+		for (const double f0 : {1e3, 4e3})
+			result.emplace_back("tone_" + std::to_string(static_cast<int>(f0)),
+								truncate(stimulus::ramped_sine_wave(0.5, 0.55, 100000, 2.5e-3, 25e-3, f0, 60.0), max_duration));
+		return result;
+	}
+
+	double cpu_time()
+	{
+		return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+	}
+}
+
+int main(const int argc, char **argv)
+{
+	// Every run of create is long enough to be timed reliably on its own
+	bench::Options defaults;
+	defaults.warmup = 1;
+	defaults.repetitions = 3;
+
+	double rss_threshold = 0.25;
+	double max_duration = std::numeric_limits<double>::infinity();
+	const auto options = bench::parse_options(
+		argc, argv, [&](const std::string &arg, const std::function<std::string()> &value)
+		{
+			if (arg == "--rss-threshold")
+				rss_threshold = std::stod(value());
+			else if (arg == "--max-duration")
+				max_duration = std::stod(value());
+			else
+				return false;
+			return true; },
+		" [--rss-threshold FRACTION] [--max-duration SECONDS]",
+		defaults);
+
+	// Create is multi-threaded, so the counters are read per stage by the stage timers rather than by the harness
+	auto suite_options = options;
+	suite_options.counters = false;
+	bench::Suite suite(suite_options);
+	if (options.counters)
+	{
+		std::string why;
+		if (!perf::supported(&why))
+			std::cerr << "hardware counters are not available (" << why << "), only reporting wall time\n";
+		profiler::set_enabled(true);
+		profiler::set_counters(true);
+		if (!profiler::counters_enabled())
+			std::cerr << "stage timers are compiled out (BRUCE_PROFILE), not reporting counters\n";
+	}
+	if (options.allocations)
+		profiler::set_enabled(true);
+	if (options.quick)
+		max_duration = std::min(max_duration, 0.1);
+
+	for (const auto &[stim_name, stim] : stimuli(max_duration))
+	{
+		for (const auto &config : configurations(options.quick))
+		{
+			const std::string name = config.name + "/" + stim_name;
+			if (!suite.enabled(name))
+				continue;
+
+			const bench::Params params{
+				{"n_cf", static_cast<double>(config.n_cf)},
+				{"n_fibers", static_cast<double>(config.n_low + config.n_med + config.n_high)},
+				{"n_trials", static_cast<double>(config.n_trials)},
+				{"duration", stim.stimulus_duration}};
+
+			utils::set_seed(42);
+			double cpu_seconds = 0.0;
+			double peak_rss = 0.0;
+			profiler::Report profile;
+			auto result = suite.measure(name, params, stim.n_simulation_timesteps, [&]()
+										{
+				bench::reset_peak_rss();
+				return std::make_unique<Neurogram>(config.n_cf, config.n_low, config.n_med, config.n_high); }, [&](std::unique_ptr<Neurogram> &ng)
+										{
+				const double start = cpu_time();
+				ng->create(stim, 1, config.n_trials, HUMAN_SHERA, RANDOM, config.power_law);
+				cpu_seconds += cpu_time() - start;
+				peak_rss = std::max(peak_rss, bench::peak_rss());
+				profile = ng->profile(); });
+
+			const double n_runs = static_cast<double>(options.warmup + options.repetitions);
+			const double rtf = stim.stimulus_duration / result.median;
+			result.metrics.insert(result.metrics.begin(), {
+				{"rtf", rtf},
+				{"audio_per_core_second", rtf / static_cast<double>(utils::N_THREADS)},
+				{"audio_per_cpu_second", stim.stimulus_duration / (cpu_seconds / n_runs)},
+				{"n_threads", static_cast<double>(utils::N_THREADS)},
+				{"peak_rss_mb", peak_rss / (1 << 20)}});
+			// Counters (per sample of the stimulus) and allocations of the last repetition
+			for (size_t s = 0; s < profiler::N_STAGES; s++)
+			{
+				const auto stage = profiler::stage_name(static_cast<profiler::Stage>(s));
+				for (auto &metric : bench::counter_metrics(profile.total[s].counters, static_cast<double>(stim.n_simulation_timesteps), std::string(stage) + "_"))
+					result.metrics.push_back(std::move(metric));
+				if (const auto &allocations = profile.total[s].allocations; allocations.count)
+				{
+					result.metrics.emplace_back(std::string(stage) + "_allocations", static_cast<double>(allocations.count));
+					result.metrics.emplace_back(std::string(stage) + "_allocated_mb", static_cast<double>(allocations.bytes) / (1 << 20));
+				}
+			}
+			suite.add(std::move(result));
+		}
+	}
+	suite.save();
+
+	const size_t n_regressions = suite.check_regressions("rtf", true) + suite.check_regressions("peak_rss_mb", false, rss_threshold);
+	return n_regressions ? 2 : 0;
+}
@@ -0,0 +1,259 @@
+/*
+ * Strong and weak scaling of Neurogram::create over the number of threads, for workloads of different shapes.
+ *
+ *	bruce_bench_scaling [--repetitions N] [--output FILE.json] [--threads 1,2,4,...] [--mode strong|weak|both]
+ *	                    [--pin] [--quick]
+ *
+ * Strong scaling runs a fixed workload on an increasing number of threads (utils::set_n_threads), weak scaling
+ * grows the number of CFs with the number of threads. Every result reports, relative to the run on the fewest
+ * threads of the same workload:
+ *
+ *	speedup       t(p_min) / t(p) for strong scaling, and the scaled speedup p * t(p_min) / t(p) / p_min for weak scaling
+ *	efficiency    speedup * p_min / p
+ *	idle_fraction the fraction of the core-seconds (p * wall time) in which the process was not running on a core,
+ *	              which is time lost to the serial parts of create, load imbalance at the end of the parallel loops,
+ *	              thread startup and blocking on the output lock
+ *	lock_wait_s   the time spent waiting for the output lock, summed over the threads (from the stage timers)
+ *
+ * By default, the thread counts are the powers of two up to the hardware concurrency (at most 64), and the hardware
+ * concurrency itself. With --pin (Linux only), the process is restricted to the first p cores it may run on, such
+ * that idle cores cannot absorb background work.
+ */
+
+#include <ctime>
+#include <thread>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "bruce.h"
+#include "harness.h"
+
+namespace
+{
+	struct Shape
+	{
+		std::string name;
+		size_t n_cf;
+		size_t n_low;
+		size_t n_med;
+		size_t n_high;
+		int n_trials;
+		double duration;
+	};
+
+	//! Fixed workloads for strong scaling
+	std::vector<Shape> strong_shapes(const bool quick)
+	{
+		if (quick)
+			return {{"strong/few_cfs_many_fibers", 2, 1, 1, 6, 1, 0.05},
+					{"strong/many_cfs", 16, 1, 0, 0, 1, 0.05}};
+		return {{"strong/few_cfs_many_fibers", 4, 10, 10, 80, 1, 0.25},
+				{"strong/many_cfs", 128, 1, 1, 2, 1, 0.25},
+				{"strong/long_stimulus", 16, 2, 2, 6, 1, 2.0},
+				{"strong/short_stimulus", 16, 2, 2, 6, 1, 0.05},
+				{"strong/many_trials", 16, 1, 1, 3, 50, 0.25}};
+	}
+
+	//! Workloads per thread for weak scaling, of which the number of CFs is multiplied by the number of threads
+	std::vector<Shape> weak_shapes(const bool quick)
+	{
+		if (quick)
+			return {{"weak/cfs_per_thread", 2, 1, 0, 1, 1, 0.05}};
+		return {{"weak/cfs_per_thread", 4, 1, 1, 3, 1, 0.25},
+				{"weak/cfs_per_thread_long", 1, 2, 2, 6, 1, 1.0}};
+	}
+
+	std::vector<size_t> default_thread_counts()
+	{
+		const size_t n_cores = std::max<size_t>(1, std::thread::hardware_concurrency());
+		std::vector<size_t> counts;
+		for (size_t p = 1; p <= std::min<size_t>(n_cores, 64); p *= 2)
+			counts.push_back(p);
+		if (counts.back() != n_cores && n_cores <= 64)
+			counts.push_back(n_cores);
+		return counts;
+	}
+
+	std::vector<size_t> parse_thread_counts(const std::string &list)
+	{
+		std::vector<size_t> counts;
+		std::stringstream ss(list);
+		for (std::string item; std::getline(ss, item, ',');)
+			counts.push_back(std::max<size_t>(1, std::stoul(item)));
+		std::sort(counts.begin(), counts.end());
+		counts.erase(std::unique(counts.begin(), counts.end()), counts.end());
+		return counts;
+	}
+
+	double cpu_time()
+	{
+		return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+	}
+
+	/**
+	 * Restricts the process to the first n cores of its original affinity mask while in scope. Threads inherit
+	 * the affinity of the thread that creates them, so this covers the workers of utils::parallel_for.
+	 */
+	class CorePinning
+	{
+#if defined(__linux__)
+		cpu_set_t original_{};
+		bool pinned_ = false;
+#endif
+
+	public:
+		CorePinning(const bool enabled, const size_t n)
+		{
+#if defined(__linux__)
+			if (!enabled || sched_getaffinity(0, sizeof(original_), &original_) != 0)
+				return;
+			cpu_set_t mask;
+			CPU_ZERO(&mask);
+			for (int cpu = 0, n_set = 0; cpu < CPU_SETSIZE && static_cast<size_t>(n_set) < n; cpu++)
+				if (CPU_ISSET(cpu, &original_))
+				{
+					CPU_SET(cpu, &mask);
+					n_set++;
+				}
+			pinned_ = sched_setaffinity(0, sizeof(mask), &mask) == 0;
+#else
+			if (enabled)
+				std::cerr << "--pin is only supported on Linux\n";
+#endif
+		}
+
+		CorePinning(const CorePinning &) = delete;
+		CorePinning &operator=(const CorePinning &) = delete;
+
+		~CorePinning()
+		{
+#if defined(__linux__)
+			if (pinned_)
+				sched_setaffinity(0, sizeof(original_), &original_);
+#endif
+		}
+	};
+
+	struct Sweep
+	{
+		bench::Suite &suite;
+		const std::vector<size_t> &thread_counts;
+		bool pin;
+
+		//! Run a workload on every thread count, shape_for(p) gives the workload on p threads
+		template <typename ShapeFor>
+		void run(const std::string &name, const bool weak, ShapeFor &&shape_for)
+		{
+			if (!suite.enabled(name))
+				return;
+
+			double reference_time = 0.0;
+			size_t reference_threads = 0;
+			for (const size_t p : thread_counts)
+			{
+				const Shape shape = shape_for(p);
+				const auto stim = stimulus::ramped_sine_wave(shape.duration, shape.duration + 0.01, 100000, 2.5e-3, 5e-3, 1e3, 60.0);
+				const bench::Params params{
+					{"n_threads", static_cast<double>(p)},
+					{"n_cf", static_cast<double>(shape.n_cf)},
+					{"n_fibers", static_cast<double>(shape.n_low + shape.n_med + shape.n_high)},
+					{"n_trials", static_cast<double>(shape.n_trials)},
+					{"duration", shape.duration}};
+
+				CorePinning pinning(pin, p);
+				utils::set_n_threads(p);
+				utils::set_seed(42);
+
+				std::vector<double> cpu_seconds;
+				std::vector<double> lock_wait;
+				auto result = suite.measure(name, params, stim.n_simulation_timesteps, [&]()
+											{ return std::make_unique<Neurogram>(shape.n_cf, shape.n_low, shape.n_med, shape.n_high); }, [&](std::unique_ptr<Neurogram> &ng)
+											{
+					const double start = cpu_time();
+					ng->create(stim, 1, shape.n_trials, HUMAN_SHERA, RANDOM, APPROXIMATED);
+					cpu_seconds.push_back(cpu_time() - start);
+					const auto &profile = ng->profile();
+					lock_wait.push_back(static_cast<double>(profile.total[profiler::LOCK_WAIT].total) * profile.seconds_per_tick); });
+
+				// The timed repetitions are the last ones
+				const auto timed = [&](const std::vector<double> &x)
+				{
+					return bench::median(std::vector<double>(x.end() - static_cast<std::ptrdiff_t>(result.times.size()), x.end()));
+				};
+				if (reference_threads == 0)
+				{
+					reference_time = result.median;
+					reference_threads = p;
+				}
+				const double ratio = static_cast<double>(p) / static_cast<double>(reference_threads);
+				const double speedup = reference_time / result.median * (weak ? ratio : 1.0);
+				const double core_seconds = static_cast<double>(p) * result.median;
+				result.metrics.insert(result.metrics.begin(), {
+					{"speedup", speedup},
+					{"efficiency", speedup / ratio},
+					{"idle_fraction", std::max(0.0, 1.0 - timed(cpu_seconds) / core_seconds)},
+					{"lock_wait_s", timed(lock_wait)},
+					{"audio_per_core_second", shape.duration / core_seconds}});
+				suite.add(std::move(result));
+			}
+		}
+	};
+}
+
+int main(const int argc, char **argv)
+{
+	bench::Options defaults;
+	defaults.warmup = 1;
+	defaults.repetitions = 3;
+
+	std::vector<size_t> thread_counts = default_thread_counts();
+	std::string mode = "both";
+	bool pin = false;
+	const auto options = bench::parse_options(
+		argc, argv, [&](const std::string &arg, const std::function<std::string()> &value)
+		{
+			if (arg == "--threads")
+				thread_counts = parse_thread_counts(value());
+			else if (arg == "--mode")
+				mode = value();
+			else if (arg == "--pin")
+				pin = true;
+			else
+				return false;
+			return true; },
+		" [--threads 1,2,4,...] [--mode strong|weak|both] [--pin]",
+		defaults);
+
+	if (mode != "strong" && mode != "weak" && mode != "both")
+	{
+		std::cerr << "--mode should be strong, weak or both\n";
+		return 1;
+	}
+
+	// The stage timers measure the time spent waiting for the output lock
+	profiler::set_enabled(true);
+	if (!profiler::enabled())
+		std::cerr << "stage timers are compiled out (BRUCE_PROFILE), lock_wait_s is not measured\n";
+
+	bench::Suite suite(options);
+	Sweep sweep{suite, thread_counts, pin};
+	const size_t n_threads = utils::N_THREADS;
+
+	if (mode != "weak")
+		for (const auto &shape : strong_shapes(options.quick))
+			sweep.run(shape.name, false, [&](size_t)
+					  { return shape; });
+	if (mode != "strong")
+		for (const auto &shape : weak_shapes(options.quick))
+			sweep.run(shape.name, true, [&](const size_t p)
+					  {
+				auto scaled = shape;
+				scaled.n_cf *= p;
+				return scaled; });
+
+	utils::set_n_threads(n_threads);
+	suite.save();
+	return 0;
+}
@@ -0,0 +1,229 @@
+/*
+ * Micro-benchmarks of the individual stages of the model, over a grid of CFs, sampling rates and stimulus durations.
+ *
+ *	bruce_bench_stages [--warmup N] [--repetitions N] [--filter NAME] [--output FILE.json] [--quick] [--allocations]
+ *
+ * With --allocations, the filter kernels are required to be allocation free, and the exit code is 3 when one allocates.
+ */
+
+#include <valarray>
+
+#include "bruce.h"
+#include "harness.h"
+
+namespace
+{
+	constexpr Species SPECIES = HUMAN_SHERA;
+	constexpr double SPONT = 100.0;
+	constexpr double TABS = 0.7e-3;
+	constexpr double TREL = 0.6e-3;
+	constexpr double SYNAPSE_SAMPLING_FREQUENCY = 10e3;
+
+	struct Grid
+	{
+		std::vector<double> cfs;
+		std::vector<double> sampling_rates;
+		std::vector<double> durations;
+	};
+
+	Grid make_grid(const bool quick)
+	{
+		if (quick)
+			return {{1e3}, {100e3}, {0.05}};
+		return {{250, 1e3, 4e3, 16e3}, {100e3, 200e3, 500e3}, {0.05, 0.25}};
+	}
+
+	//! Intermediate signals of the model for a single CF, used as realistic inputs for the stage benchmarks
+	struct Trace
+	{
+		stimulus::Stimulus stim;
+		std::vector<double> me_out;
+		std::vector<double> tau_c1;
+		double bm_tau_max;
+		double ratio_bm;
+		std::vector<double> ihc;
+		std::vector<double> mapped;
+
+		Trace(const double cf, const double fs, const double duration)
+			: stim(stimulus::ramped_sine_wave(duration, 1.2 * duration, static_cast<size_t>(fs), 2.5e-3, 0.0, cf, 60.0))
+		{
+			ihc::MiddleEarFilter me_filter(stim.time_resolution, SPECIES);
+			ihc::WideBandGammaToneFilter wb_filter(stim.time_resolution, cf, SPECIES, 1.0);
+			ihc::BoltzmanFilter boltzman_filter{7.0};
+			ihc::LowPassFilter<2> ohc_low_pass_filter(stim.time_resolution, 600.);
+			ihc::PostOhcFilter post_ohc_filter{1.0, wb_filter.bm_tau_min, wb_filter.bm_tau_max, 7.0};
+
+			for (size_t n = 0; n < stim.n_simulation_timesteps; n++)
+			{
+				me_out.push_back(me_filter(n < stim.n_stimulation_timesteps ? stim.data[n] : 0.0));
+				const double wb_out = wb_filter(me_out.back());
+				tau_c1.push_back(post_ohc_filter(ohc_low_pass_filter(boltzman_filter(wb_out))));
+				wb_filter.shift_poles(tau_c1.back(), n);
+			}
+			bm_tau_max = wb_filter.bm_tau_max;
+			ratio_bm = wb_filter.ratio_bm;
+
+			ihc = inner_hair_cell(stim, cf, 1, 1.0, 1.0, SPECIES);
+			mapped = synapse_mapping::map(ihc, SPONT, cf, stim.time_resolution, SOFTPLUS);
+		}
+
+		[[nodiscard]] size_t n() const
+		{
+			return stim.n_simulation_timesteps;
+		}
+	};
+
+	void bench_ihc_stages(bench::Suite &suite, const Trace &t, const bench::Params &params, const double cf)
+	{
+		const double tres = t.stim.time_resolution;
+
+		suite.run("middle_ear", params, t.n(), [&]()
+				  {
+			ihc::MiddleEarFilter filter(tres, SPECIES);
+			double sink = 0.0;
+			for (size_t i = 0; i < t.n(); i++)
+				sink += filter(i < t.stim.n_stimulation_timesteps ? t.stim.data[i] : 0.0);
+			bench::do_not_optimize(sink); });
+
+		// The filter state is allocated on construction, which is left out of the timed region
+		suite.run("wideband_gammatone", params, t.n(), [&]()
+				  { return ihc::WideBandGammaToneFilter(tres, cf, SPECIES, 1.0); }, [&](ihc::WideBandGammaToneFilter &filter)
+				  {
+			double sink = 0.0;
+			for (size_t i = 0; i < t.n(); i++)
+			{
+				sink += filter(t.me_out[i]);
+				filter.shift_poles(t.tau_c1[i], i);
+			}
+			bench::do_not_optimize(sink); });
+
+		suite.run("chirp_c1", params, t.n(), [&]()
+				  {
+			ihc::ChirpFilter filter(tres, cf, t.bm_tau_max, true);
+			double sink = 0.0;
+			for (size_t i = 0; i < t.n(); i++)
+				sink += filter(t.me_out[i], 1 / t.tau_c1[i] - 1 / t.bm_tau_max);
+			bench::do_not_optimize(sink); });
+
+		suite.run("chirp_c2", params, t.n(), [&]()
+				  {
+			ihc::ChirpFilter filter(tres, cf, t.bm_tau_max, false);
+			double sink = 0.0;
+			for (size_t i = 0; i < t.n(); i++)
+				sink += filter(t.me_out[i], 1 / t.ratio_bm);
+			bench::do_not_optimize(sink); });
+
+		suite.run("low_pass_2", params, t.n(), [&]()
+				  {
+			ihc::LowPassFilter<2> filter(tres, 600.);
+			double sink = 0.0;
+			for (size_t i = 0; i < t.n(); i++)
+				sink += filter(t.me_out[i]);
+			bench::do_not_optimize(sink); });
+
+		suite.run("low_pass_7", params, t.n(), [&]()
+				  {
+			ihc::LowPassFilter<7> filter(tres, 3000.);
+			double sink = 0.0;
+			for (size_t i = 0; i < t.n(); i++)
+				sink += filter(t.me_out[i]);
+			bench::do_not_optimize(sink); });
+
+		suite.run("inner_hair_cell", params, t.n(), [&]()
+				  { bench::do_not_optimize(inner_hair_cell(t.stim, cf, 1, 1.0, 1.0, SPECIES)); });
+
+		suite.run("synapse_mapping", params, t.n(), [&]()
+				  { bench::do_not_optimize(synapse_mapping::map(t.ihc, SPONT, cf, tres, SOFTPLUS)); });
+	}
+
+	void bench_synapse_stages(bench::Suite &suite, const Trace &t, const bench::Params &params, const double cf)
+	{
+		const double tres = t.stim.time_resolution;
+		const int delay_point = static_cast<int>(floor(7500 / (cf / 1e3)));
+		const int n = static_cast<int>(floor((t.n() + 2.0 * delay_point) * tres * SYNAPSE_SAMPLING_FREQUENCY));
+		const auto random_numbers = utils::fast_fractional_gaussian_noise(n, RANDOM, SPONT);
+		const auto mapped = utils::Span<double>(t.mapped);
+
+		suite.run("pla_approximate", params, static_cast<size_t>(n), [&]()
+				  { return std::vector<double>(n); }, [&](std::vector<double> &out)
+				  {
+			pla::approximate(mapped, random_numbers, n, 1.5e-6 * 100e3, 1e-2 * 100e3, out);
+			bench::do_not_optimize(out.data()); });
+
+		suite.run("pla_actual", params, static_cast<size_t>(n), [&]()
+				  { return std::vector<double>(n); }, [&](std::vector<double> &out)
+				  {
+			pla::actual(mapped, random_numbers, n, 1.5e-6 * 100e3, 1e-2 * 100e3, 5e-4, 1e-1, 1 / SYNAPSE_SAMPLING_FREQUENCY, out);
+			bench::do_not_optimize(out.data()); });
+
+		const auto synapse_out = synapse(t.mapped, cf, 1, t.n(), tres, RANDOM, APPROXIMATED, SPONT, TABS, TREL, false);
+		suite.run("spike_generator_4", params, t.n(), [&]()
+				  {
+			syn::SynapseOutput res(1, static_cast<int>(t.n()));
+			res.synaptic_output = synapse_out.synaptic_output;
+			return res; }, [&](syn::SynapseOutput &res)
+				  { bench::do_not_optimize(syn::spike_generator<4>(tres, SPONT, TABS, TREL, res)); });
+
+		suite.run("synapse", params, t.n(), [&]()
+				  { bench::do_not_optimize(synapse(t.mapped, cf, 1, t.n(), tres, RANDOM, APPROXIMATED, SPONT, TABS, TREL, false)); });
+	}
+
+	void bench_signal_processing(bench::Suite &suite, const Grid &grid)
+	{
+		for (const double duration : grid.durations)
+		{
+			const int n = static_cast<int>(duration * SYNAPSE_SAMPLING_FREQUENCY);
+			suite.run("fractional_gaussian_noise", {{"duration", duration}}, static_cast<size_t>(n), [&]()
+					  { bench::do_not_optimize(utils::fast_fractional_gaussian_noise(n, RANDOM, SPONT)); });
+
+			for (const double fs : grid.sampling_rates)
+			{
+				const auto n_samples = static_cast<size_t>(duration * fs);
+				const int down_factor = static_cast<int>(fs / SYNAPSE_SAMPLING_FREQUENCY);
+				const auto signal = utils::randn(n_samples);
+				suite.run("resample", {{"fs", fs}, {"duration", duration}}, n_samples, [&]()
+						  { return signal; }, [&](std::vector<double> &x)
+						  { bench::do_not_optimize(resample(1, down_factor, x)); });
+			}
+		}
+
+		for (const size_t n : suite.options().quick ? std::vector<size_t>{1 << 12} : std::vector<size_t>{1 << 10, 1 << 14, 1 << 17})
+		{
+			const auto signal = utils::randn(n);
+			suite.run("fft", {{"n", static_cast<double>(n)}}, n, [&]()
+					  {
+				std::valarray<std::complex<double>> x(n);
+				for (size_t i = 0; i < n; i++)
+					x[i] = signal[i];
+				return x; }, [](std::valarray<std::complex<double>> &x)
+					  {
+				utils::fft(x);
+				bench::do_not_optimize(x[0]); });
+		}
+	}
+}
+
+int main(const int argc, char **argv)
+{
+	bench::Suite suite(bench::parse_options(argc, argv));
+	const auto grid = make_grid(suite.options().quick);
+	utils::set_seed(42);
+
+	for (const double fs : grid.sampling_rates)
+		for (const double cf : grid.cfs)
+			for (const double duration : grid.durations)
+			{
+				const Trace trace(cf, fs, duration);
+				const bench::Params params{{"cf", cf}, {"fs", fs}, {"duration", duration}};
+				bench_ihc_stages(suite, trace, params, cf);
+				bench_synapse_stages(suite, trace, params, cf);
+			}
+
+	bench_signal_processing(suite, grid);
+	suite.save();
+
+	// The per-sample filter loops should not touch the heap once their state is constructed
+	const size_t n_allocating = suite.check_allocation_free([](const std::string &name)
+															{ return name == "middle_ear" || name == "wideband_gammatone" || name.rfind("chirp_", 0) == 0 || name.rfind("low_pass_", 0) == 0; });
+	return n_allocating ? 3 : 0;
+}
@@ -0,0 +1,504 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "memory_accounting.h"
+#include "perf_counters.h"
+
+/**
+ * Minimal benchmark harness. Each benchmark is warmed up, and then timed for a number of repetitions, of which
+ * the median and the median absolute deviation (MAD) are reported. Results can be written as JSON, such that
+ * they can be compared across commits.
+ */
+namespace bench
+{
+	using Clock = std::chrono::steady_clock;
+
+	//! Named numeric parameters of a benchmark, i.e. {{"cf", 1e3}, {"fs", 100e3}}
+	using Params = std::vector<std::pair<std::string, double>>;
+
+	struct Options
+	{
+		size_t warmup = 2;
+		size_t repetitions = 10;
+		//! Only run benchmarks whose name contains this string
+		std::string filter;
+		//! Path of the JSON output, empty for none
+		std::string output;
+		//! Reduced parameter grid, for smoke testing
+		bool quick = false;
+		//! Path of the JSON output of an earlier run to compare against, empty for none
+		std::string baseline;
+		//! Maximum allowed relative regression with respect to the baseline
+		double threshold = 0.1;
+		//! Read hardware performance counters around every repetition, if available
+		bool counters = false;
+		//! Count the allocations of every repetition, if supported
+		bool allocations = false;
+	};
+
+	//! Handler for benchmark specific arguments, returns false for unknown arguments. value() consumes the next argument.
+	using ArgumentHandler = std::function<bool(const std::string &arg, const std::function<std::string()> &value)>;
+
+	inline void print_usage(const char *program, const std::string &extra = "")
+	{
+		std::cout << "usage: " << program
+				  << " [--warmup N] [--repetitions N] [--filter NAME] [--output FILE.json] [--quick]"
+				  << " [--baseline FILE.json] [--threshold FRACTION] [--counters] [--allocations]" << extra << "\n";
+	}
+
+	inline Options parse_options(const int argc, char **argv, const ArgumentHandler &handler = nullptr, const std::string &usage = "", Options options = {})
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			const std::string arg = argv[i];
+			const auto value = [&]() -> std::string
+			{
+				if (i + 1 >= argc)
+				{
+					print_usage(argv[0], usage);
+					std::exit(1);
+				}
+				return argv[++i];
+			};
+
+			if (arg == "--warmup")
+				options.warmup = std::stoul(value());
+			else if (arg == "--repetitions")
+				options.repetitions = std::max<size_t>(1, std::stoul(value()));
+			else if (arg == "--filter")
+				options.filter = value();
+			else if (arg == "--output")
+				options.output = value();
+			else if (arg == "--quick")
+				options.quick = true;
+			else if (arg == "--baseline")
+				options.baseline = value();
+			else if (arg == "--threshold")
+				options.threshold = std::stod(value());
+			else if (arg == "--counters")
+				options.counters = true;
+			else if (arg == "--allocations")
+				options.allocations = true;
+			else if (!handler || !handler(arg, value))
+			{
+				print_usage(argv[0], usage);
+				std::exit(arg == "--help" ? 0 : 1);
+			}
+		}
+		return options;
+	}
+
+	//! Prevent the compiler from optimizing away the computation of value
+	template <typename T>
+	void do_not_optimize(const T &value)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		asm volatile("" : : "r,m"(value) : "memory");
+#else
+		static volatile const void *sink;
+		sink = &value;
+#endif
+	}
+
+	inline double median(std::vector<double> x)
+	{
+		if (x.empty())
+			return 0.0;
+		std::sort(x.begin(), x.end());
+		const size_t n = x.size();
+		return n % 2 ? x[n / 2] : (x[n / 2 - 1] + x[n / 2]) / 2.0;
+	}
+
+	inline double median_absolute_deviation(const std::vector<double> &x, const double m)
+	{
+		std::vector<double> deviation(x.size());
+		std::transform(x.begin(), x.end(), deviation.begin(), [m](const double xi)
+					   { return std::abs(xi - m); });
+		return median(deviation);
+	}
+
+	//! Peak resident set size of the process in bytes, or 0 when unavailable
+	inline double peak_rss()
+	{
+		return memory::peak_rss();
+	}
+
+	//! Reset the peak resident set size to the current value (Linux only), such that peaks can be attributed to a single run
+	inline void reset_peak_rss()
+	{
+		memory::reset_peak_rss();
+	}
+
+	//! Metrics of hardware counters over n_samples samples: ipc and events per sample
+	inline Params counter_metrics(const perf::Counts &counts, const double n_samples, const std::string &prefix = "")
+	{
+		Params metrics;
+		if (counts.has(perf::CYCLES) && counts.has(perf::INSTRUCTIONS))
+			metrics.emplace_back(prefix + "ipc", counts.ipc());
+		for (const auto event : {perf::CACHE_MISSES, perf::BRANCH_MISSES, perf::FP_ASSISTS})
+			if (counts.has(event))
+				metrics.emplace_back(prefix + perf::event_name(event) + "_per_sample", static_cast<double>(counts.values[event]) / n_samples);
+		return metrics;
+	}
+
+	inline std::string escape(const std::string &s)
+	{
+		std::string out;
+		for (const char c : s)
+		{
+			if (c == '"' || c == '\\')
+				out += '\\';
+			out += c;
+		}
+		return out;
+	}
+
+	struct Result
+	{
+		std::string name;
+		Params params;
+		//! Number of samples processed per repetition
+		size_t n_samples;
+		//! Wall time in seconds of each repetition
+		std::vector<double> times;
+		double median;
+		double mad;
+		double min;
+		//! Additional, benchmark specific, metrics
+		Params metrics;
+
+		[[nodiscard]] double samples_per_second() const
+		{
+			return median > 0 ? static_cast<double>(n_samples) / median : 0.0;
+		}
+
+		//! Identifies the benchmark across runs, i.e. for comparing against a baseline
+		[[nodiscard]] std::string key() const
+		{
+			std::ostringstream ss;
+			ss << std::setprecision(9) << name;
+			for (const auto &[k, v] : params)
+				ss << " " << k << "=" << v;
+			return ss.str();
+		}
+
+		//! Value of a metric by name, which includes the standard metrics
+		[[nodiscard]] bool get(const std::string &metric, double &value) const
+		{
+			if (metric == "median_s")
+				value = median;
+			else if (metric == "samples_per_second")
+				value = samples_per_second();
+			else
+			{
+				const auto it = std::find_if(metrics.begin(), metrics.end(), [&](const auto &m)
+											 { return m.first == metric; });
+				if (it == metrics.end())
+					return false;
+				value = it->second;
+			}
+			return true;
+		}
+	};
+
+	/**
+	 * Read the results of an earlier run, as written by Suite::write_json. Only the fields needed to compare
+	 * against are read (name, params and numeric metrics), which relies on write_json emitting a result per line.
+	 */
+	inline std::vector<Result> read_results(const std::string &path)
+	{
+		std::ifstream is(path);
+		if (!is)
+			throw std::runtime_error("cannot read " + path);
+
+		// Reads "key": value pairs from a flat json fragment
+		const auto read_pairs = [](const std::string &text, const auto &on_pair)
+		{
+			for (size_t pos = text.find('"'); pos != std::string::npos; pos = text.find('"', pos))
+			{
+				const size_t end = text.find('"', pos + 1);
+				const std::string key = text.substr(pos + 1, end - pos - 1);
+				size_t value_start = text.find_first_not_of(": ", end + 1);
+				if (value_start == std::string::npos)
+					break;
+				if (text[value_start] == '"')
+				{
+					const size_t value_end = text.find('"', value_start + 1);
+					on_pair(key, text.substr(value_start + 1, value_end - value_start - 1), 0.0);
+					pos = value_end + 1;
+				}
+				else if (text[value_start] == '{')
+				{
+					pos = value_start;
+				}
+				else
+				{
+					size_t value_end = text.find_first_of(",}", value_start);
+					on_pair(key, "", std::stod(text.substr(value_start, value_end - value_start)));
+					pos = value_end;
+				}
+			}
+		};
+
+		std::vector<Result> results;
+		for (std::string line; std::getline(is, line);)
+		{
+			const size_t params_start = line.find("\"params\": {");
+			if (line.find("{\"name\"") == std::string::npos || params_start == std::string::npos)
+				continue;
+			const size_t params_end = line.find('}', params_start);
+
+			Result result{};
+			read_pairs(line.substr(params_end + 1), [&](const std::string &key, const std::string &, const double value)
+					   {
+				if (key == "n_samples")
+					result.n_samples = static_cast<size_t>(value);
+				else if (key == "median_s")
+					result.median = value;
+				else if (key == "mad_s")
+					result.mad = value;
+				else if (key == "min_s")
+					result.min = value;
+				else if (key != "samples_per_second")
+					result.metrics.emplace_back(key, value); });
+			read_pairs(line.substr(params_start + 10, params_end - params_start - 9), [&](const std::string &key, const std::string &, const double value)
+					   { result.params.emplace_back(key, value); });
+			read_pairs(line.substr(0, params_start), [&](const std::string &key, const std::string &text, double)
+					   {
+				if (key == "name")
+					result.name = text; });
+			results.push_back(std::move(result));
+		}
+		return results;
+	}
+
+	class Suite
+	{
+		Options options_;
+		std::vector<Result> results_;
+
+	public:
+		explicit Suite(Options options) : options_(std::move(options))
+		{
+			std::string why;
+			if (options_.counters && !perf::supported(&why))
+				std::cerr << "hardware counters are not available (" << why << "), only reporting wall time\n";
+			if (options_.allocations && !memory::supported())
+				std::cerr << "allocation counting is not available (build with BRUCE_COUNT_ALLOCATIONS on glibc)\n";
+			memory::set_enabled(options_.allocations);
+		}
+
+		[[nodiscard]] const Options &options() const
+		{
+			return options_;
+		}
+
+		[[nodiscard]] const std::vector<Result> &results() const
+		{
+			return results_;
+		}
+
+		[[nodiscard]] bool enabled(const std::string &name) const
+		{
+			return options_.filter.empty() || name.find(options_.filter) != std::string::npos;
+		}
+
+		/**
+		 * Time a benchmark, without recording the result. setup() is called before every repetition, outside the
+		 * timed region, and its result is passed to body. With Options::counters, the hardware counters of the
+		 * calling thread over all repetitions are added to the metrics. With Options::allocations, the allocations
+		 * of all threads per repetition are added as allocations_per_run, allocated_bytes_per_run and
+		 * peak_live_bytes (the largest over all repetitions).
+		 * @param name the name of the benchmark
+		 * @param params the parameters of this instance of the benchmark
+		 * @param n_samples the number of samples processed by a single call of body
+		 * @param setup callable returning the (mutable) input of body
+		 * @param body the timed callable
+		 * @return the result
+		 */
+		template <typename Setup, typename Body>
+		Result measure(const std::string &name, const Params &params, const size_t n_samples, Setup &&setup, Body &&body)
+		{
+			for (size_t i = 0; i < options_.warmup; i++)
+			{
+				auto input = setup();
+				body(input);
+			}
+
+			Result result{name, params, n_samples, {}, 0.0, 0.0, 0.0, {}};
+			result.times.reserve(options_.repetitions);
+			std::unique_ptr<perf::CounterGroup> counters;
+			if (options_.counters)
+				counters = std::make_unique<perf::CounterGroup>();
+			perf::Counts counts;
+			memory::Allocations allocations;
+			for (size_t i = 0; i < options_.repetitions; i++)
+			{
+				auto input = setup();
+				const auto start_counts = counters ? counters->read() : perf::Counts{};
+				memory::reset();
+				const auto start = Clock::now();
+				body(input);
+				result.times.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+				allocations.merge(memory::totals());
+				if (counters)
+					counts += counters->read() - start_counts;
+			}
+			result.metrics = counter_metrics(counts, static_cast<double>(n_samples * options_.repetitions));
+			if (memory::enabled())
+			{
+				const auto n = static_cast<double>(options_.repetitions);
+				result.metrics.emplace_back("allocations_per_run", static_cast<double>(allocations.count) / n);
+				result.metrics.emplace_back("allocated_bytes_per_run", static_cast<double>(allocations.bytes) / n);
+				result.metrics.emplace_back("peak_live_bytes", static_cast<double>(allocations.peak_live));
+			}
+			result.median = median(result.times);
+			result.mad = median_absolute_deviation(result.times, result.median);
+			result.min = *std::min_element(result.times.begin(), result.times.end());
+			return result;
+		}
+
+		/**
+		 * Check that the benchmarks for which steady_state(name) holds did not allocate, when allocations were counted.
+		 * @return the number of benchmarks that allocated
+		 */
+		template <typename Predicate>
+		size_t check_allocation_free(Predicate &&steady_state) const
+		{
+			size_t n_allocating = 0;
+			for (const auto &result : results_)
+			{
+				double allocations;
+				if (!steady_state(result.name) || !result.get("allocations_per_run", allocations) || allocations == 0)
+					continue;
+				std::cout << "ALLOCATES " << result.key() << ": " << allocations << " allocations per run\n";
+				n_allocating++;
+			}
+			return n_allocating;
+		}
+
+		//! Record a result
+		void add(Result result)
+		{
+			print(result);
+			results_.push_back(std::move(result));
+		}
+
+		//! Time and record a benchmark, if it is enabled, see measure
+		template <typename Setup, typename Body>
+		void run(const std::string &name, const Params &params, const size_t n_samples, Setup &&setup, Body &&body)
+		{
+			if (enabled(name))
+				add(measure(name, params, n_samples, std::forward<Setup>(setup), std::forward<Body>(body)));
+		}
+
+		//! Time a benchmark without per-repetition setup
+		template <typename Body>
+		void run(const std::string &name, const Params &params, const size_t n_samples, Body &&body)
+		{
+			run(name, params, n_samples, []()
+				{ return 0; }, [&body](int)
+				{ body(); });
+		}
+
+		static void print(const Result &result)
+		{
+			std::ostringstream ss;
+			ss << std::left << std::setw(28) << result.name;
+			for (const auto &[key, value] : result.params)
+				ss << key << "=" << value << " ";
+			std::cout << std::left << std::setw(72) << ss.str()
+					  << std::right << std::setw(12) << std::setprecision(4) << result.median * 1e3 << " ms"
+					  << " +- " << std::setw(8) << std::setprecision(3) << result.mad * 1e3 << " ms"
+					  << std::setw(14) << std::setprecision(4) << result.samples_per_second() / 1e6 << " MS/s";
+			for (const auto &[key, value] : result.metrics)
+				std::cout << "  " << key << "=" << std::setprecision(4) << value;
+			std::cout << std::endl;
+		}
+
+		void write_json(std::ostream &os) const
+		{
+			os << std::setprecision(9) << "{\n  \"warmup\": " << options_.warmup
+			   << ",\n  \"repetitions\": " << options_.repetitions << ",\n  \"results\": [";
+			for (size_t i = 0; i < results_.size(); i++)
+			{
+				const auto &r = results_[i];
+				os << (i ? ",\n" : "\n") << "    {\"name\": \"" << escape(r.name) << "\", \"params\": {";
+				for (size_t j = 0; j < r.params.size(); j++)
+					os << (j ? ", " : "") << "\"" << escape(r.params[j].first) << "\": " << r.params[j].second;
+				os << "}, \"n_samples\": " << r.n_samples
+				   << ", \"median_s\": " << r.median
+				   << ", \"mad_s\": " << r.mad
+				   << ", \"min_s\": " << r.min
+				   << ", \"samples_per_second\": " << r.samples_per_second();
+				for (const auto &[key, value] : r.metrics)
+					os << ", \"" << escape(key) << "\": " << value;
+				os << "}";
+			}
+			os << "\n  ]\n}\n";
+		}
+
+		/**
+		 * Compare a metric of the results against the baseline given in the options, if any. Results without
+		 * a counterpart in the baseline are skipped.
+		 * @param metric the name of the metric
+		 * @param higher_is_better whether an increase of the metric is an improvement
+		 * @param threshold maximum allowed relative regression, defaults to the threshold given in the options
+		 * @return the number of regressions
+		 */
+		[[nodiscard]] size_t check_regressions(const std::string &metric, const bool higher_is_better, double threshold = -1.0) const
+		{
+			if (options_.baseline.empty())
+				return 0;
+			if (threshold < 0)
+				threshold = options_.threshold;
+
+			const auto baseline = read_results(options_.baseline);
+			size_t n_regressions = 0;
+			for (const auto &result : results_)
+			{
+				const auto it = std::find_if(baseline.begin(), baseline.end(), [&](const Result &b)
+											 { return b.key() == result.key(); });
+				double current, reference;
+				if (it == baseline.end() || !result.get(metric, current) || !it->get(metric, reference) || reference == 0.0)
+					continue;
+
+				const double change = (current - reference) / std::abs(reference);
+				const bool regressed = higher_is_better ? change < -threshold : change > threshold;
+				n_regressions += regressed;
+				std::cout << (regressed ? "REGRESSION " : "ok         ") << std::left << std::setw(64) << result.key()
+						  << metric << " " << std::setprecision(4) << reference << " -> " << current
+						  << " (" << std::showpos << change * 100.0 << std::noshowpos << "%)" << std::endl;
+			}
+			return n_regressions;
+		}
+
+		//! Write the results to the output file given in the options, if any
+		void save() const
+		{
+			if (options_.output.empty())
+				return;
+			std::ofstream os(options_.output);
+			if (!os)
+			{
+				std::cerr << "cannot write " << options_.output << std::endl;
+				std::exit(1);
+			}
+			write_json(os);
+		}
+	};
+}
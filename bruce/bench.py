@@ -0,0 +1,282 @@
+"""Benchmarks of the overhead of the Python bindings.
+
+Measures the per-call overhead and the conversion throughput (numpy <-> std::vector) of the bindings, across
+input sizes, such that optimizations of src/interface.cpp can be tracked. Results are written as JSON in the
+format of the C++ benchmarks (see bench/harness.h), and can be compared against an earlier run:
+
+    python -m bruce.bench [--quick] [--filter NAME] [--output FILE.json] [--baseline FILE.json] [--threshold FRACTION]
+
+Each benchmark is warmed up, and then timed for a number of repetitions, of which the median and the median
+absolute deviation are reported. A repetition calls the function as many times as needed to take at least
+min_time seconds, and times are reported per call.
+"""
+
+import argparse
+import json
+import sys
+import time
+from dataclasses import dataclass, field
+
+import numpy as np
+
+import bruce
+
+SAMPLING_RATE = 100_000
+CF = 1e3
+SPONT = 100.0
+TABS = 0.7e-3
+TREL = 0.6e-3
+
+SIZES = [100, 1_000, 10_000, 100_000, 1_000_000]
+QUICK_SIZES = [100, 10_000]
+
+#: The model functions run the model itself, so their largest sizes are left out
+MODEL_SIZES = [100, 1_000, 10_000, 100_000]
+NEUROGRAM_SIZES = [1_000, 10_000, 100_000]
+NEUROGRAM_N_CF = 10
+
+SYNAPSE_OUTPUT_FIELDS = [
+    "psth",
+    "synaptic_output",
+    "spike_times",
+    "redocking_time",
+    "mean_firing_rate",
+    "mean_relative_refractory_period",
+]
+
+
+@dataclass
+class Result:
+    name: str
+    params: dict
+    n_samples: int
+    median_s: float
+    mad_s: float
+    min_s: float
+    metrics: dict = field(default_factory=dict)
+
+    def key(self) -> str:
+        return self.name + "".join(f" {k}={v:g}" for k, v in self.params.items())
+
+    def to_dict(self) -> dict:
+        return {
+            "name": self.name,
+            "params": self.params,
+            "n_samples": self.n_samples,
+            "median_s": self.median_s,
+            "mad_s": self.mad_s,
+            "min_s": self.min_s,
+            "samples_per_second": self.n_samples / self.median_s if self.median_s > 0 else 0.0,
+            **self.metrics,
+        }
+
+
+def tone(n: int, dtype=np.float64) -> np.ndarray:
+    t = np.arange(n) / SAMPLING_RATE
+    return (0.02 * np.sin(2 * np.pi * CF * t)).astype(dtype)
+
+
+def stimulus(n: int, dtype=np.float64) -> "bruce.stimulus.Stimulus":
+    return bruce.stimulus.Stimulus(tone(n, dtype), SAMPLING_RATE, n / SAMPLING_RATE)
+
+
+class Suite:
+    def __init__(self, warmup: int = 2, repetitions: int = 10, min_time: float = 1e-3, name_filter: str = "",
+                 quick: bool = False, verbose: bool = True):
+        self.warmup = warmup
+        self.repetitions = repetitions
+        self.min_time = min_time
+        self.name_filter = name_filter
+        self.quick = quick
+        self.verbose = verbose
+        self.results = []
+
+    def sizes(self, sizes: list) -> list:
+        if not self.quick:
+            return sizes
+        return [n for n in sizes if n in QUICK_SIZES] or sizes[:1]
+
+    def run(self, name: str, fn, n_samples: int, n_bytes: int = 0, **params):
+        """Time fn(), which converts n_bytes between Python and C++ per call"""
+
+        if self.name_filter not in name:
+            return
+
+        # Calls per repetition, such that a repetition takes at least min_time
+        number = 1
+        while True:
+            start = time.perf_counter()
+            for _ in range(number):
+                fn()
+            if time.perf_counter() - start >= self.min_time or number >= 1 << 20:
+                break
+            number *= 2
+
+        for _ in range(self.warmup):
+            fn()
+
+        times = []
+        for _ in range(max(self.repetitions, 1)):
+            start = time.perf_counter()
+            for _ in range(number):
+                fn()
+            times.append((time.perf_counter() - start) / number)
+
+        median = float(np.median(times))
+        mad = float(np.median(np.abs(np.array(times) - median)))
+        metrics = {"per_call_us": median * 1e6, "calls_per_repetition": number}
+        if n_bytes:
+            metrics["mb_per_second"] = n_bytes / median / 1e6 if median > 0 else 0.0
+        result = Result(name, params, n_samples, median, mad, float(np.min(times)), metrics)
+        self.results.append(result)
+        if self.verbose:
+            print(f"{result.key():<56}{median * 1e6:>14.3f} us +- {mad * 1e6:>10.3f} us"
+                  + (f"{metrics['mb_per_second']:>12.1f} MB/s" if n_bytes else ""), flush=True)
+
+    def to_dict(self) -> dict:
+        return {
+            "warmup": self.warmup,
+            "repetitions": self.repetitions,
+            "results": [r.to_dict() for r in self.results],
+        }
+
+    def check_regressions(self, baseline: dict, metric: str = "median_s", threshold: float = 0.1) -> int:
+        """Compare against the results of an earlier run, returns the number of regressions (slowdowns)"""
+
+        reference = {
+            Result(r["name"], r["params"], r["n_samples"], 0, 0, 0).key(): r for r in baseline.get("results", [])
+        }
+        n_regressions = 0
+        for result in self.results:
+            other = reference.get(result.key())
+            current = result.to_dict().get(metric)
+            if other is None or current is None or not other.get(metric):
+                continue
+            change = (current - other[metric]) / abs(other[metric])
+            regressed = change > threshold
+            n_regressions += regressed
+            print(f"{'REGRESSION' if regressed else 'ok':<11}{result.key():<56}{metric} "
+                  f"{other[metric]:.4g} -> {current:.4g} ({change * 100:+.1f}%)")
+        return n_regressions
+
+
+def bench_overhead(suite: Suite):
+    suite.run("overhead/call", bruce.get_n_threads, 1)
+
+
+def bench_stimulus(suite: Suite):
+    for n in suite.sizes(SIZES):
+        for dtype in (np.float64, np.float32):
+            data = tone(n, dtype)
+            suite.run(f"stimulus/construct/{np.dtype(dtype).name}",
+                      lambda: bruce.stimulus.Stimulus(data, SAMPLING_RATE, n / SAMPLING_RATE),
+                      n, data.nbytes, n=n)
+
+        stim = stimulus(n)
+        suite.run("stimulus/data", lambda: stim.data, n, n * 8, n=n)
+
+
+def bench_inner_hair_cell(suite: Suite):
+    for n in suite.sizes(MODEL_SIZES):
+        stim = stimulus(n)
+        suite.run("inner_hair_cell", lambda: bruce.inner_hair_cell(stim, CF, 1), n, n * 8, n=n)
+
+
+def bench_map_to_synapse(suite: Suite):
+    for n in suite.sizes(SIZES):
+        ihc = bruce.inner_hair_cell(stimulus(min(n, MODEL_SIZES[-1])), CF, 1)
+        ihc = np.resize(ihc, n)
+        for dtype in (np.float64, np.float32):
+            x = ihc.astype(dtype)
+            suite.run(f"map_to_synapse/{np.dtype(dtype).name}",
+                      lambda: bruce.map_to_synapse(x, SPONT, CF, 1 / SAMPLING_RATE),
+                      n, x.nbytes + n * 8, n=n)
+
+
+def bench_synapse(suite: Suite):
+    for n in suite.sizes(MODEL_SIZES):
+        mapped = bruce.map_to_synapse(bruce.inner_hair_cell(stimulus(n), CF, 1), SPONT, CF, 1 / SAMPLING_RATE)
+        for stats in (False, True):
+            suite.run("synapse",
+                      lambda: bruce.synapse(mapped, CF, 1, n, 1 / SAMPLING_RATE, bruce.ONES, bruce.APPROXIMATED,
+                                            SPONT, TABS, TREL, stats),
+                      n, mapped.nbytes, n=n, calculate_stats=int(stats))
+
+
+def bench_synapse_output(suite: Suite):
+    for n in suite.sizes(MODEL_SIZES):
+        mapped = bruce.map_to_synapse(bruce.inner_hair_cell(stimulus(n), CF, 1), SPONT, CF, 1 / SAMPLING_RATE)
+        out = bruce.synapse(mapped, CF, 1, n, 1 / SAMPLING_RATE, bruce.ONES, bruce.APPROXIMATED,
+                            SPONT, TABS, TREL, True)
+        for name in SYNAPSE_OUTPUT_FIELDS:
+            n_bytes = np.asarray(getattr(out, name)).nbytes
+            suite.run(f"synapse_output/{name}", lambda: getattr(out, name), n, n_bytes, n=n)
+
+
+def bench_neurogram(suite: Suite):
+    for n in suite.sizes(NEUROGRAM_SIZES):
+        ng = bruce.Neurogram(NEUROGRAM_N_CF, 0, 0, 1)
+        # One bin per sample, such that the output has n_cf rows of n elements
+        ng.bin_width = 1 / SAMPLING_RATE
+        ng.create(stimulus(n))
+        n_bytes = NEUROGRAM_N_CF * ng.get_n_bins(stimulus(n)) * 8
+        suite.run("neurogram/get_output", ng.get_output, NEUROGRAM_N_CF * n, n_bytes, n=n, n_cf=NEUROGRAM_N_CF)
+        suite.run("neurogram/asarray", lambda: np.asarray(ng), NEUROGRAM_N_CF * n, n_bytes, n=n, n_cf=NEUROGRAM_N_CF)
+
+
+BENCHMARKS = [
+    bench_overhead,
+    bench_stimulus,
+    bench_inner_hair_cell,
+    bench_map_to_synapse,
+    bench_synapse,
+    bench_synapse_output,
+    bench_neurogram,
+]
+
+
+def run_all(suite: Suite):
+    for benchmark in BENCHMARKS:
+        benchmark(suite)
+
+
+def run(warmup: int = 2, repetitions: int = 10, min_time: float = 1e-3, name_filter: str = "",
+        quick: bool = False, verbose: bool = False) -> dict:
+    """Run the benchmarks, returns the results as a JSON compatible dict"""
+
+    suite = Suite(warmup, repetitions, min_time, name_filter, quick, verbose)
+    run_all(suite)
+    return suite.to_dict()
+
+
+def main(argv=None) -> int:
+    parser = argparse.ArgumentParser("python -m bruce.bench", description=__doc__.split("\n\n")[0])
+    parser.add_argument("--warmup", default=2, type=int)
+    parser.add_argument("--repetitions", default=10, type=int)
+    parser.add_argument("--min-time", default=1e-3, type=float, help="minimum time of a repetition in seconds")
+    parser.add_argument("--filter", default="", help="only run benchmarks whose name contains this string")
+    parser.add_argument("--quick", action="store_true", help="reduced set of sizes, for smoke testing")
+    parser.add_argument("--output", help="path of the JSON output")
+    parser.add_argument("--baseline", help="path of the JSON output of an earlier run to compare against")
+    parser.add_argument("--threshold", default=0.1, type=float, help="maximum allowed relative regression")
+    args = parser.parse_args(argv)
+
+    bruce.set_seed(42)
+    suite = Suite(args.warmup, args.repetitions, args.min_time, args.filter, args.quick)
+    run_all(suite)
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(suite.to_dict(), f, indent=2)
+            f.write("\n")
+
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        if suite.check_regressions(baseline, threshold=args.threshold):
+            return 2
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -56,15 +56,39 @@ class FiberType:
     def value(self) -> int: ...
 
 class Neurogram:
+    accuracy_budget: float | None
     bin_width: float
+    control_decimation: int
+    prefix: PrefixState | None
+    schedule: Schedule | None
+    trace_file: str
+    use_shared_memory: bool
+    use_tuning_profile: bool
     @overload
     def __init__(self, n_cf: int = ..., n_low: int = ..., n_med: int = ..., n_high: int = ...) -> None: ...
     @overload
     def __init__(self, cfs: list[float], n_low: int = ..., n_med: int = ..., n_high: int = ...) -> None: ...
-    def create(self, sound_wave: stimulus.Stimulus, n_rep: int = ..., n_trials: int = ..., species: Species = ..., noise_type: NoiseType = ..., power_law: PowerLaw = ...) -> None: ...
+    def __array__(self, *args, **kwargs) -> numpy.ndarray[numpy.float64]: ...
+    def __reduce_ex__(self, protocol: int) -> tuple: ...
+    def build_index(self, sound_wave: stimulus.Stimulus, interval: float = ..., species: Species = ...) -> StateIndex: ...
+    def create(self, sound_wave: stimulus.Stimulus, n_rep: int = ..., n_trials: int = ..., species: Species = ..., noise_type: NoiseType = ..., power_law: PowerLaw = ..., out: numpy.ndarray[numpy.float64] | None = ...) -> None: ...
+    def create_window(self, sound_wave: stimulus.Stimulus, index: StateIndex, t0: float, t1: float, n_rep: int = ..., n_trials: int = ..., species: Species = ..., noise_type: NoiseType = ..., power_law: PowerLaw = ..., warmup: float = ...) -> None: ...
     def get_cfs(self) -> list[float]: ...
     def get_fibers(self, cf_idx: int) -> list[Fiber]: ...
+    def get_n_bins(self, sound_wave: stimulus.Stimulus) -> int: ...
     def get_output(self) -> numpy.ndarray[numpy.float64]: ...
+    def iter_create(self, sound_wave: stimulus.Stimulus, n_rep: int = ..., n_trials: int = ..., species: Species = ..., noise_type: NoiseType = ..., power_law: PowerLaw = ..., out: numpy.ndarray[numpy.float64] | None = ...) -> NeurogramIterator: ...
+    def last_schedule(self) -> Schedule: ...
+    def plan(self) -> dict: ...
+    def profile(self) -> dict: ...
+    def share_output(self) -> SharedArray: ...
+    def simulate_prefix(self, prefix: stimulus.Stimulus, species: Species = ...) -> PrefixState: ...
+    def window_ihc(self, sound_wave: stimulus.Stimulus, index: StateIndex, cf_index: int, t0: float, t1: float, warmup: float = ...) -> numpy.ndarray[numpy.float64]: ...
+    def window_start(self) -> float: ...
+
+class NeurogramIterator:
+    def __iter__(self) -> NeurogramIterator: ...
+    def __next__(self) -> tuple[int, numpy.ndarray[numpy.float64]]: ...
 
 class NoiseType:
     __members__: ClassVar[dict] = ...  # read-only
@@ -122,6 +146,14 @@ class PowerLaw:
     @property
     def value(self) -> int: ...
 
+class PrefixState:
+    @property
+    def control_decimation(self) -> int: ...
+    @property
+    def n_samples(self) -> int: ...
+    @property
+    def species(self) -> Species: ...
+
 class Species:
     __members__: ClassVar[dict] = ...  # read-only
     CAT: ClassVar[Species] = ...
@@ -150,6 +182,55 @@ class Species:
     @property
     def value(self) -> int: ...
 
+class Schedule:
+    cf_block: int
+    n_threads: int
+    trials_per_task: int
+    def __init__(self, n_threads: int = ..., cf_block: int = ..., trials_per_task: int = ...) -> None: ...
+    def __eq__(self, other: Schedule) -> bool: ...
+
+class SharedArray:
+    def __array__(self, *args, **kwargs) -> numpy.ndarray[numpy.float64]: ...
+    def __reduce__(self) -> tuple: ...
+    def array(self) -> numpy.ndarray[numpy.float64]: ...
+    @property
+    def name(self) -> str: ...
+    @property
+    def ref_count(self) -> int: ...
+    @property
+    def shape(self) -> tuple[int, int]: ...
+
+class StateIndex:
+    @staticmethod
+    def load(path: str) -> StateIndex: ...
+    def save(self, path: str) -> None: ...
+    @property
+    def control_decimation(self) -> int: ...
+    @property
+    def interval(self) -> float: ...
+    @property
+    def n_samples(self) -> int: ...
+    @property
+    def n_snapshots(self) -> int: ...
+    @property
+    def seed(self) -> int: ...
+    @property
+    def species(self) -> Species: ...
+
+class SynapseBatchOutput:
+    @property
+    def n_bins(self) -> int: ...
+    @property
+    def n_fibers(self) -> int: ...
+    @property
+    def n_trials(self) -> int: ...
+    @property
+    def psth(self) -> numpy.ndarray[numpy.float64]: ...
+    @property
+    def spike_offsets(self) -> numpy.ndarray[numpy.uint64]: ...
+    @property
+    def spike_times(self) -> numpy.ndarray[numpy.float64]: ...
+
 class SynapseMapping:
     __members__: ClassVar[dict] = ...  # read-only
     BOLTZMAN: ClassVar[SynapseMapping] = ...
@@ -181,10 +262,11 @@ class SynapseMapping:
 
 class SynapseOutput:
     def __init__(self, n_rep: int, n_timesteps: int) -> None: ...
+    def __reduce_ex__(self, protocol: int) -> tuple: ...
     @property
-    def mean_firing_rate(self) -> list[float]: ...
+    def mean_firing_rate(self) -> numpy.ndarray[numpy.float64]: ...
     @property
-    def mean_relative_refractory_period(self) -> list[float]: ...
+    def mean_relative_refractory_period(self) -> numpy.ndarray[numpy.float64]: ...
     @property
     def n_rep(self) -> int: ...
     @property
@@ -192,17 +274,34 @@ class SynapseOutput:
     @property
     def n_total_timesteps(self) -> int: ...
     @property
-    def psth(self) -> list[float]: ...
+    def psth(self) -> numpy.ndarray[numpy.float64]: ...
     @property
-    def redocking_time(self) -> list[float]: ...
+    def redocking_time(self) -> numpy.ndarray[numpy.float64]: ...
     @property
-    def spike_times(self) -> list[float]: ...
+    def spike_times(self) -> numpy.ndarray[numpy.float64]: ...
     @property
-    def synaptic_output(self) -> list[float]: ...
+    def synaptic_output(self) -> numpy.ndarray[numpy.float64]: ...
     @property
-    def variance_firing_rate(self) -> list[float]: ...
+    def variance_firing_rate(self) -> numpy.ndarray[numpy.float64]: ...
 
-def inner_hair_cell(stimulus: stimulus.Stimulus, cf: float = ..., n_rep: int = ..., cohc: float = ..., cihc: float = ..., species: Species = ...) -> list[float]: ...
-def map_to_synapse(ihc_output: list[float], spontaneous_firing_rate: float, characteristic_frequency: float, time_resolution: float, mapping_function: SynapseMapping = ...) -> list[float]: ...
+def allocation_counting_supported() -> bool: ...
+def autotune(path: str = ..., repetitions: int = ..., verbose: bool = ...) -> str: ...
+def chrome_trace() -> str: ...
+def instruction_set() -> str: ...
+def inner_hair_cell(stimulus: stimulus.Stimulus, cf: float = ..., n_rep: int = ..., cohc: float = ..., cihc: float = ..., species: Species = ..., control_decimation: int = ...) -> numpy.ndarray[numpy.float64]: ...
+@overload
+def map_to_synapse(ihc_output: numpy.ndarray[numpy.float64], spontaneous_firing_rate: float, characteristic_frequency: float, time_resolution: float, mapping_function: SynapseMapping = ...) -> numpy.ndarray[numpy.float64]: ...
+@overload
+def map_to_synapse(ihc_output: numpy.ndarray[numpy.float32], spontaneous_firing_rate: float, characteristic_frequency: float, time_resolution: float, mapping_function: SynapseMapping = ...) -> numpy.ndarray[numpy.float64]: ...
+def get_n_threads() -> int: ...
+def hardware_counters_supported() -> bool: ...
+def is_profiling() -> bool: ...
+def set_n_threads(n_threads: int = ...) -> None: ...
+def set_profiling(enabled: bool = ..., counters: bool = ..., allocations: bool = ...) -> None: ...
 def set_seed(arg0: int) -> None: ...
-def synapse(amplitude_ihc: list[float], cf: float, n_rep: int, n_timesteps: int, time_resolution: float = ..., noise: NoiseType = ..., pla_impl: PowerLaw = ..., spontaneous_firing_rate: float = ..., abs_refractory_period: float = ..., rel_refractory_period: float = ..., calculate_stats: bool = ...) -> SynapseOutput: ...
+def set_tracing(enabled: bool = ..., capacity: int = ...) -> None: ...
+@overload
+def synapse(amplitude_ihc: numpy.ndarray[numpy.float64], cf: float, n_rep: int, n_timesteps: int, time_resolution: float = ..., noise: NoiseType = ..., pla_impl: PowerLaw = ..., spontaneous_firing_rate: float = ..., abs_refractory_period: float = ..., rel_refractory_period: float = ..., calculate_stats: bool = ...) -> SynapseOutput: ...
+@overload
+def synapse(amplitude_ihc: numpy.ndarray[numpy.float32], cf: float, n_rep: int, n_timesteps: int, time_resolution: float = ..., noise: NoiseType = ..., pla_impl: PowerLaw = ..., spontaneous_firing_rate: float = ..., abs_refractory_period: float = ..., rel_refractory_period: float = ..., calculate_stats: bool = ...) -> SynapseOutput: ...
+def synapse_batch(input: numpy.ndarray, cf: float, spontaneous_firing_rates: numpy.ndarray[numpy.float64], abs_refractory_periods: numpy.ndarray[numpy.float64], rel_refractory_periods: numpy.ndarray[numpy.float64], n_trials: int = ..., n_rep: int = ..., n_timesteps: int = ..., time_resolution: float = ..., noise: NoiseType = ..., pla_impl: PowerLaw = ..., mapping_function: SynapseMapping | None = ..., n_bins: int = ..., store_spikes: bool = ...) -> SynapseBatchOutput: ...
@@ -1,7 +1,12 @@
 import numpy
+from typing import overload
 
 class Stimulus:
-    def __init__(self, data: list[float], sampling_rate: int, simulation_duration: float) -> None: ...
+    @overload
+    def __init__(self, data: numpy.ndarray[numpy.float64], sampling_rate: int, simulation_duration: float) -> None: ...
+    @overload
+    def __init__(self, data: numpy.ndarray[numpy.float32], sampling_rate: int, simulation_duration: float) -> None: ...
+    def __reduce_ex__(self, protocol: int) -> tuple: ...
     @property
     def data(self) -> numpy.ndarray[numpy.float64]: ...
     @property
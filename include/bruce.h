@@ -2,10 +2,21 @@
 
 #include "types.h"
 #include "utils.h"
+#include "dispatch.h"
+#include "completion_queue.h"
+#include "shared_memory.h"
+#include "memory_accounting.h"
+#include "perf_counters.h"
+#include "trace.h"
+#include "profiler.h"
+#include "tuning.h"
+#include "planner.h"
 #include "resample.h"
 #include "synapse_mapping.h"
 #include "power_law.h"
 #include "inner_hair_cell.h"
+#include "state_index.h"
 #include "synapse.h"
 #include "neurogram.h"
 #include "stimulus.h"
+#include "serialize.h"
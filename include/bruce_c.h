@@ -0,0 +1,169 @@
+#ifndef BRUCE_C_H
+#define BRUCE_C_H
+
+/**
+ * Stable C interface of the model, for embedding it in other runtimes (C, C++ with another standard library, Go,
+ * Rust, ...) without the python extension. All objects are opaque handles, which are created and released through
+ * this interface. No exceptions cross the interface: every function that can fail returns a bruce_status, and the
+ * message of the last error of the calling thread is available from bruce_last_error.
+ *
+ * Functions are thread safe, except that a single engine must not be used by multiple threads at the same time.
+ * The interface is versioned by BRUCE_C_ABI_VERSION, which is only incremented on incompatible changes.
+ */
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#if defined(BRUCE_C_BUILD)
+#define BRUCE_C_API __declspec(dllexport)
+#else
+#define BRUCE_C_API __declspec(dllimport)
+#endif
+#else
+#define BRUCE_C_API __attribute__((visibility("default")))
+#endif
+
+#define BRUCE_C_ABI_VERSION 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	typedef enum
+	{
+		BRUCE_OK = 0,
+		//! A parameter is out of bounds, or a handle or pointer is null
+		BRUCE_ERROR_INVALID_ARGUMENT = 1,
+		BRUCE_ERROR_OUT_OF_MEMORY = 2,
+		//! A file could not be read or written
+		BRUCE_ERROR_IO = 3,
+		BRUCE_ERROR_INTERNAL = 4
+	} bruce_status;
+
+	//! Values equal to the Species, NoiseType and PowerLaw enums of types.h
+	typedef enum
+	{
+		BRUCE_CAT = 1,
+		BRUCE_HUMAN_SHERA = 2,
+		BRUCE_HUMAN_GLASSBERG_MOORE = 3
+	} bruce_species;
+
+	typedef enum
+	{
+		BRUCE_NOISE_ONES = 0,
+		BRUCE_NOISE_FIXED_MATLAB = 1,
+		BRUCE_NOISE_FIXED_SEED = 2,
+		BRUCE_NOISE_RANDOM = 3
+	} bruce_noise_type;
+
+	typedef enum
+	{
+		BRUCE_POWER_LAW_APPROXIMATED = 0,
+		BRUCE_POWER_LAW_ACTUAL = 1
+	} bruce_power_law;
+
+	//! Parameters of a call to create
+	typedef struct
+	{
+		int n_rep;
+		int n_trials;
+		bruce_species species;
+		bruce_noise_type noise_type;
+		bruce_power_law power_law;
+	} bruce_create_params;
+
+	typedef struct bruce_stimulus bruce_stimulus;
+	typedef struct bruce_engine bruce_engine;
+	typedef struct bruce_result bruce_result;
+
+	//! BRUCE_C_ABI_VERSION of the library, which should equal the version of the header the caller was compiled with
+	BRUCE_C_API int bruce_abi_version(void);
+
+	//! Message of the last failed call on the calling thread, empty when there was none. Valid until the next failing call.
+	BRUCE_C_API const char *bruce_last_error(void);
+
+	//! Parameters as used by Neurogram: 1 repetition, 1 trial, HUMAN_SHERA, RANDOM noise, APPROXIMATED power law
+	BRUCE_C_API bruce_create_params bruce_default_create_params(void);
+
+	//! Number of worker threads used by create, 0 selects the hardware concurrency
+	BRUCE_C_API void bruce_set_n_threads(size_t n_threads);
+
+	BRUCE_C_API size_t bruce_get_n_threads(void);
+
+	//! Seed of the random number generators, which are shared by all engines
+	BRUCE_C_API void bruce_set_seed(int seed);
+
+	/**
+	 * Create a stimulus from n samples (in Pa), which are copied
+	 * @param simulation_duration the duration of the simulation in seconds, at least n / sampling_rate
+	 */
+	BRUCE_C_API bruce_status bruce_stimulus_new(const double *data, size_t n, size_t sampling_rate, double simulation_duration, bruce_stimulus **stimulus);
+
+	//! Read a wav file, resampled to 100 kHz and normalized to 65 dB SPL, simulated for sim_time times its duration
+	BRUCE_C_API bruce_status bruce_stimulus_from_file(const char *path, double sim_time, bruce_stimulus **stimulus);
+
+	//! See stimulus::ramped_sine_wave
+	BRUCE_C_API bruce_status bruce_stimulus_ramped_sine_wave(double duration, double simulation_duration, size_t sampling_rate,
+															 double rt, double delay, double f0, double db, bruce_stimulus **stimulus);
+
+	//! Number of samples of the stimulus, and of the simulation (either may be null)
+	BRUCE_C_API bruce_status bruce_stimulus_size(const bruce_stimulus *stimulus, size_t *n_stimulation, size_t *n_simulation);
+
+	BRUCE_C_API void bruce_stimulus_free(bruce_stimulus *stimulus);
+
+	/**
+	 * Create an engine, which holds the CFs and the (randomly drawn) fiber population of a neurogram
+	 * @param cfs n_cf characteristic frequencies in Hz, or null for n_cf log-spaced CFs between 250 Hz and 16 kHz
+	 */
+	BRUCE_C_API bruce_status bruce_engine_new(const double *cfs, size_t n_cf, size_t n_low, size_t n_med, size_t n_high, bruce_engine **engine);
+
+	BRUCE_C_API void bruce_engine_free(bruce_engine *engine);
+
+	//! Number of CFs of the engine
+	BRUCE_C_API bruce_status bruce_engine_n_cf(const bruce_engine *engine, size_t *n_cf);
+
+	//! Copy the n_cf CFs of the engine to cfs
+	BRUCE_C_API bruce_status bruce_engine_cfs(const bruce_engine *engine, double *cfs);
+
+	//! Width in seconds of the bins of the output, 5e-4 by default
+	BRUCE_C_API bruce_status bruce_engine_set_bin_width(bruce_engine *engine, double bin_width);
+
+	//! Number of bins per CF of the output of create for a stimulus
+	BRUCE_C_API bruce_status bruce_engine_n_bins(const bruce_engine *engine, const bruce_stimulus *stimulus, size_t *n_bins);
+
+	/**
+	 * Create the neurogram of a stimulus in caller provided storage, without copying the output
+	 * @param output storage for n_cf rows of bruce_engine_n_bins elements, which is overwritten
+	 * @param row_stride the distance in elements between the start of consecutive rows, at least n_bins
+	 */
+	BRUCE_C_API bruce_status bruce_engine_create(bruce_engine *engine, const bruce_stimulus *stimulus, const bruce_create_params *params,
+												 double *output, size_t row_stride);
+
+	/**
+	 * Create the neurograms of n stimuli in turn, each in its own caller provided storage. Stops at the first error,
+	 * of which the index is written to failed_index (when not null), or n when all succeeded.
+	 * @param outputs n pointers to storage as for bruce_engine_create
+	 * @param row_strides n row strides, or null to use row_stride for every output
+	 */
+	BRUCE_C_API bruce_status bruce_engine_create_batch(bruce_engine *engine, const bruce_stimulus *const *stimuli, size_t n,
+													   const bruce_create_params *params, double *const *outputs,
+													   const size_t *row_strides, size_t row_stride, size_t *failed_index);
+
+	//! Create the neurogram of a stimulus in storage owned by the library, which is returned as a result
+	BRUCE_C_API bruce_status bruce_engine_run(bruce_engine *engine, const bruce_stimulus *stimulus, const bruce_create_params *params,
+											  bruce_result **result);
+
+	/**
+	 * View of the output of a result, (n_cf x n_bins) with rows row_stride elements apart. The data remains valid
+	 * until the result is freed, independent of the engine. Any of the outputs may be null.
+	 */
+	BRUCE_C_API bruce_status bruce_result_data(const bruce_result *result, const double **data, size_t *n_cf, size_t *n_bins, size_t *row_stride);
+
+	BRUCE_C_API void bruce_result_free(bruce_result *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+namespace utils
+{
+	/**
+	 * Bounded, lock-free multi-producer single-consumer ring buffer of indices, used to signal completed work items
+	 * (i.e. CF rows of a neurogram) to a consumer thread. A push into a full queue waits until the consumer pops a
+	 * value, so producers never fail; size the queue to the number of work items to never wait.
+	 */
+	class CompletionQueue
+	{
+		//! A slot holds a value for position p once its sequence is p + 1, and is free for position p at sequence p
+		struct Slot
+		{
+			std::atomic<size_t> sequence{0};
+			size_t value = 0;
+		};
+
+		size_t capacity_;
+		std::unique_ptr<Slot[]> slots_;
+		std::atomic<size_t> tail_{0};
+		size_t head_ = 0;
+
+	public:
+		explicit CompletionQueue(size_t capacity);
+
+		/**
+		 * Push a value, can be called concurrently from any number of threads. Waits (with backoff) while the queue
+		 * is full.
+		 * @param value the value
+		 */
+		void push(size_t value);
+
+		/**
+		 * Pop the next value, if available. Must only be called from a single consumer thread.
+		 * @param value output, the popped value
+		 * @return whether a value was popped
+		 */
+		bool try_pop(size_t &value);
+
+		/**
+		 * Wait (with backoff) until the next value is available, or until stop is set and the queue is drained.
+		 * Must only be called from a single consumer thread.
+		 * @param value output, the popped value
+		 * @param stop flag signalling that no more values will be pushed
+		 * @return whether a value was popped
+		 */
+		bool pop(size_t &value, const std::atomic<bool> &stop);
+
+		[[nodiscard]] size_t capacity() const
+		{
+			return capacity_;
+		}
+	};
+}
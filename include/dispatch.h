@@ -0,0 +1,32 @@
+#pragma once
+
+/**
+ * Runtime instruction set dispatch of the hot kernels. When the library is built with BRUCE_DISPATCH, functions
+ * marked BRUCE_TARGET_CLONES are compiled for several x86-64 instruction sets (baseline, SSE4.2, AVX2 and AVX-512),
+ * of which the best one supported by the CPU is selected by the dynamic loader (GNU ifunc). A single build thus
+ * runs at full speed on every generation of hardware, without requiring -march=native.
+ *
+ * The AVX2 and AVX-512 clones imply FMA, which the compiler would use to contract multiplies and adds, rounding
+ * differently. The translation units with clones are therefore compiled with -ffp-contract=off (see CMakeLists.txt and
+ * setup.py), and no clone reassociates, so the output does not depend on the selected clone; the golden_dispatch test
+ * checks this bit for bit against the baseline clones.
+ */
+#if defined(BRUCE_DISPATCH) && defined(__x86_64__) && defined(__ELF__) && defined(__has_attribute)
+#if __has_attribute(target_clones)
+#define BRUCE_TARGET_CLONES __attribute__((target_clones("default", "sse4.2", "avx2", "avx512f")))
+#define BRUCE_HAS_DISPATCH
+#endif
+#endif
+
+#ifndef BRUCE_TARGET_CLONES
+#define BRUCE_TARGET_CLONES
+#endif
+
+namespace dispatch
+{
+	//! Whether the kernels are built for multiple instruction sets
+	bool enabled();
+
+	//! Name of the instruction set of the kernels selected for this CPU: "avx512f", "avx2", "sse4.2" or "default"
+	const char *isa();
+}
@@ -3,6 +3,8 @@
 
 #include <array>
 #include <complex>
+#include <istream>
+#include <ostream>
 #include <vector>
 
 #include "types.h"
@@ -109,6 +111,23 @@ namespace ihc
 		double operator()(double x) const;
 	};
 
+	//! Coefficients of a chirp filter for a value of its control signal (see ChirpFilter::coefficients_for)
+	struct ChirpCoefficients
+	{
+		double norm_gain;
+		//! The bilinear transform terms of the zero: fs - r0, 2 r0 and fs + r0
+		double zero_minus;
+		double zero_twice;
+		double zero_plus;
+		//! The bilinear transform terms of the poles, indexed as input and output
+		std::array<double, 6> pole_output_1;
+		std::array<double, 6> pole_output_2;
+		std::array<double, 6> pole_denominator;
+
+		//! Linear interpolation of every coefficient, from a (t = 0) to b (t = 1), extrapolation for t > 1
+		static ChirpCoefficients interpolate(const ChirpCoefficients &a, const ChirpCoefficients &b, double t);
+	};
+
 	struct ChirpFilter
 	{
 		double time_resolution;
@@ -131,12 +150,121 @@ namespace ihc
 		double gain_denominator;
 		bool c1;
 
+		/**
+		 * Coefficients of the filter for the last r_sigma, which only change with the control signal; they are
+		 * recomputed when it changes. The control signal of C2 is constant, and that of C1 is pinned at a bound of
+		 * tau_c1 for long stretches (quiet passages, or always when cohc is 0), in which case the poles, the zero,
+		 * and the gain are not recomputed every sample.
+		 */
+		double coefficients_r_sigma;
+		bool has_coefficients;
+		ChirpCoefficients coefficients;
+
 		ChirpFilter(double time_resolution, double cf_in, double bm_tau_max, bool c1 = true);
 
 		void fill_phase_array(double r_sigma, bool multiply = false);
 
+		//! The poles, the zero and the bilinear transform coefficients for r_sigma, cached in coefficients
+		const ChirpCoefficients &coefficients_for(double r_sigma);
+
+		//! Filter the next sample with the given coefficients
+		double filter(double me_out, const ChirpCoefficients &c);
+
 		double operator()(double me_out, double r_sigma);
 	};
+
+	/**
+	 * Largest number of samples per evaluation of the control path of Model. Beyond it, the extrapolated control
+	 * signal diverges from that of the full-rate model at high levels (relative errors of the output above 1 at 90 dB
+	 * SPL with a decimation of 8).
+	 */
+	constexpr size_t MAX_CONTROL_DECIMATION = 4;
+
+	/**
+	 * The complete state of the inner hair cell model of a single CF: all of its filters, and the number of samples
+	 * processed so far. The model is causal, so a copy of it is a snapshot from which the model can be continued
+	 * (forked), i.e. once for every stimulus that starts with the samples processed so far.
+	 */
+	class Model
+	{
+		MiddleEarFilter me_filter_;
+		WideBandGammaToneFilter wb_filter_;
+		BoltzmanFilter boltzman_filter_;
+		LowPassFilter<2> ohc_low_pass_filter_;
+		PostOhcFilter non_linear_after_ohc_filter_;
+		ChirpFilter c1_chirp_filter_;
+		ChirpFilter c2_chirp_filter_;
+		LogarithmicTransductionFunction ltf_1_;
+		LogarithmicTransductionFunction ltf_2_;
+		LowPassFilter<7> ihc_low_pass_filter_;
+
+		double cf_;
+		double cihc_;
+		//! Without OHC function (cohc = 0), tau_c1 is pinned at bm_tau_min, and the control path is not evaluated
+		bool control_pinned_;
+		size_t control_decimation_;
+		//! The control signal at the previous and the last control point, and the C1 coefficients for it
+		double tau_c1_from_;
+		double tau_c1_to_;
+		ChirpCoefficients c1_from_{};
+		ChirpCoefficients c1_to_{};
+		size_t n_ = 0;
+
+		//! Start the interpolation towards the control signal of the next control point
+		void advance_control(double tau_c1);
+
+	public:
+		/**
+		 * @param control_decimation the number of samples per evaluation of the control path. The control signal
+		 * (tau_c1) is smoothed by the 600 Hz OHC low-pass filter, so rather than every sample, the mapping to tau_c1
+		 * and the C1 coefficients are evaluated at a decimated rate, and extrapolated linearly from the last two
+		 * control points in between (up to the bounds of tau_c1). The filters up to the OHC low-pass filter, which
+		 * rectifies the signal at CF, and the signal path run at the full rate. 1 (the default) gives the full-rate
+		 * model, at most MAX_CONTROL_DECIMATION. The relative error of the output is below 0.05 up to 60 dB SPL, but
+		 * grows quickly with the level, where the control signal follows the rectified signal: with a decimation of 4,
+		 * it is up to 0.5 at 90 dB SPL for a CF two octaves below a 1 kHz tone, and larger off CF, where the output
+		 * is small.
+		 */
+		Model(double time_resolution, double cf, double cohc, double cihc, Species species, size_t control_decimation = 1);
+
+		//! Process the next sample of the stimulus, returns the IHC output before the delay (see delay_point)
+		double operator()(double px);
+
+		//! Process n samples, appending the outputs to output
+		void run(const double *px, size_t n, std::vector<double> &output);
+
+		//! The number of samples processed
+		[[nodiscard]] size_t n_processed() const
+		{
+			return n_;
+		}
+
+		[[nodiscard]] double cf() const
+		{
+			return cf_;
+		}
+
+		[[nodiscard]] size_t control_decimation() const
+		{
+			return control_decimation_;
+		}
+
+		//! The delay in samples of the IHC output with respect to the stimulus
+		static int delay_point(double cf, double time_resolution);
+
+		//! Version of the format of write_state, incremented on any change of the fields it writes
+		static constexpr size_t STATE_VERSION = 1;
+
+		/**
+		 * Write the state of the model, i.e. the fields of its filters that change while processing and the number
+		 * of samples processed, field by field as doubles and 64-bit counts in the byte order of the host, after
+		 * STATE_VERSION. The parameters of the model are not written.
+		 */
+		void write_state(std::ostream &os) const;
+
+		//! Restore the state written by write_state, into a model constructed with the same parameters
+		void read_state(std::istream &is);
+	};
 }
 
 
@@ -168,6 +296,8 @@ namespace ihc
  * @param cihc is the IHC scaling factor: 1 is normal IHC function; 0 is complete IHC dysfunction
  * @param species is the model species: "1" for cat, "2" for human with BM tuning from Shera et al. (PNAS 2002),
  *    or "3" for human BM tuning from Glasberg & Moore (Hear. Res. 1990)
+ * @param control_decimation the number of samples per evaluation of the OHC control path (1 to
+ *    ihc::MAX_CONTROL_DECIMATION), see ihc::Model
  * @returns 
  */
 std::vector<double> inner_hair_cell(
@@ -176,5 +306,24 @@ std::vector<double> inner_hair_cell(
 	int n_rep = 10,
 	double cohc = 1,
 	double cihc = 1,
-	Species species = HUMAN_SHERA
+	Species species = HUMAN_SHERA,
+	size_t control_decimation = 1
+);
+
+/**
+ * The inner hair cell model continued from a snapshot of its state, taken after a prefix that the stimulus starts
+ * with (see ihc::Model). Only the samples after the prefix are simulated, which gives the same output as
+ * inner_hair_cell(stimulus, ...) with the parameters of the model.
+ *
+ * @param stimulus the input sound wave, which starts with the prefix_output.size() samples of the prefix
+ * @param model the state of the model after the prefix
+ * @param prefix_output the outputs of the model (see ihc::Model::operator()) over the prefix, which may be empty,
+ * i.e. to continue from a snapshot taken at an earlier point of a longer recording
+ * @param n_rep the number of repetitions for the psth
+ */
+std::vector<double> inner_hair_cell(
+	const stimulus::Stimulus& stimulus,
+	ihc::Model model,
+	const std::vector<double>& prefix_output,
+	int n_rep = 1
 );
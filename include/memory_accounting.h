@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Heap allocation accounting. When the library is built with BRUCE_COUNT_ALLOCATIONS (glibc only), the global
+ * operator new and delete are replaced by versions that count every allocation made through them, which includes
+ * all standard containers used by the library. Counting is only performed while enabled at runtime (see set_enabled).
+ *
+ * Allocations are counted per thread (see THREAD_COUNTERS), which the stage timers of the profiler use to attribute
+ * allocations to stages, and for the whole process (see totals).
+ */
+namespace memory
+{
+	struct Allocations
+	{
+		//! Number of allocations
+		uint64_t count = 0;
+		//! Bytes allocated
+		uint64_t bytes = 0;
+		//! Maximum of the bytes allocated and not yet freed, relative to the start
+		int64_t peak_live = 0;
+
+		void merge(const Allocations &other)
+		{
+			count += other.count;
+			bytes += other.bytes;
+			peak_live = other.peak_live > peak_live ? other.peak_live : peak_live;
+		}
+	};
+
+	//! Running counters of a thread, live can be negative when memory allocated by another thread is freed
+	struct ThreadCounters
+	{
+		uint64_t count = 0;
+		uint64_t bytes = 0;
+		int64_t live = 0;
+		int64_t peak = 0;
+	};
+
+	inline thread_local ThreadCounters THREAD_COUNTERS;
+
+	extern std::atomic<bool> ENABLED;
+
+	//! Whether allocations can be counted, i.e. the library was built with BRUCE_COUNT_ALLOCATIONS
+	bool supported();
+
+	//! Enable or disable counting at runtime
+	void set_enabled(bool enabled);
+
+	//! Whether allocations are counted
+	bool enabled();
+
+	//! Reset the process wide totals
+	void reset();
+
+	//! Process wide allocations since the last reset, with the peak live bytes over all threads
+	Allocations totals();
+
+	//! Called by the allocation hooks with the usable size of the block
+	void on_allocate(size_t size);
+
+	//! Called by the allocation hooks with the usable size of the block
+	void on_deallocate(size_t size);
+
+	//! Current resident set size of the process in bytes, or 0 when unavailable
+	double current_rss();
+
+	//! Peak resident set size of the process in bytes (since reset_peak_rss on Linux), or 0 when unavailable
+	double peak_rss();
+
+	//! Reset the peak resident set size to the current value (Linux only), such that peaks can be attributed to a single run
+	void reset_peak_rss();
+
+	/**
+	 * Allocations of the calling thread during the lifetime of the scope. Scopes can be nested, the peak of the
+	 * enclosing scope includes the peak of nested ones. An inactive scope does not touch the counters, i.e. when
+	 * counting is disabled.
+	 */
+	class Scope
+	{
+		bool active_;
+		ThreadCounters start_{};
+		int64_t outer_peak_ = 0;
+
+	public:
+		explicit Scope(const bool active = true) : active_(active)
+		{
+			if (!active_)
+				return;
+			start_ = THREAD_COUNTERS;
+			outer_peak_ = THREAD_COUNTERS.peak;
+			THREAD_COUNTERS.peak = THREAD_COUNTERS.live;
+		}
+
+		Scope(const Scope &) = delete;
+		Scope &operator=(const Scope &) = delete;
+
+		[[nodiscard]] bool active() const
+		{
+			return active_;
+		}
+
+		//! Allocations since the start of the scope
+		[[nodiscard]] Allocations allocations() const
+		{
+			const auto &now = THREAD_COUNTERS;
+			return {now.count - start_.count, now.bytes - start_.bytes, now.peak - start_.live};
+		}
+
+		~Scope()
+		{
+			if (!active_)
+				return;
+			auto &now = THREAD_COUNTERS;
+			now.peak = outer_peak_ > now.peak ? outer_peak_ : now.peak;
+		}
+	};
+}
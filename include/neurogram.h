@@ -1,9 +1,18 @@
 #pragma once
 
 #include <array>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <string>
 #include "utils.h"
 #include "inner_hair_cell.h"
+#include "planner.h"
+#include "profiler.h"
+#include "shared_memory.h"
+#include "state_index.h"
+#include "tuning.h"
 
 enum FiberType
 {
@@ -20,6 +29,35 @@ struct Fiber
 	FiberType type;
 };
 
+/**
+ * The state of the IHC models of every CF of a neurogram after a stimulus prefix (see Neurogram::simulate_prefix).
+ * Stimuli that start with the prefix continue the IHC models from it, rather than simulating the prefix again.
+ *
+ * Only the IHC stage is forked. The synapse stage is not incremental (the fGn is synthesized by FFT over the whole
+ * signal, and the power law and the spike generator run over the whole mapped signal), so it still runs over the
+ * complete stimulus, including the prefix, for every continuation. The saving is bounded by the share of the IHC
+ * stage in the run time.
+ */
+struct PrefixState
+{
+	//! The samples of the prefix
+	std::vector<double> data;
+	double time_resolution;
+	Species species;
+	std::vector<double> cfs;
+	std::vector<double> coh_cs;
+	std::vector<double> ihc_cs;
+	size_t control_decimation = 1;
+	//! Per CF, the state of the model after the prefix, and its outputs over the prefix
+	std::vector<ihc::Model> models;
+	std::vector<std::vector<double>> outputs;
+
+	//! Whether a stimulus starts with the prefix, and is simulated with the same parameters
+	[[nodiscard]] bool applies_to(const stimulus::Stimulus &sound_wave, Species species, const std::vector<double> &cfs,
+								  const std::vector<double> &coh_cs, const std::vector<double> &ihc_cs,
+								  size_t control_decimation) const;
+};
+
 class Neurogram
 {
 	std::vector<double> cfs_;
@@ -30,11 +68,132 @@ class Neurogram
 
 	std::array<std::vector<Fiber>, 3> an_population_;
 
-	std::vector<std::vector<double>> output_;
+	//! Row-major (n_cf x n_bins) output, row i starts at output_.get() + i * row_stride_
+	std::shared_ptr<double> output_;
+	size_t n_bins_ = 0;
+	size_t row_stride_ = 0;
 	std::mutex mutex_;
+
+	//! Stage timers of the last call to create, when profiling is enabled
+	profiler::Report profile_;
+
+	//! Schedule of the last call to create
+	tuning::Schedule last_schedule_;
+
+	//! Approximation tiers of the last call to create
+	planner::Plan plan_;
+
+	//! Time of the first bin of the output, non-zero after create_window
+	double window_start_ = 0.0;
+
+	[[nodiscard]] std::vector<double> evaluate_ihc(
+		const stimulus::Stimulus &sound_wave,
+		int n_rep,
+		Species species,
+		size_t cf_i,
+		const PrefixState *prefix_state = nullptr
+	) const;
+
+	//! The prefix state create continues from, null when there is none; throws when it does not apply
+	[[nodiscard]] const PrefixState *resolve_prefix(const stimulus::Stimulus &sound_wave, Species species) const;
+
+	//! The part of a recording create_window simulates, from a snapshot to the end of the window
+	struct Window
+	{
+		const state_index::Snapshot *snapshot;
+		size_t snapshot_i;
+		//! The recording from the snapshot on
+		stimulus::Stimulus stimulus;
+		//! The number of bins of the warm-up, which are dropped from the output
+		size_t skip;
+		//! Number of samples per bin
+		size_t bin_size;
+	};
+
+	//! The window of create_window, which throws when the index or the window do not apply
+	[[nodiscard]] Window resolve_window(const stimulus::Stimulus &sound_wave, const state_index::Index &index, double t0,
+										double t1, Species species, double warmup) const;
+
+	//! Seed of the generators of the fiber tasks of run (see utils::GeneratorScope)
+	struct TaskSeed
+	{
+		int seed;
+		//! The stream of the first task, task t draws from stream first_stream + t
+		size_t first_stream;
+	};
+
+	/**
+	 * Implementation of create, continuing the IHC models from prefix_state when it is not null. Every fiber task
+	 * draws from a generator of its own, seeded by task_seed, such that the output does not depend on the threads.
+	 */
+	void run(
+		const stimulus::Stimulus &sound_wave,
+		int n_rep,
+		int n_trials,
+		Species species,
+		NoiseType noise_type,
+		PowerLaw power_law,
+		std::shared_ptr<double> output,
+		size_t row_stride,
+		const PrefixState *prefix_state,
+		TaskSeed task_seed);
+
 public:
 	double bin_width = 5e-4;
 
+	//! Allocate the output of create in named shared memory, such that it can be handed to other processes
+	bool use_shared_memory = false;
+
+	//! When tracing is enabled (see profiler::set_tracing), create writes its timeline as Chrome trace JSON to this path
+	std::string trace_file;
+
+	//! Schedule of create, when not set it is looked up in the tuning profile (see tuning::active_profile)
+	std::optional<tuning::Schedule> schedule;
+
+	//! Look up the schedule in the tuning profile when none is set, otherwise use the default schedule
+	bool use_tuning_profile = true;
+
+	/**
+	 * Accuracy budget of create. When set, create selects the cheapest approximation tiers that fit it (see
+	 * planner::plan), and the power law passed to create is ignored.
+	 */
+	std::optional<planner::Budget> budget;
+
+	/**
+	 * Samples per evaluation of the OHC control path of the IHC models (see ihc::Model), 1 for the full-rate model.
+	 * It is not an approximation tier of the planner, as its error depends strongly on the level: it also applies
+	 * when a budget is set. The relative L1 error of the IHC output, the worst over CFs of 125 Hz to 12 kHz, for a
+	 * decimation of 2, 3 and 4 with tones of:
+	 *
+	 *      tone      level     2       3       4
+	 *      any     <= 60 dB  0.01    0.03    0.05
+	 *      250 Hz     80 dB  0.032   0.088   0.12
+	 *      250 Hz     90 dB  0.060   0.088   0.29
+	 *      1 kHz      80 dB  0.47    0.99    0.56
+	 *      1 kHz      90 dB  0.76    0.87    1.7
+	 *      4 kHz      80 dB  0.60    0.49    6.3
+	 *      4 kHz      90 dB  1.0     1.1     1.3
+	 *
+	 * The large errors are at CFs far from the tone, where the output is small; at the CF of a tone it is 0.01 for
+	 * a decimation of 4 at 90 dB. The relative L1 error of the PSTH with 4 is 0.014 at 60 dB, 0.07 to 0.5 at 80 dB
+	 * and 0.08 to 1.5 at 90 dB. The golden_control_decimation tests check 2 and 4 at 60 dB.
+	 */
+	size_t control_decimation = 1;
+
+	/**
+	 * State after a common stimulus prefix (see simulate_prefix). When set, create continues the IHC models of every
+	 * CF from it, which gives the same IHC output as simulating the stimulus from its start; the synapse stage runs
+	 * over the complete stimulus (see PrefixState). The stimulus should start with the prefix, and be created with
+	 * the same species.
+	 */
+	std::shared_ptr<PrefixState> prefix;
+
+	//! Optional callback, invoked from a worker thread during create as soon as the row of a CF is complete
+	std::function<void(size_t)> on_cf_completed;
+
+	//! Alignment in bytes of the output buffer and each of its rows
+	static constexpr size_t ROW_ALIGNMENT = 64;
+
 public:
 	explicit Neurogram(
 		const std::vector<double> &cfs,
@@ -48,6 +207,24 @@ public:
 		size_t n_med = 10,
 		size_t n_high = 30);
 
+	/**
+	 * Restore a neurogram from its complete state, i.e. when deserializing (see serialize.h)
+	 * @param output the output buffer (n_cf x row_stride), may be null when the neurogram was never created
+	 * @param window_start the time of the first bin of the output, see window_start
+	 */
+	Neurogram(
+		std::vector<double> cfs,
+		std::vector<double> db_loss,
+		std::vector<double> coh_cs,
+		std::vector<double> ihc_cs,
+		std::vector<double> ohc_loss,
+		std::array<std::vector<Fiber>, 3> an_population,
+		double bin_width,
+		std::shared_ptr<double> output,
+		size_t n_bins,
+		size_t row_stride,
+		double window_start = 0.0);
+
 	static std::vector<Fiber> generate_fiber_set(
 		size_t n_cf,
 		size_t n_fibers,
@@ -65,6 +242,23 @@ public:
 
 	[[nodiscard]] std::vector<Fiber> get_fibers(size_t cf_idx) const;
 
+	/**
+	 * Allocate a zero-initialized output buffer of n_cf rows with n_bins elements, rows are padded to ROW_ALIGNMENT bytes
+	 * @param n_cf the number of rows
+	 * @param n_bins the number of elements per row
+	 * @param row_stride output, the distance in elements between the start of consecutive rows
+	 * @param shared allocate the buffer in a shared memory segment, see get_output_segment
+	 * @return the buffer
+	 */
+	static std::shared_ptr<double> allocate_output(size_t n_cf, size_t n_bins, size_t &row_stride, bool shared = false);
+
+	/**
+	 * The number of bins of the output when the neurogram is created for a given stimulus
+	 * @param sound_wave the stimulus
+	 * @return the number of bins
+	 */
+	[[nodiscard]] size_t get_n_bins(const stimulus::Stimulus &sound_wave) const;
+
 	void create(
 		const stimulus::Stimulus &sound_wave,
 		int n_rep,
@@ -74,6 +268,93 @@ public:
 		PowerLaw power_law
     );
 
+	/**
+	 * Create the neurogram, writing the output directly into caller provided storage. The neurogram keeps
+	 * a reference to output, which is zeroed before use, until the next call to create.
+	 *
+	 * @param output storage for (at least) n_cf rows of get_n_bins(sound_wave) elements
+	 * @param row_stride the distance in elements between the start of consecutive rows
+	 */
+	void create(
+		const stimulus::Stimulus &sound_wave,
+		int n_rep,
+		int n_trials,
+		Species species,
+		NoiseType noise_type,
+		PowerLaw power_law,
+		std::shared_ptr<double> output,
+		size_t row_stride
+	);
+
+	/**
+	 * Simulate the IHC models of every CF over a stimulus prefix, on the worker threads, and capture their state
+	 * @param prefix the prefix, of which the stimulation samples are used
+	 * @param species the species, which should match that of later calls to create
+	 * @return the state, which can be assigned to prefix
+	 */
+	[[nodiscard]] std::shared_ptr<PrefixState> simulate_prefix(const stimulus::Stimulus &prefix, Species species) const;
+
+	/**
+	 * Simulate the IHC models of every CF over a (long) recording, on the worker threads, and take a snapshot of
+	 * their state every interval seconds, from which create_window continues
+	 * @param sound_wave the recording
+	 * @param species the species, which should match that of later calls to create_window
+	 * @param interval the time between snapshots in s, which bounds the recomputation of a window
+	 * @return the index, which can be saved to a file (see state_index::Index::save)
+	 */
+	[[nodiscard]] state_index::Index build_index(const stimulus::Stimulus &sound_wave, Species species, double interval) const;
+
+	/**
+	 * Create the neurogram of a window [t0, t1) of a recording, simulating only from the last snapshot in the index
+	 * at least warmup seconds before t0. The IHC output is exact from the delay of the model after the snapshot on
+	 * (see window_ihc); the synapse stage starts from its initial state at the snapshot, which the warm-up allows to
+	 * adapt, so the spikes match those of a full run only statistically. The bins are aligned to the snapshot, so the
+	 * output starts at window_start(), at most a bin before t0. The fibers draw from generators seeded by the seed of
+	 * the index, the snapshot and the task, so a window is reproducible for a given schedule.
+	 *
+	 * @param sound_wave the recording the index was built for
+	 * @param index the index, see build_index
+	 * @param t0 the start of the window in s
+	 * @param t1 the end of the window in s
+	 * @param warmup the minimum time in s between the snapshot and t0
+	 */
+	void create_window(
+		const stimulus::Stimulus &sound_wave,
+		const state_index::Index &index,
+		double t0,
+		double t1,
+		int n_rep,
+		int n_trials,
+		Species species,
+		NoiseType noise_type,
+		PowerLaw power_law,
+		double warmup = 0.25
+	);
+
+	/**
+	 * The IHC output of a CF that create_window computes for a window, from window_start() to t1. Once the warm-up
+	 * exceeds the delay of the model (see ihc::Model::delay_point), it equals the output of inner_hair_cell over the
+	 * recording at the same samples.
+	 *
+	 * @param cf_i the index of the CF
+	 * @param t0, t1, warmup the window, see create_window
+	 */
+	[[nodiscard]] std::vector<double> window_ihc(
+		const stimulus::Stimulus &sound_wave,
+		const state_index::Index &index,
+		size_t cf_i,
+		double t0,
+		double t1,
+		double warmup = 0.25
+	) const;
+
+	//! Time in s of the first bin of the output, i.e. of the window of the last call to create_window, 0 after create
+	[[nodiscard]] double window_start() const
+	{
+		return window_start_;
+	}
+
+	//! Evaluate all fibers of a single CF on the calling thread
 	void evaluate_cf(
 		const stimulus::Stimulus &sound_wave,
 		int n_rep,
@@ -95,13 +376,107 @@ public:
 		size_t cf_i
 	);
 
+	//! Evaluate a fiber over a view of the IHC output, explicitly instantiated for double and float
+	template <typename T>
+	void evaluate_fiber(
+		const stimulus::Stimulus &sound_wave,
+		utils::Span<T> ihc,
+		int n_rep,
+		int n_trials,
+		NoiseType noise_type,
+		PowerLaw power_law,
+		const Fiber &fiber,
+		size_t cf_i
+	);
+
+	//! Copy of the output, as a vector of rows
 	[[nodiscard]] std::vector<std::vector<double>> get_output() const
+	{
+		std::vector<std::vector<double>> output(output_ ? cfs_.size() : 0);
+		for (size_t i = 0; i < output.size(); i++)
+			output[i].assign(row(i), row(i) + n_bins_);
+		return output;
+	}
+
+	//! The output buffer, shared with any views of it
+	[[nodiscard]] std::shared_ptr<double> get_output_buffer() const
 	{
 		return output_;
 	}
 
+	//! Per-stage timers of the last call to create, empty unless profiling was enabled (see profiler::set_enabled),
+	//! and its allocations if allocation counting was enabled (see memory::set_enabled)
+	[[nodiscard]] const profiler::Report &profile() const
+	{
+		return profile_;
+	}
+
+	//! Schedule used by the last call to create, with the number of threads resolved
+	[[nodiscard]] const tuning::Schedule &last_schedule() const
+	{
+		return last_schedule_;
+	}
+
+	//! Approximation tiers used by the last call to create
+	[[nodiscard]] const planner::Plan &plan() const
+	{
+		return plan_;
+	}
+
+	/**
+	 * The schedule create would use for a workload: schedule if set, otherwise the nearest one in the tuning
+	 * profile, otherwise the default (all threads, all CFs at once, all trials of a fiber in a single task)
+	 */
+	[[nodiscard]] tuning::Schedule resolve_schedule(size_t n_samples, int n_trials) const;
+
+	//! The shared memory segment holding the output, or null when the output is not in shared memory
+	[[nodiscard]] std::shared_ptr<shared_memory::Segment> get_output_segment() const
+	{
+		return shared_memory::Segment::owner_of(output_);
+	}
+
+	[[nodiscard]] const double *row(const size_t cf_i) const
+	{
+		return output_.get() + cf_i * row_stride_;
+	}
+
+	[[nodiscard]] size_t n_bins() const
+	{
+		return n_bins_;
+	}
+
+	[[nodiscard]] size_t row_stride() const
+	{
+		return row_stride_;
+	}
+
 	[[nodiscard]] std::vector<double> get_cfs() const
 	{
 		return cfs_;
 	}
+
+	[[nodiscard]] const std::vector<double> &get_db_loss() const
+	{
+		return db_loss_;
+	}
+
+	[[nodiscard]] const std::vector<double> &get_coh_cs() const
+	{
+		return coh_cs_;
+	}
+
+	[[nodiscard]] const std::vector<double> &get_ihc_cs() const
+	{
+		return ihc_cs_;
+	}
+
+	[[nodiscard]] const std::vector<double> &get_ohc_loss() const
+	{
+		return ohc_loss_;
+	}
+
+	[[nodiscard]] const std::array<std::vector<Fiber>, 3> &get_an_population() const
+	{
+		return an_population_;
+	}
 };
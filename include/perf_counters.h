@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+/**
+ * Hardware performance counters of the calling thread, read as a single group through perf_event_open (Linux only).
+ * Counters that cannot be opened (i.e. in a VM, with a restrictive perf_event_paranoid, or on other platforms) are
+ * left out, so callers should check Counts::has before reporting a value.
+ *
+ * Floating point assists (i.e. on subnormal operands) have no generic perf event. The raw, model specific, event
+ * code is taken from the environment variable BRUCE_PERF_FP_ASSIST, i.e. 0x1eca (FP_ASSIST.ANY) up to Broadwell,
+ * or 0x02c1 (ASSISTS.FP) from Ice Lake on.
+ */
+namespace perf
+{
+	enum Event
+	{
+		CYCLES = 0,
+		INSTRUCTIONS,
+		CACHE_MISSES,
+		BRANCH_MISSES,
+		FP_ASSISTS,
+		N_EVENTS
+	};
+
+	const char *event_name(Event event);
+
+	struct Counts
+	{
+		std::array<uint64_t, N_EVENTS> values{};
+		//! Bit mask of the events that were counted
+		unsigned available = 0;
+
+		[[nodiscard]] bool has(const Event event) const
+		{
+			return available & (1u << event);
+		}
+
+		[[nodiscard]] bool empty() const
+		{
+			return available == 0;
+		}
+
+		//! Instructions per cycle, or 0 when either was not counted
+		[[nodiscard]] double ipc() const
+		{
+			return has(CYCLES) && has(INSTRUCTIONS) && values[CYCLES] ? static_cast<double>(values[INSTRUCTIONS]) / static_cast<double>(values[CYCLES]) : 0.0;
+		}
+
+		Counts &operator+=(const Counts &other)
+		{
+			for (size_t i = 0; i < N_EVENTS; i++)
+				values[i] += other.values[i];
+			available |= other.available;
+			return *this;
+		}
+
+		//! Difference of two readings of the same group
+		Counts operator-(const Counts &start) const
+		{
+			Counts result{{}, available & start.available};
+			for (size_t i = 0; i < N_EVENTS; i++)
+				result.values[i] = values[i] >= start.values[i] ? values[i] - start.values[i] : 0;
+			return result;
+		}
+	};
+
+	/**
+	 * Counter group of the calling thread, counting user space events from construction on. Must be read on the
+	 * thread that created it.
+	 */
+	class CounterGroup
+	{
+		int leader_ = -1;
+		std::array<int, N_EVENTS> fds_;
+		//! The event of each value in a group read, in the order the events were opened
+		std::array<Event, N_EVENTS> order_{};
+		size_t n_open_ = 0;
+		unsigned available_ = 0;
+
+	public:
+		CounterGroup();
+		~CounterGroup();
+
+		CounterGroup(const CounterGroup &) = delete;
+		CounterGroup &operator=(const CounterGroup &) = delete;
+
+		//! Whether any counter could be opened
+		[[nodiscard]] bool valid() const
+		{
+			return available_ != 0;
+		}
+
+		//! Current values, scaled up when the group was multiplexed with other counters
+		[[nodiscard]] Counts read() const;
+	};
+
+	//! Whether counters can be opened on this system, with the reason in why (if not null) when not
+	bool supported(std::string *why = nullptr);
+}
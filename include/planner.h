@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "stimulus.h"
+#include "types.h"
+
+/**
+ * Accuracy budgeted execution planning. The model has several approximation tiers, which each trade some accuracy
+ * for speed or memory. Rather than selecting them one by one, a Budget states the largest acceptable error, and plan
+ * selects the cheapest combination of tiers whose characterized error fits it.
+ *
+ * The error of a tier is the largest relative (L1) error of the expected PSTH of a CF, i.e. the synaptic output
+ * without noise binned as in Neurogram, with respect to the exact model, over a set of CFs and spontaneous rates
+ * (see characterize). The errors of combined tiers are assumed to add up, and their costs to multiply.
+ */
+namespace planner
+{
+	enum Tier : unsigned
+	{
+		//! Approximated power-law adaptation (PowerLaw APPROXIMATED) instead of the exact (ACTUAL) implementation
+		APPROXIMATE_POWER_LAW = 0,
+		//! Keep the IHC output in single precision between the IHC and the synapse stages
+		FLOAT_IHC = 1,
+		N_TIERS = 2
+	};
+
+	const char *tier_name(Tier tier);
+
+	struct TierStat
+	{
+		//! Largest relative error of the expected PSTH of a CF
+		double error = 0.0;
+		//! Run time (of a CF with one fiber) relative to the exact model, i.e. 0.5 for a tier that halves the run time
+		double cost = 1.0;
+		//! Memory of the intermediate (IHC) outputs relative to the exact model
+		double memory = 1.0;
+	};
+
+	using Characterization = std::array<TierStat, N_TIERS>;
+
+	//! Relative difference below which the costs of plans are considered equal
+	constexpr double COST_TOLERANCE = 0.05;
+
+	struct Budget
+	{
+		//! Largest acceptable relative error of the expected PSTH of a CF, 0 for the exact model
+		double max_relative_error = 0.0;
+
+		static Budget exact()
+		{
+			return {0.0};
+		}
+	};
+
+	struct Plan
+	{
+		//! Bit mask of the selected tiers (1 << Tier)
+		unsigned tiers = 0;
+		//! Estimated largest relative error of the expected PSTH of a CF
+		double estimated_error = 0.0;
+		//! Estimated run time relative to the exact model
+		double relative_cost = 1.0;
+		//! Estimated memory of the intermediate (IHC) outputs relative to the exact model
+		double relative_memory = 1.0;
+
+		[[nodiscard]] bool uses(const Tier tier) const
+		{
+			return tiers & (1u << tier);
+		}
+
+		[[nodiscard]] PowerLaw power_law() const
+		{
+			return uses(APPROXIMATE_POWER_LAW) ? APPROXIMATED : ACTUAL;
+		}
+
+		//! The selected tiers, i.e. "approximate_power_law+float_ihc", or "exact"
+		[[nodiscard]] std::string describe() const;
+	};
+
+	/**
+	 * The characterization used by plan, by default measured on a 1 kHz tone at 60 dB SPL (50 ms), at CFs of 250 Hz
+	 * to 12 kHz, for low, medium and high spontaneous rate fibers.
+	 */
+	Characterization characterization();
+
+	//! Replace the characterization used by plan, i.e. by one measured on representative stimuli
+	void set_characterization(const Characterization &characterization);
+
+	/**
+	 * Measure the error and cost of every tier with respect to the exact model
+	 * @param stim the stimulus
+	 * @param cfs the characteristic frequencies in Hz
+	 * @param sponts the spontaneous rates in spikes/s
+	 * @param bin_width the width of the PSTH bins in s
+	 * @return the characterization
+	 */
+	Characterization characterize(const stimulus::Stimulus &stim, const std::vector<double> &cfs,
+								  const std::vector<double> &sponts, double bin_width = 5e-4);
+
+	/**
+	 * The cheapest combination of tiers of which the estimated error fits the budget. Costs within COST_TOLERANCE of
+	 * each other are considered equal (they are measured), in which case the plan that uses the least memory is selected.
+	 */
+	Plan plan(const Budget &budget, const Characterization &characterization = planner::characterization());
+
+	//! The plan that corresponds to a fixed power-law implementation, without other tiers
+	Plan fixed(PowerLaw power_law, const Characterization &characterization = planner::characterization());
+}
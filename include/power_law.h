@@ -3,12 +3,14 @@
 #include <vector>
 
 #include "types.h"
+#include "utils.h"
 
 
 namespace pla
 {
 	/**
 	 * Approximate implementation of the power law mapping
+	 * @tparam T element type of the input
 	 * @param amplitude_ihc the input
 	 * @param random_numbers source of randomness
 	 * @param n the size of the output
@@ -16,8 +18,9 @@ namespace pla
 	 * @param alpha2 constant
 	 * @param synapse_out the output container
 	 */
+	template <typename T>
 	void approximate(
-		const std::vector<double>& amplitude_ihc,
+		utils::Span<T> amplitude_ihc,
 		const std::vector<double>& random_numbers,
 		int n,
 		double alpha1,
@@ -28,6 +31,7 @@ namespace pla
 	/**
 	 * Actual implementation of the power law mapping
 	 *
+	 * @tparam T element type of the input
 	 * @param amplitude_ihc the input
 	 * @param random_numbers source of randomness
 	 * @param n the size of the output
@@ -38,8 +42,9 @@ namespace pla
 	 * @param bin_width 
 	 * @param synapse_out the output container
 	 */
+	template <typename T>
 	void actual(
-		const std::vector<double>& amplitude_ihc,
+		utils::Span<T> amplitude_ihc,
 		const std::vector<double>& random_numbers,
 		int n,
 		double alpha1,
@@ -54,6 +59,7 @@ namespace pla
 	 * Implementation of the power law mapping function. Applies either the approximate or actual implementation
 	 * given the value of impl.
 	 *
+	 * @tparam T element type of the input, explicitly instantiated for double and float
 	 * @param amplitude_ihc the input
 	 * @param noise the type of noise to use 
 	 * @param impl the type of power law implementation to use
@@ -64,8 +70,9 @@ namespace pla
 	 * @param n_total_timesteps the total number of timesteps of the model
 	 * @return Transformed input
 	 */
+	template <typename T>
 	std::vector<double> power_law(
-		const std::vector<double>& amplitude_ihc,
+		utils::Span<T> amplitude_ihc,
 		NoiseType noise,
 		PowerLaw impl,
 		double spontaneous_firing_rate,
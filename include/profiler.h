@@ -0,0 +1,254 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "memory_accounting.h"
+#include "perf_counters.h"
+#include "trace.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define BRUCE_PROFILE_TSC
+#else
+#include <chrono>
+#endif
+
+/**
+ * Low-overhead per-stage timers. Timers are aggregated per thread and per CF (see set_cf) in thread local storage,
+ * which is merged into a global report when a thread exits or calls flush. Timing is only performed when profiling
+ * is enabled at runtime (see set_enabled), and the timers are compiled out entirely unless BRUCE_PROFILE is defined.
+ *
+ * Optionally, hardware performance counters are read around every timer as well (see set_counters), which falls
+ * back to timing only when the counters are not available. When allocation counting is enabled (see
+ * memory::set_enabled), the allocations of every stage are recorded as well. With tracing enabled (see set_tracing),
+ * every timer is also recorded as an event on the timeline of its thread (see trace.h). When all of these are
+ * disabled, a timer costs a single load and branch.
+ *
+ * The report is global to the process, so it only attributes time correctly when a single neurogram is created
+ * at a time.
+ */
+namespace profiler
+{
+	enum Stage
+	{
+		IHC = 0,
+		MAPPING,
+		FGN,
+		POWER_LAW,
+		UPSAMPLE,
+		SPIKE_GENERATION,
+		BINNING,
+		LOCK_WAIT,
+		N_STAGES
+	};
+
+	const char *stage_name(Stage stage);
+
+	//! Time stamp in ticks, the time stamp counter where available
+	inline uint64_t ticks()
+	{
+#ifdef BRUCE_PROFILE_TSC
+		return __rdtsc();
+#else
+		return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+	}
+
+	//! Duration of a tick in seconds, calibrated on first use
+	double seconds_per_tick();
+
+	struct Stat
+	{
+		uint64_t count = 0;
+		uint64_t total = 0;
+		uint64_t max = 0;
+		//! Hardware counters summed over all timers, if enabled
+		perf::Counts counters;
+		//! Allocations summed over all timers, with the largest peak of a single timer, if enabled
+		memory::Allocations allocations;
+
+		void add(const uint64_t t)
+		{
+			count++;
+			total += t;
+			max = t > max ? t : max;
+		}
+
+		void merge(const Stat &other)
+		{
+			count += other.count;
+			total += other.total;
+			max = other.max > max ? other.max : max;
+			counters += other.counters;
+			allocations.merge(other.allocations);
+		}
+	};
+
+	using Stats = std::array<Stat, N_STAGES>;
+
+	struct Report
+	{
+		//! Statistics per CF index and stage, in ticks
+		std::vector<Stats> per_cf;
+		//! Statistics per stage over all CFs
+		Stats total{};
+		//! Statistics of timers outside of a CF context
+		Stats other{};
+		double seconds_per_tick = 0.0;
+		//! Allocations of all threads over the whole run (excluding the output), if allocation counting is enabled
+		memory::Allocations allocations;
+		//! Peak resident set size of the process during the run in bytes, if allocation counting is enabled
+		double peak_rss = 0.0;
+
+		[[nodiscard]] bool empty() const;
+
+		//! Human-readable summary per stage
+		[[nodiscard]] std::string summary() const;
+	};
+
+	enum Mode : unsigned
+	{
+		TIMERS = 1,
+		COUNTERS = 2,
+		TRACING = 4
+	};
+
+	//! Bit mask of the enabled modes, which every timer reads once
+	extern std::atomic<unsigned> MODE;
+
+	//! Enable or disable the timers at runtime
+	void set_enabled(bool enabled);
+
+	//! Whether the timers are compiled in and enabled
+	bool enabled();
+
+	//! Also read hardware performance counters around every timer (when the timers are enabled)
+	void set_counters(bool enabled);
+
+	bool counters_enabled();
+
+	//! Record every timer, and the tasks of Neurogram::create, as a trace event (independent of set_enabled)
+	void set_tracing(bool enabled);
+
+	//! Whether the timers are compiled in and tracing is enabled
+	bool tracing_enabled();
+
+	//! Current hardware counters of the calling thread, empty when they are not available
+	perf::Counts read_counters();
+
+	//! Attribute timers of the calling thread to CF index cf_i, until the next call
+	void set_cf(size_t cf_i);
+
+	//! Attribute timers of the calling thread to no CF in particular
+	void clear_cf();
+
+	//! Record the interval [begin, end) in ticks of a stage according to mode, and optionally the hardware counters and allocations over that interval
+	void record(Stage stage, unsigned mode, uint64_t begin, uint64_t end, const perf::Counts *counters = nullptr, const memory::Allocations *allocations = nullptr);
+
+	//! Merge the timers of the calling thread into the global report
+	void flush();
+
+	//! Clear the global report and the timers of the calling thread
+	void reset();
+
+	//! The global report, timers of threads that are still running and did not flush are not included
+	Report collect();
+
+	class ScopedTimer
+	{
+		Stage stage_;
+		unsigned mode_;
+		uint64_t start_ = 0;
+		perf::Counts start_counters_;
+		//! Active when allocations are counted
+		memory::Scope allocations_;
+
+		void start()
+		{
+			if ((mode_ & (TIMERS | COUNTERS)) == (TIMERS | COUNTERS))
+				start_counters_ = read_counters();
+			start_ = ticks();
+		}
+
+		void stop()
+		{
+			const uint64_t end = ticks();
+			perf::Counts counters;
+			const bool counting = (mode_ & (TIMERS | COUNTERS)) == (TIMERS | COUNTERS);
+			if (counting)
+				counters = read_counters() - start_counters_;
+			memory::Allocations allocations;
+			if (allocations_.active())
+				allocations = allocations_.allocations();
+			record(stage_, mode_, start_, end, counting ? &counters : nullptr, allocations_.active() ? &allocations : nullptr);
+		}
+
+	public:
+		explicit ScopedTimer(const Stage stage) : stage_(stage),
+												  mode_(MODE.load(std::memory_order_relaxed)),
+												  allocations_((mode_ & TIMERS) && memory::ENABLED.load(std::memory_order_relaxed))
+		{
+			if (mode_)
+				start();
+		}
+
+		ScopedTimer(const ScopedTimer &) = delete;
+		ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+		~ScopedTimer()
+		{
+			if (mode_)
+				stop();
+		}
+	};
+
+	//! Records the lifetime of the scope as a trace event named name, i.e. for a task, when tracing is enabled
+	class TraceScope
+	{
+		const char *name_;
+		int64_t cf_;
+		uint64_t start_ = 0;
+		bool active_;
+
+	public:
+		explicit TraceScope(const char *name, const int64_t cf = -1) : name_(name),
+																		cf_(cf),
+																		active_(MODE.load(std::memory_order_relaxed) & TRACING)
+		{
+			if (active_)
+				start_ = ticks();
+		}
+
+		TraceScope(const TraceScope &) = delete;
+		TraceScope &operator=(const TraceScope &) = delete;
+
+		~TraceScope()
+		{
+			if (active_)
+				trace::emit({name_, start_, ticks(), cf_});
+		}
+	};
+}
+
+#define BRUCE_PROFILE_CONCAT_(a, b) a##b
+#define BRUCE_PROFILE_CONCAT(a, b) BRUCE_PROFILE_CONCAT_(a, b)
+
+#ifdef BRUCE_PROFILE
+//! Time the remainder of the enclosing scope as stage
+#define BRUCE_PROFILE_SCOPE(stage) const profiler::ScopedTimer BRUCE_PROFILE_CONCAT(profile_timer_, __LINE__)(stage)
+#define BRUCE_PROFILE_CF(cf_i) profiler::set_cf(cf_i)
+//! Trace the remainder of the enclosing scope as an event named name (a string literal) for CF index cf
+#define BRUCE_TRACE_SCOPE(name, cf) const profiler::TraceScope BRUCE_PROFILE_CONCAT(trace_scope_, __LINE__)(name, static_cast<int64_t>(cf))
+#else
+#define BRUCE_PROFILE_SCOPE(stage) ((void)0)
+#define BRUCE_PROFILE_CF(cf_i) ((void)0)
+#define BRUCE_TRACE_SCOPE(name, cf) ((void)0)
+#endif
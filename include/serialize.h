@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include "neurogram.h"
+#include "stimulus.h"
+#include "synapse.h"
+
+/**
+ * Native binary serialization of the model objects. An object is split into a small, versioned header,
+ * holding its metadata, and a list of raw contiguous data buffers. The buffers are not copied when
+ * archiving, so they can be written to a stream or handed to a transport (i.e. pickle protocol 5
+ * out-of-band buffers) directly from the object's own storage.
+ *
+ * The format uses the byte order of the host, and is rejected when read on a host with a different one.
+ */
+namespace serialize
+{
+	//! Magic number at the start of every header ("BRCE")
+	constexpr uint32_t MAGIC = 0x45435242;
+
+	//! Format version, incremented on any incompatible change of the layout
+	constexpr uint32_t VERSION = 2;
+
+	enum class ObjectType : uint32_t
+	{
+		STIMULUS = 1,
+		SYNAPSE_OUTPUT = 2,
+		NEUROGRAM = 3
+	};
+
+	//! Non-owning view of a raw data buffer
+	struct Buffer
+	{
+		const void *data = nullptr;
+		//! size in bytes
+		size_t size = 0;
+	};
+
+	//! Serialized form of an object, the buffers refer to the storage of the archived object
+	struct Archive
+	{
+		std::string header;
+		std::vector<Buffer> buffers;
+	};
+
+	Archive archive(const stimulus::Stimulus &stim);
+
+	Archive archive(const syn::SynapseOutput &output);
+
+	Archive archive(const Neurogram &neurogram);
+
+	/**
+	 * Read the object type from a header, validating its magic number and version
+	 * @param header the header
+	 * @return the type of the serialized object
+	 */
+	ObjectType get_type(const std::string &header);
+
+	stimulus::Stimulus restore_stimulus(const std::string &header, const std::vector<Buffer> &buffers);
+
+	syn::SynapseOutput restore_synapse_output(const std::string &header, const std::vector<Buffer> &buffers);
+
+	/**
+	 * Restore a neurogram from its archive
+	 * @param header the header
+	 * @param buffers the buffers
+	 * @param output optional storage, already holding the contents of the output buffer, which is adopted
+	 * by the neurogram instead of copying the output buffer when it is aligned to Neurogram::ROW_ALIGNMENT.
+	 * @return the neurogram
+	 */
+	std::unique_ptr<Neurogram> restore_neurogram(
+		const std::string &header,
+		const std::vector<Buffer> &buffers,
+		std::shared_ptr<double> output = nullptr);
+
+	/**
+	 * Write an archive to a stream, as the size prefixed header followed by the size prefixed buffers
+	 * @param os the stream
+	 * @param archive the archive
+	 */
+	void write(std::ostream &os, const Archive &archive);
+
+	template <typename T>
+	void write(std::ostream &os, const T &object)
+	{
+		write(os, archive(object));
+	}
+
+	stimulus::Stimulus read_stimulus(std::istream &is);
+
+	syn::SynapseOutput read_synapse_output(std::istream &is);
+
+	std::unique_ptr<Neurogram> read_neurogram(std::istream &is);
+}
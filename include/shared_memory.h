@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace shared_memory
+{
+	/**
+	 * A named POSIX shared memory segment, mapped into this process. The segment carries a reference count
+	 * in its header, which counts the mappings in all processes and the references held by handles in transit.
+	 * The segment is unlinked when the last reference is released, so it outlives the process that created it
+	 * for as long as another process holds a reference.
+	 *
+	 * Only supported on POSIX systems, elsewhere create and open throw std::runtime_error.
+	 */
+	class Segment
+	{
+		//! Deleter of shared_ptr<Segment>, allows recovering the segment from aliasing pointers (see owner_of)
+		struct Deleter
+		{
+			Segment *segment;
+
+			void operator()(Segment *p) const
+			{
+				delete p;
+			}
+		};
+
+		struct Header;
+
+		std::string name_;
+		Header *header_ = nullptr;
+		size_t size_ = 0;
+
+		Segment(std::string name, size_t size, bool create, bool adopt_reference);
+
+		static std::shared_ptr<Segment> make_shared(Segment *segment);
+
+	public:
+		//! Offset of the data from the start of the mapping, i.e. the data is aligned to this many bytes
+		static constexpr size_t DATA_OFFSET = 64;
+
+		Segment(const Segment &) = delete;
+		Segment &operator=(const Segment &) = delete;
+
+		~Segment();
+
+		/**
+		 * Create a new, zero-initialized segment with a unique name
+		 * @param size the size of the data in bytes
+		 * @return the segment, holding a single reference
+		 */
+		static std::shared_ptr<Segment> create(size_t size);
+
+		/**
+		 * Map an existing segment
+		 * @param name the name of the segment
+		 * @param adopt_reference take over a reference added by retain (i.e. in another process), rather than adding one
+		 * @return the segment
+		 */
+		static std::shared_ptr<Segment> open(const std::string &name, bool adopt_reference = false);
+
+		/**
+		 * The segment owning the storage of p, when p was created by aliasing a shared_ptr<Segment>
+		 * @param p the pointer
+		 * @return the segment, or null when p does not point into shared memory
+		 */
+		template <typename T>
+		static std::shared_ptr<Segment> owner_of(const std::shared_ptr<T> &p)
+		{
+			if (const auto *deleter = std::get_deleter<Deleter>(p))
+				return std::shared_ptr<Segment>(p, deleter->segment);
+			return nullptr;
+		}
+
+		/**
+		 * Add a reference which is not tied to a mapping, i.e. for a handle that is sent to another process,
+		 * where it is taken over by open(name, true).
+		 */
+		void retain() const;
+
+		[[nodiscard]] size_t ref_count() const;
+
+		[[nodiscard]] void *data() const;
+
+		[[nodiscard]] size_t size() const
+		{
+			return size_;
+		}
+
+		[[nodiscard]] const std::string &name() const
+		{
+			return name_;
+		}
+	};
+}
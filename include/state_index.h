@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "inner_hair_cell.h"
+#include "types.h"
+
+/**
+ * Index of snapshots of the model state over a long recording, for random access into it (see
+ * Neurogram::build_index and Neurogram::create_window). A snapshot holds the state of the IHC model of every CF
+ * (see ihc::Model) at a sample of the recording, so the IHC output of a window is obtained exactly by continuing
+ * from the nearest earlier snapshot, rather than by simulating the recording from its start.
+ *
+ * The synapse stage is not incremental (its fGn is synthesized over the whole signal), so a snapshot holds no
+ * synapse state: a window restarts it at the snapshot, after a warm-up. Instead of a position of a global generator,
+ * the index holds the seed of the generators of the fibers of a window, which are keyed by the snapshot and the task.
+ */
+namespace state_index
+{
+	struct Snapshot
+	{
+		//! The sample of the recording at which the snapshot was taken, i.e. the number of samples processed
+		size_t sample = 0;
+		//! The state of the IHC model of every CF
+		std::vector<ihc::Model> models;
+	};
+
+	class Index
+	{
+	public:
+		double time_resolution = 0.0;
+		Species species = HUMAN_SHERA;
+		//! The parameters of the neurogram the index was built for
+		std::vector<double> cfs;
+		std::vector<double> coh_cs;
+		std::vector<double> ihc_cs;
+		size_t control_decimation = 1;
+		//! Base seed of the generators the fibers of a window draw from (utils::SEED when the index was built)
+		int seed = 42;
+		//! Samples between consecutive snapshots
+		size_t interval = 0;
+		//! Number of (simulation) samples of the recording
+		size_t n_samples = 0;
+		//! Snapshots in order of their sample, the first is taken at sample 0
+		std::vector<Snapshot> snapshots;
+
+		//! The last snapshot taken at or before sample
+		[[nodiscard]] const Snapshot &before(size_t sample) const;
+
+		/**
+		 * Write the index to a binary file, field by field (see ihc::Model::write_state) in the byte order of the
+		 * host; throws std::runtime_error on failure
+		 */
+		void save(const std::string &path) const;
+
+		//! Read an index written by save; throws std::runtime_error when it cannot be read or is malformed
+		static Index load(const std::string &path);
+	};
+}
@@ -23,17 +23,26 @@ namespace stimulus
 		size_t n_simulation_timesteps;
 
 		Stimulus(
-			const std::vector<double> &data,
+			std::vector<double> data,
 			const size_t sampling_rate,
-			const double simulation_duration) : data(data),
+			const double simulation_duration) : data(std::move(data)),
 												sampling_rate(sampling_rate),
 												time_resolution(1.0 / static_cast<double>(sampling_rate)),
-												stimulus_duration(static_cast<double>(data.size()) * time_resolution),
+												stimulus_duration(static_cast<double>(this->data.size()) * time_resolution),
 												simulation_duration(simulation_duration),
-												n_stimulation_timesteps(data.size()),
+												n_stimulation_timesteps(this->data.size()),
 												n_simulation_timesteps(static_cast<size_t>(std::ceil(simulation_duration / time_resolution)))
 		{
 		}
+
+		//! Construct from a view over externally owned samples, which are copied (and converted to double) in bulk
+		template <typename T>
+		Stimulus(
+			const utils::Span<T> data,
+			const size_t sampling_rate,
+			const double simulation_duration) : Stimulus(std::vector<double>(data.begin(), data.end()), sampling_rate, simulation_duration)
+		{
+		}
 	};
 
 	Stimulus from_file(const std::string &path, bool verbose = true, double sim_time = 1.0);
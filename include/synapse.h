@@ -2,6 +2,9 @@
 
 #include <vector>
 
+#include "types.h"
+#include "utils.h"
+
 namespace syn
 {
 	//! Output wrapper for synapse model
@@ -40,6 +43,21 @@ namespace syn
 		 */
 	};
 
+	//! Output wrapper for a batch of synapse model evaluations, see synapse_batch
+	struct SynapseBatchOutput
+	{
+		size_t n_fibers;
+		size_t n_trials;
+		size_t n_bins;
+
+		//! Binned psth for each (fiber, trial), row major, shape (n_fibers, n_trials, n_bins). Empty if spikes are stored
+		std::vector<double> psth;
+
+		//! Spike times in CSR layout, the spikes of row r = fiber * n_trials + trial are in [spike_offsets[r], spike_offsets[r + 1])
+		std::vector<size_t> spike_offsets;
+		std::vector<double> spike_times;
+	};
+
 	/**
 	 * Up sample the result of the power law function to the original (High 100 kHz) sampling rate
 	 *
@@ -135,4 +153,67 @@ syn::SynapseOutput synapse(
 	double abs_refractory_period = 0.7,
 	double rel_refractory_period = 0.6,
 	bool calculate_stats = true
-);
\ No newline at end of file
+);
+
+/**
+ * Synapse model over a view of the (mapped) inner hair cell output, see synapse(const std::vector<double>&, ...).
+ * Explicitly instantiated for double and float inputs, such that externally owned buffers can be used without copying.
+ */
+template <typename T>
+syn::SynapseOutput synapse(
+	utils::Span<T> amplitude_ihc,
+	double cf,
+	int n_rep,
+	size_t n_timesteps,
+	double time_resolution = 1 / 100e3, // time_resolution in seconds, reciprocal of sampling rate
+	NoiseType noise = RANDOM,
+	PowerLaw pla_impl = APPROXIMATED, 
+	double spontaneous_firing_rate = 100,
+	double abs_refractory_period = 0.7,
+	double rel_refractory_period = 0.6,
+	bool calculate_stats = true
+);
+
+/**
+ * Evaluate the synapse model for a population of fibers with a shared characteristic frequency, for n_trials
+ * each, on the worker threads (see utils::parallel_for). Work that only depends on the CF and the spontaneous
+ * rate, i.e. the synapse mapping, is computed once for each unique spontaneous rate.
+ * Each (fiber, trial) row draws from a generator of its own (see utils::GeneratorScope), seeded by utils::SEED and
+ * the index of the row, so the output does not depend on the number of threads.
+ *
+ * @tparam T element type of the input, explicitly instantiated for double and float
+ * @param input the output of the inner hair cell model if map_input is true, otherwise the already mapped input (see synapse)
+ * @param cf the characteristic frequency of the fibers in Hz
+ * @param spontaneous_firing_rates the spontaneous firing rate of each fiber in /s
+ * @param abs_refractory_periods the absolute refractory period of each fiber in s
+ * @param rel_refractory_periods the baseline mean relative refractory period of each fiber in s
+ * @param n_trials the number of trials per fiber
+ * @param n_rep the number of repetitions for the psth
+ * @param n_timesteps the number of timesteps, if 0 it is derived from the size of the input (only if map_input is true)
+ * @param time_resolution the binsize in seconds, i.e., the reciprocal of the sampling rate
+ * @param noise The type of noise (see `NoiseType')
+ * @param pla_impl The type of power law implementation
+ * @param map_input whether the input is to be mapped using mapping_function first
+ * @param mapping_function the synapse mapping function, only used when map_input is true
+ * @param n_bins the number of psth bins (see utils::make_bins), 0 to store the psth at full resolution
+ * @param store_spikes store the spike times of each (fiber, trial) in CSR layout instead of the psth
+ * @return the stacked outputs
+ */
+template <typename T>
+syn::SynapseBatchOutput synapse_batch(
+	utils::Span<T> input,
+	double cf,
+	utils::Span<double> spontaneous_firing_rates,
+	utils::Span<double> abs_refractory_periods,
+	utils::Span<double> rel_refractory_periods,
+	int n_trials,
+	int n_rep,
+	size_t n_timesteps,
+	double time_resolution = 1 / 100e3,
+	NoiseType noise = RANDOM,
+	PowerLaw pla_impl = APPROXIMATED,
+	bool map_input = false,
+	SynapseMapping mapping_function = SOFTPLUS,
+	size_t n_bins = 0,
+	bool store_spikes = false
+);
@@ -3,6 +3,7 @@
 #include <functional>
 #include <vector>
 #include "types.h"
+#include "utils.h"
 
 using SynapseMappingFunction = std::function<double(double)>;
 
@@ -56,13 +57,26 @@ namespace synapse_mapping
 	 *	Synapse mapping function. Maps the output of the inner hair cell model (ihc_output)
 	 *	to a rescaled output, using a given non-linear mapping function.
 	 *
-	 * @param ihc_output the output of the inner hair cell model
+	 * @tparam T element type of the input, explicitly instantiated for double and float
+	 * @param ihc_output view of the output of the inner hair cell model
 	 * @param spontaneous_firing_rate the spontaneous firing rate
 	 * @param characteristic_frequency the characteristic frequency
 	 * @param time_resolution the time resolution of the input
 	 * @param mapping_function Type of mapping function to be used
 	 * @return transformed inner hair cell output
 	 */
+	template <typename T>
+	std::vector<double> map(
+		utils::Span<T> ihc_output,
+		double spontaneous_firing_rate,
+		double characteristic_frequency,
+		double time_resolution,
+		SynapseMapping mapping_function
+	);
+
+	/**
+	 *	Synapse mapping function, see map(utils::Span<T>, ...)
+	 */
 	std::vector<double> map(
 		const std::vector<double>& ihc_output,
 		double spontaneous_firing_rate,
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Timeline tracing of tasks and stages. Every thread records complete (begin, end) events in its own fixed size ring
+ * buffer, which only the owning thread writes to, so recording takes no locks. When a buffer is full, the oldest
+ * events are overwritten. The events are meant to be read (see write_chrome_trace) once the recording threads have
+ * finished, i.e. after Neurogram::create returns.
+ *
+ * Events are recorded through the profiler (see profiler::set_tracing), which timestamps them in profiler::ticks.
+ */
+namespace trace
+{
+	struct Event
+	{
+		//! Static string, i.e. the name of a stage
+		const char *name;
+		uint64_t begin;
+		uint64_t end;
+		//! CF index of the event, or -1 for none
+		int64_t cf;
+	};
+
+	class RingBuffer
+	{
+		std::vector<Event> events_;
+		std::atomic<uint64_t> head_{0};
+		const uint32_t thread_id_;
+
+	public:
+		RingBuffer(size_t capacity, uint32_t thread_id);
+
+		void push(const Event &event)
+		{
+			const uint64_t head = head_.load(std::memory_order_relaxed);
+			events_[head & (events_.size() - 1)] = event;
+			head_.store(head + 1, std::memory_order_release);
+		}
+
+		//! The events in the buffer, oldest first
+		[[nodiscard]] std::vector<Event> events() const;
+
+		//! Number of events that were overwritten
+		[[nodiscard]] uint64_t n_dropped() const;
+
+		//! Drop all events, which must not race with push
+		void clear()
+		{
+			head_.store(0, std::memory_order_release);
+		}
+
+		[[nodiscard]] uint32_t thread_id() const
+		{
+			return thread_id_;
+		}
+	};
+
+	//! Record an event on the ring buffer of the calling thread, which is created on first use
+	void emit(const Event &event);
+
+	//! Number of events per thread (rounded up to a power of two) of ring buffers created from now on
+	void set_capacity(size_t capacity);
+
+	//! Drop all recorded events, and the buffers of threads that have exited. Threads must not record concurrently.
+	void clear();
+
+	//! Write the recorded events as Chrome trace event JSON (chrome://tracing, ui.perfetto.dev)
+	void write_chrome_trace(std::ostream &os, double seconds_per_tick);
+
+	//! Write the recorded events as Chrome trace event JSON to path, throws std::runtime_error when it cannot be written
+	void write_chrome_trace(const std::string &path, double seconds_per_tick);
+}
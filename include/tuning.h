@@ -0,0 +1,122 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * Autotuning of the schedule of Neurogram::create. The fastest schedule depends on the machine (number of cores,
+ * caches, memory bandwidth) and on the shape of the workload, so autotune times short calibration workloads of a
+ * number of shapes, and stores the fastest schedule of each in a Profile. Profiles are saved to a local file
+ * (see default_path), which is loaded on first use by Neurogram::create, and only applies to the machine it was
+ * recorded on.
+ */
+namespace tuning
+{
+	//! How Neurogram::create distributes its work over the worker threads
+	struct Schedule
+	{
+		//! Number of worker threads, 0 for utils::N_THREADS (which is also the upper bound)
+		size_t n_threads = 0;
+		//! Number of CFs whose IHC outputs are evaluated (and kept in memory) at once, 0 for all CFs
+		size_t cf_block = 0;
+		//! Maximum number of trials of a fiber per task, 0 for all trials in a single task
+		size_t trials_per_task = 0;
+
+		bool operator==(const Schedule &other) const
+		{
+			return n_threads == other.n_threads && cf_block == other.cf_block && trials_per_task == other.trials_per_task;
+		}
+	};
+
+	//! Shape of a workload of Neurogram::create
+	struct Shape
+	{
+		size_t n_cf = 0;
+		//! Number of fibers per CF
+		size_t n_fibers = 0;
+		//! Number of simulation samples of the stimulus
+		size_t n_samples = 0;
+		size_t n_trials = 1;
+
+		//! Log distance to another shape, over all dimensions
+		[[nodiscard]] double distance(const Shape &other) const;
+	};
+
+	struct Entry
+	{
+		Shape shape;
+		Schedule schedule;
+		//! Calibration time of the schedule in seconds
+		double seconds = 0.0;
+	};
+
+	class Profile
+	{
+		std::string machine_;
+		std::vector<Entry> entries_;
+
+	public:
+		explicit Profile(std::string machine);
+
+		//! Identifier of the machine the profile was recorded on, see machine_id
+		[[nodiscard]] const std::string &machine() const
+		{
+			return machine_;
+		}
+
+		[[nodiscard]] const std::vector<Entry> &entries() const
+		{
+			return entries_;
+		}
+
+		//! Add an entry, replacing an entry of the same shape
+		void add(const Entry &entry);
+
+		//! The schedule of the entry nearest to shape, if any
+		[[nodiscard]] std::optional<Schedule> lookup(const Shape &shape) const;
+
+		//! Write the profile as text to path, creating its directory; throws std::runtime_error when it cannot be written
+		void save(const std::string &path) const;
+
+		//! Read a profile written by save; throws std::runtime_error when it cannot be read or is malformed
+		static Profile load(const std::string &path);
+	};
+
+	//! Identifier of this machine: the model of the CPU and the number of hardware threads
+	std::string machine_id();
+
+	/**
+	 * Location of the profile file: the environment variable BRUCE_TUNING_PROFILE if set, otherwise
+	 * bruce/tuning_profile.txt in $XDG_CACHE_HOME or $HOME/.cache, or empty when none of these are set.
+	 */
+	std::string default_path();
+
+	/**
+	 * The profile used by Neurogram::create. On first use, the profile at default_path is loaded, if it exists and
+	 * was recorded on this machine. Null when there is no such profile.
+	 */
+	std::shared_ptr<const Profile> active_profile();
+
+	//! Replace the profile used by Neurogram::create, null to use the default schedule
+	void set_active_profile(std::shared_ptr<const Profile> profile);
+
+	struct Options
+	{
+		//! Shapes to calibrate, empty for a default set of small workloads
+		std::vector<Shape> shapes;
+		//! Candidate thread counts, empty for the powers of two up to (and including) the hardware concurrency
+		std::vector<size_t> thread_counts;
+		//! Repetitions per candidate, of which the fastest is used
+		size_t repetitions = 3;
+		//! Print the timing of every candidate
+		bool verbose = false;
+	};
+
+	/**
+	 * Time the candidate schedules for every shape and return the fastest ones. The thread count, CF block and
+	 * trials per task are tuned in turn, each with the best values found for the previous ones.
+	 */
+	Profile autotune(const Options &options = {});
+}
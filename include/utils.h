@@ -1,5 +1,10 @@
 ﻿#pragma once
+#include <algorithm>
+#include <atomic>
 #include <complex>
+#include <exception>
+#include <mutex>
+#include <thread>
 #include <random>
 #include <valarray>
 #include <vector>
@@ -36,6 +41,40 @@ namespace utils
 		}
 	}
 
+	/**
+	 * Non-owning, read-only view over a contiguous array. Allows the model functions
+	 * to operate directly on externally owned memory (i.e. numpy buffers).
+	 * @tparam T the element type
+	 */
+	template <typename T>
+	struct Span
+	{
+		const T* ptr = nullptr;
+		size_t n = 0;
+
+		Span() = default;
+
+		Span(const T* ptr, const size_t n) : ptr(ptr), n(n)
+		{
+		}
+
+		Span(const std::vector<T>& x) : ptr(x.data()), n(x.size())
+		{
+		}
+
+		const T& operator[](const size_t i) const { return ptr[i]; }
+
+		[[nodiscard]] size_t size() const { return n; }
+
+		[[nodiscard]] bool empty() const { return n == 0; }
+
+		[[nodiscard]] const T* data() const { return ptr; }
+
+		[[nodiscard]] const T* begin() const { return ptr; }
+
+		[[nodiscard]] const T* end() const { return ptr + n; }
+	};
+
 	/**
 	 * The fast-fourier transform of a signal x
 	 * @param x signal to transform
@@ -60,6 +99,92 @@ namespace utils
 	 */
 	void set_seed(int seed);
 
+	/**
+	 * A generator of its own for the calling thread: during the lifetime of the scope, rand1, randn1, randn and the
+	 * noise of fast_fractional_gaussian_noise draw from it instead of GENERATOR. Parallel tasks use it to draw
+	 * reproducible streams (seeded by the task) without sharing GENERATOR. Scopes nest, in reverse order of destruction.
+	 */
+	class GeneratorScope
+	{
+		GeneratorScope *previous_;
+
+	public:
+		std::mt19937 generator;
+		std::normal_distribution<double> normal{0.0, 1.0};
+
+		/**
+		 * @param seed the base seed, i.e. SEED
+		 * @param stream the index of the stream of the task, which gives a distinct sequence for each index
+		 */
+		GeneratorScope(int seed, size_t stream);
+		~GeneratorScope();
+
+		GeneratorScope(const GeneratorScope &) = delete;
+		GeneratorScope &operator=(const GeneratorScope &) = delete;
+	};
+
+	//! The generator of the calling thread, that of the innermost GeneratorScope, or GENERATOR outside of any scope
+	std::mt19937 &generator();
+
+	//! The number of worker threads used by the model
+	extern size_t N_THREADS;
+
+	/**
+	 * Set the global number of worker threads
+	 * @param n_threads the number of threads, 0 selects the hardware concurrency
+	 */
+	void set_n_threads(size_t n_threads);
+
+	/**
+	 * Evaluate f(i) for i in [0, n) on a pool of worker threads, which take tasks in order from a shared
+	 * counter. The calling thread participates as one of the workers. The first exception thrown by any
+	 * task is rethrown on the calling thread, after which the remaining tasks are skipped.
+	 *
+	 * @tparam F callable with signature void(size_t)
+	 * @param n the number of tasks
+	 * @param f the task function
+	 * @param n_threads the maximum number of threads to use
+	 */
+	template <typename F>
+	void parallel_for(const size_t n, F&& f, size_t n_threads = N_THREADS)
+	{
+		n_threads = std::max<size_t>(1, std::min(n_threads, n));
+
+		std::atomic<size_t> next{0};
+		std::exception_ptr error;
+		std::mutex error_mutex;
+
+		auto worker = [&]()
+		{
+			for (size_t i = next++; i < n; i = next++)
+			{
+				try
+				{
+					f(i);
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(error_mutex);
+					if (!error)
+						error = std::current_exception();
+					next = n;
+				}
+			}
+		};
+
+		std::vector<std::thread> threads;
+		threads.reserve(n_threads - 1);
+		for (size_t t = 1; t < n_threads; t++)
+			threads.emplace_back(worker);
+		worker();
+
+		for (auto& th : threads)
+			th.join();
+
+		if (error)
+			std::rethrow_exception(error);
+	}
+
 	/**
 	 * Generate a single uniform random number in [0, 1)
 	 * @return the number
@@ -8,10 +8,16 @@ from pybind11.setup_helpers import Pybind11Extension, build_ext
 
 __version__ = "0.0.1"
 
+# Counting allocations replaces the global operator new and delete of the whole interpreter, so it is opt-in
+define_macros = [("BRUCE_PROFILE", None)]
+if os.environ.get("BRUCE_COUNT_ALLOCATIONS", "0") == "1":
+    define_macros.append(("BRUCE_COUNT_ALLOCATIONS", None))
+
 ext = Pybind11Extension(
     "bruce.brucecpp", 
-    [x for x in glob("src/*cpp") if "main.cpp" not in x], 
+    [x for x in glob("src/*cpp") if not x.endswith(("main.cpp", "bruce_c.cpp"))], 
     include_dirs=["include"],
+    define_macros=define_macros,
     cxx_std=17
 )
 
@@ -19,6 +25,14 @@ if platform.system() in ("Linux", "Darwin"):
     os.environ["CC"] = "g++"
     os.environ["CXX"] = "g++"
     ext._add_cflags(["-O3", "-pthread"])
+    if platform.system() == "Linux":
+        # shm_open lives in librt on older glibc versions
+        ext.libraries.append("rt")
+        if platform.machine() in ("x86_64", "AMD64"):
+            # Kernels are built for several instruction sets and selected at load time, see dispatch.h. Without
+            # contraction to FMA, which the extension can only disable for all of its sources, the clones agree bit for bit
+            ext.define_macros.append(("BRUCE_DISPATCH", None))
+            ext._add_cflags(["-ffp-contract=off"])
 else:
     ext._add_cflags(["/O2"])
 
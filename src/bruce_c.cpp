@@ -0,0 +1,315 @@
+#include "bruce_c.h"
+
+#include <fstream>
+#include <functional>
+#include <ios>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include "bruce.h"
+
+struct bruce_stimulus
+{
+	stimulus::Stimulus stim;
+};
+
+struct bruce_engine
+{
+	Neurogram neurogram;
+};
+
+struct bruce_result
+{
+	std::shared_ptr<double> output;
+	size_t n_cf;
+	size_t n_bins;
+	size_t row_stride;
+};
+
+namespace
+{
+	thread_local std::string last_error;
+
+	struct IoError : std::runtime_error
+	{
+		using std::runtime_error::runtime_error;
+	};
+
+	//! Run f, translating any exception into a status code and the last error of the thread
+	template <typename F>
+	bruce_status guard(F &&f) noexcept
+	{
+		try
+		{
+			f();
+			return BRUCE_OK;
+		}
+		catch (const std::bad_alloc &)
+		{
+			last_error = "out of memory";
+			return BRUCE_ERROR_OUT_OF_MEMORY;
+		}
+		catch (const IoError &e)
+		{
+			last_error = e.what();
+			return BRUCE_ERROR_IO;
+		}
+		catch (const std::ios_base::failure &e)
+		{
+			last_error = e.what();
+			return BRUCE_ERROR_IO;
+		}
+		catch (const std::logic_error &e)
+		{
+			// Includes std::invalid_argument, as thrown by utils::validate_parameter
+			last_error = e.what();
+			return BRUCE_ERROR_INVALID_ARGUMENT;
+		}
+		catch (const std::exception &e)
+		{
+			last_error = e.what();
+			return BRUCE_ERROR_INTERNAL;
+		}
+		catch (...)
+		{
+			last_error = "unknown error";
+			return BRUCE_ERROR_INTERNAL;
+		}
+	}
+
+	template <typename T>
+	void require(const T *p, const char *name)
+	{
+		if (!p)
+			throw std::invalid_argument(std::string(name) + " should not be null");
+	}
+
+	template <typename T>
+	bruce_status make(T **handle, const char *name, const std::function<T *()> &f) noexcept
+	{
+		return guard([&]()
+					 {
+			require(handle, name);
+			*handle = nullptr;
+			*handle = f(); });
+	}
+
+	void create(Neurogram &ng, const stimulus::Stimulus &stim, const bruce_create_params &params, double *output, const size_t row_stride)
+	{
+		require(output, "output");
+		ng.create(stim, params.n_rep, params.n_trials, static_cast<Species>(params.species), static_cast<NoiseType>(params.noise_type),
+				  static_cast<PowerLaw>(params.power_law), std::shared_ptr<double>(output, [](double *) {}), row_stride);
+	}
+
+	void validate(const bruce_create_params *params)
+	{
+		require(params, "params");
+		utils::validate_parameter<int>(params->species, CAT, HUMAN_GLASSBERG_MOORE, "species");
+		utils::validate_parameter<int>(params->noise_type, ONES, RANDOM, "noise_type");
+		utils::validate_parameter<int>(params->power_law, APPROXIMATED, ACTUAL, "power_law");
+	}
+}
+
+extern "C"
+{
+	int bruce_abi_version(void)
+	{
+		return BRUCE_C_ABI_VERSION;
+	}
+
+	const char *bruce_last_error(void)
+	{
+		return last_error.c_str();
+	}
+
+	bruce_create_params bruce_default_create_params(void)
+	{
+		return {1, 1, BRUCE_HUMAN_SHERA, BRUCE_NOISE_RANDOM, BRUCE_POWER_LAW_APPROXIMATED};
+	}
+
+	void bruce_set_n_threads(const size_t n_threads)
+	{
+		utils::set_n_threads(n_threads);
+	}
+
+	size_t bruce_get_n_threads(void)
+	{
+		return utils::N_THREADS;
+	}
+
+	void bruce_set_seed(const int seed)
+	{
+		utils::set_seed(seed);
+	}
+
+	bruce_status bruce_stimulus_new(const double *data, const size_t n, const size_t sampling_rate, const double simulation_duration, bruce_stimulus **stimulus)
+	{
+		return make<bruce_stimulus>(stimulus, "stimulus", [&]()
+									{
+			if (n)
+				require(data, "data");
+			if (sampling_rate == 0)
+				throw std::invalid_argument("sampling_rate should be positive");
+			auto stim = stimulus::Stimulus(std::vector<double>(data, data + n), sampling_rate, simulation_duration);
+			utils::validate_parameter(stim.simulation_duration, stim.stimulus_duration, std::numeric_limits<double>::infinity(), "simulation_duration");
+			return new bruce_stimulus{std::move(stim)}; });
+	}
+
+	bruce_status bruce_stimulus_from_file(const char *path, const double sim_time, bruce_stimulus **stimulus)
+	{
+		return make<bruce_stimulus>(stimulus, "stimulus", [&]()
+									{
+			require(path, "path");
+			if (!std::ifstream(path))
+				throw IoError(std::string("cannot read ") + path);
+			auto stim = stimulus::from_file(path, false, sim_time);
+			if (stim.data.empty())
+				throw IoError(std::string("not a valid audio file: ") + path);
+			return new bruce_stimulus{std::move(stim)}; });
+	}
+
+	bruce_status bruce_stimulus_ramped_sine_wave(const double duration, const double simulation_duration, const size_t sampling_rate,
+												 const double rt, const double delay, const double f0, const double db, bruce_stimulus **stimulus)
+	{
+		return make<bruce_stimulus>(stimulus, "stimulus", [&]()
+									{ return new bruce_stimulus{stimulus::ramped_sine_wave(duration, simulation_duration, sampling_rate, rt, delay, f0, db)}; });
+	}
+
+	bruce_status bruce_stimulus_size(const bruce_stimulus *stimulus, size_t *n_stimulation, size_t *n_simulation)
+	{
+		return guard([&]()
+					 {
+			require(stimulus, "stimulus");
+			if (n_stimulation)
+				*n_stimulation = stimulus->stim.n_stimulation_timesteps;
+			if (n_simulation)
+				*n_simulation = stimulus->stim.n_simulation_timesteps; });
+	}
+
+	void bruce_stimulus_free(bruce_stimulus *stimulus)
+	{
+		delete stimulus;
+	}
+
+	bruce_status bruce_engine_new(const double *cfs, const size_t n_cf, const size_t n_low, const size_t n_med, const size_t n_high, bruce_engine **engine)
+	{
+		return make<bruce_engine>(engine, "engine", [&]()
+								  {
+			if (!cfs)
+				return new bruce_engine{Neurogram(n_cf, n_low, n_med, n_high)};
+			for (size_t i = 0; i < n_cf; i++)
+				utils::validate_parameter(cfs[i], 124.9, 40.1e3, "cf");
+			return new bruce_engine{Neurogram(std::vector<double>(cfs, cfs + n_cf), n_low, n_med, n_high)}; });
+	}
+
+	void bruce_engine_free(bruce_engine *engine)
+	{
+		delete engine;
+	}
+
+	bruce_status bruce_engine_n_cf(const bruce_engine *engine, size_t *n_cf)
+	{
+		return guard([&]()
+					 {
+			require(engine, "engine");
+			require(n_cf, "n_cf");
+			*n_cf = engine->neurogram.get_cfs().size(); });
+	}
+
+	bruce_status bruce_engine_cfs(const bruce_engine *engine, double *cfs)
+	{
+		return guard([&]()
+					 {
+			require(engine, "engine");
+			require(cfs, "cfs");
+			const auto values = engine->neurogram.get_cfs();
+			std::copy(values.begin(), values.end(), cfs); });
+	}
+
+	bruce_status bruce_engine_set_bin_width(bruce_engine *engine, const double bin_width)
+	{
+		return guard([&]()
+					 {
+			require(engine, "engine");
+			utils::validate_parameter(bin_width, 1e-6, std::numeric_limits<double>::infinity(), "bin_width");
+			engine->neurogram.bin_width = bin_width; });
+	}
+
+	bruce_status bruce_engine_n_bins(const bruce_engine *engine, const bruce_stimulus *stimulus, size_t *n_bins)
+	{
+		return guard([&]()
+					 {
+			require(engine, "engine");
+			require(stimulus, "stimulus");
+			require(n_bins, "n_bins");
+			*n_bins = engine->neurogram.get_n_bins(stimulus->stim); });
+	}
+
+	bruce_status bruce_engine_create(bruce_engine *engine, const bruce_stimulus *stimulus, const bruce_create_params *params, double *output, const size_t row_stride)
+	{
+		return guard([&]()
+					 {
+			require(engine, "engine");
+			require(stimulus, "stimulus");
+			validate(params);
+			create(engine->neurogram, stimulus->stim, *params, output, row_stride); });
+	}
+
+	bruce_status bruce_engine_create_batch(bruce_engine *engine, const bruce_stimulus *const *stimuli, const size_t n, const bruce_create_params *params,
+										   double *const *outputs, const size_t *row_strides, const size_t row_stride, size_t *failed_index)
+	{
+		size_t i = 0;
+		const auto status = guard([&]()
+								  {
+			require(engine, "engine");
+			validate(params);
+			if (n)
+			{
+				require(stimuli, "stimuli");
+				require(outputs, "outputs");
+			}
+			for (; i < n; i++)
+			{
+				require(stimuli[i], "stimulus");
+				create(engine->neurogram, stimuli[i]->stim, *params, outputs[i], row_strides ? row_strides[i] : row_stride);
+			} });
+		if (failed_index)
+			*failed_index = i;
+		return status;
+	}
+
+	bruce_status bruce_engine_run(bruce_engine *engine, const bruce_stimulus *stimulus, const bruce_create_params *params, bruce_result **result)
+	{
+		return make<bruce_result>(result, "result", [&]()
+								  {
+			require(engine, "engine");
+			require(stimulus, "stimulus");
+			validate(params);
+			auto &ng = engine->neurogram;
+			ng.create(stimulus->stim, params->n_rep, params->n_trials, static_cast<Species>(params->species),
+					  static_cast<NoiseType>(params->noise_type), static_cast<PowerLaw>(params->power_law));
+			return new bruce_result{ng.get_output_buffer(), ng.get_cfs().size(), ng.n_bins(), ng.row_stride()}; });
+	}
+
+	bruce_status bruce_result_data(const bruce_result *result, const double **data, size_t *n_cf, size_t *n_bins, size_t *row_stride)
+	{
+		return guard([&]()
+					 {
+			require(result, "result");
+			if (data)
+				*data = result->output.get();
+			if (n_cf)
+				*n_cf = result->n_cf;
+			if (n_bins)
+				*n_bins = result->n_bins;
+			if (row_stride)
+				*row_stride = result->row_stride; });
+	}
+
+	void bruce_result_free(bruce_result *result)
+	{
+		delete result;
+	}
+}
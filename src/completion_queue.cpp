@@ -0,0 +1,70 @@
+#include "completion_queue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+namespace utils
+{
+	namespace
+	{
+		//! Spin briefly, then sleep for increasingly longer
+		void backoff(const size_t attempt)
+		{
+			if (attempt < 64)
+				std::this_thread::yield();
+			else
+				std::this_thread::sleep_for(std::chrono::microseconds(std::min<size_t>(attempt, 1000)));
+		}
+	}
+
+	CompletionQueue::CompletionQueue(const size_t capacity) : capacity_(capacity),
+															  slots_(new Slot[capacity])
+	{
+		if (capacity_ == 0)
+			throw std::invalid_argument("CompletionQueue should have a capacity of at least 1");
+		for (size_t i = 0; i < capacity_; i++)
+			slots_[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	void CompletionQueue::push(const size_t value)
+	{
+		const size_t position = tail_.fetch_add(1, std::memory_order_relaxed);
+		auto &slot = slots_[position % capacity_];
+
+		// The slot is free once the consumer popped the value of the previous lap
+		for (size_t attempt = 0; slot.sequence.load(std::memory_order_acquire) != position; attempt++)
+			backoff(attempt);
+
+		slot.value = value;
+		slot.sequence.store(position + 1, std::memory_order_release);
+	}
+
+	bool CompletionQueue::try_pop(size_t &value)
+	{
+		auto &slot = slots_[head_ % capacity_];
+		if (slot.sequence.load(std::memory_order_acquire) != head_ + 1)
+			return false;
+
+		value = slot.value;
+		slot.sequence.store(head_ + capacity_, std::memory_order_release);
+		head_++;
+		return true;
+	}
+
+	bool CompletionQueue::pop(size_t &value, const std::atomic<bool> &stop)
+	{
+		for (size_t attempt = 0;; attempt++)
+		{
+			if (try_pop(value))
+				return true;
+
+			// Values pushed before stop was set are still returned
+			if (stop.load(std::memory_order_acquire))
+				return try_pop(value);
+
+			backoff(attempt);
+		}
+	}
+}
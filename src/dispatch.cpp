@@ -0,0 +1,28 @@
+#include "dispatch.h"
+
+namespace dispatch
+{
+	bool enabled()
+	{
+#ifdef BRUCE_HAS_DISPATCH
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	const char *isa()
+	{
+#ifdef BRUCE_HAS_DISPATCH
+		// Mirrors the priority of the resolvers generated for target_clones
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f"))
+			return "avx512f";
+		if (__builtin_cpu_supports("avx2"))
+			return "avx2";
+		if (__builtin_cpu_supports("sse4.2"))
+			return "sse4.2";
+#endif
+		return "default";
+	}
+}
@@ -19,7 +19,11 @@
 
 #define _USE_MATH_DEFINES
 #include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
 
+#include "dispatch.h"
 #include "inner_hair_cell.h"
 #include "utils.h"
 
@@ -277,6 +281,9 @@ namespace ihc
 		return ohc[Order];
 	}
 
+	template struct LowPassFilter<2>;
+	template struct LowPassFilter<7>;
+
 
 	PostOhcFilter::PostOhcFilter(const double cohc, const double bm_tau_min, const double bm_tau_max, const double asym)
 		: cohc(cohc),
@@ -344,7 +351,10 @@ namespace ihc
 		r0{-(pow(10, log10(cf_in) * 0.7 + 1.6) + 500)},
 		fs_bi_linear{cf / tan(cf * time_resolution / 2)},
 		gain_denominator{pow(sqrt(cf * cf + r0 * r0), 5)},
-		c1(c1)
+		c1(c1),
+		coefficients_r_sigma(0.0),
+		has_coefficients(false),
+		coefficients{}
 
 	{
 		fill_phase_array(0.0);
@@ -386,13 +396,33 @@ namespace ihc
 		phase_array[10] = phase_array[6];
 	}
 
-	double ChirpFilter::operator()(const double me_out, const double r_sigma)
+	ChirpCoefficients ChirpCoefficients::interpolate(const ChirpCoefficients& a, const ChirpCoefficients& b, const double t)
+	{
+		const auto lerp = [t](const double x, const double y) { return x + (y - x) * t; };
+
+		ChirpCoefficients c;
+		c.norm_gain = lerp(a.norm_gain, b.norm_gain);
+		c.zero_minus = lerp(a.zero_minus, b.zero_minus);
+		c.zero_twice = lerp(a.zero_twice, b.zero_twice);
+		c.zero_plus = lerp(a.zero_plus, b.zero_plus);
+		for (size_t i = 0; i < c.pole_denominator.size(); i++)
+		{
+			c.pole_output_1[i] = lerp(a.pole_output_1[i], b.pole_output_1[i]);
+			c.pole_output_2[i] = lerp(a.pole_output_2[i], b.pole_output_2[i]);
+			c.pole_denominator[i] = lerp(a.pole_denominator[i], b.pole_denominator[i]);
+		}
+		return c;
+	}
+
+	const ChirpCoefficients& ChirpFilter::coefficients_for(const double r_sigma)
 	{
 		constexpr int order_of_zero = 5;
 		constexpr size_t half_order_pole = 5;
 
+		if (has_coefficients && r_sigma == coefficients_r_sigma)
+			return coefficients;
 
-		const double norm_gain = sqrt(gain_norm) / gain_denominator;
+		coefficients.norm_gain = sqrt(gain_norm) / gain_denominator;
 
 		fill_phase_array(r_sigma, !c1);
 
@@ -408,6 +438,32 @@ namespace ihc
 		if (r0 > 0.0)
 			printf("The zeros are in the right-half plane.\n");
 
+		coefficients.zero_minus = fs_bi_linear - r0;
+		coefficients.zero_twice = 2 * r0;
+		coefficients.zero_plus = fs_bi_linear + r0;
+
+		for (size_t i = 1; i <= half_order_pole; i++)
+		{
+			const auto& p = phase_array[i * 2 - 1];
+			coefficients.pole_denominator[i] = pow((fs_bi_linear - p.real()), 2) + pow(p.imag(), 2);
+			coefficients.pole_output_1[i] = fs_bi_linear * fs_bi_linear - p.real() * p.real() - p.imag() * p.imag();
+			coefficients.pole_output_2[i] = (fs_bi_linear + p.real()) * (fs_bi_linear + p.real()) + p.imag() * p.imag();
+		}
+
+		coefficients_r_sigma = r_sigma;
+		has_coefficients = true;
+		return coefficients;
+	}
+
+	double ChirpFilter::operator()(const double me_out, const double r_sigma)
+	{
+		return filter(me_out, coefficients_for(r_sigma));
+	}
+
+	double ChirpFilter::filter(const double me_out, const ChirpCoefficients& c)
+	{
+		constexpr size_t half_order_pole = 5;
+
 		input[1][3] = input[1][2];
 		input[1][2] = input[1][1];
 		input[1][1] = me_out;
@@ -415,14 +471,10 @@ namespace ihc
 		double dy;
 		for (size_t i = 1; i <= half_order_pole; i++)
 		{
-			const auto& p = phase_array[i * 2 - 1];
-
-			const double temp = pow((fs_bi_linear - p.real()), 2) + pow(p.imag(), 2);
-			dy = input[i][1] * (fs_bi_linear - r0) - 2 * r0 * input[i][2] - (fs_bi_linear + r0) * input[i][3] + 2 *
-				output[i][1] * (fs_bi_linear * fs_bi_linear - p.real() * p.real() - p.imag() * p.imag()) - output[i]
-				[2] * ((fs_bi_linear + p.real()) * (fs_bi_linear + p.real()) + p.imag() * p.imag());
+			dy = input[i][1] * c.zero_minus - c.zero_twice * input[i][2] - c.zero_plus * input[i][3] + 2 *
+				output[i][1] * c.pole_output_1[i] - output[i][2] * c.pole_output_2[i];
 
-			dy = dy / temp;
+			dy = dy / c.pole_denominator[i];
 
 
 			input[i + 1][3] = output[i][2];
@@ -433,19 +485,336 @@ namespace ihc
 			output[i][1] = dy;
 		}
 
-		dy = output[half_order_pole][1] * norm_gain; /* don't forget the gain term */
+		dy = output[half_order_pole][1] * c.norm_gain; /* don't forget the gain term */
 		return dy / 4.0; /* signal path output is divided by 4 to give correct C1 filter gain */
 	}
 }
 
 
+namespace ihc
+{
+	Model::Model(const double time_resolution, const double cf, const double cohc, const double cihc, const Species species,
+	             const size_t control_decimation)
+		: me_filter_(time_resolution, species),
+		  wb_filter_(time_resolution, cf, species, cohc),
+		  boltzman_filter_{7.0},
+		  ohc_low_pass_filter_(time_resolution, 600.),
+		  non_linear_after_ohc_filter_{cohc, wb_filter_.bm_tau_min, wb_filter_.bm_tau_max, 7.0},
+		  c1_chirp_filter_{time_resolution, cf, wb_filter_.bm_tau_max, true},
+		  c2_chirp_filter_{time_resolution, cf, wb_filter_.bm_tau_max, false},
+		  ltf_1_{0.1, 3.0},
+		  ltf_2_{0.2, 1.0},
+		  ihc_low_pass_filter_(time_resolution, 3000),
+		  cf_(cf),
+		  cihc_(cihc),
+		  control_pinned_(cohc == 0.0),
+		  control_decimation_(control_decimation),
+		  tau_c1_from_(cohc * (wb_filter_.bm_tau_max - wb_filter_.bm_tau_min) + wb_filter_.bm_tau_min),
+		  tau_c1_to_(tau_c1_from_)
+	{
+		if (control_decimation_ < 1 || control_decimation_ > MAX_CONTROL_DECIMATION)
+			throw std::invalid_argument("control_decimation should be between 1 and " + std::to_string(MAX_CONTROL_DECIMATION));
+		if (control_decimation_ > 1 && cihc_ != 0.0)
+			c1_from_ = c1_to_ = c1_chirp_filter_.coefficients_for(1 / tau_c1_to_ - 1 / wb_filter_.bm_tau_max);
+	}
+
+	void Model::advance_control(const double tau_c1)
+	{
+		tau_c1_from_ = tau_c1_to_;
+		tau_c1_to_ = tau_c1;
+		if (cihc_ != 0.0)
+		{
+			c1_from_ = c1_to_;
+			c1_to_ = c1_chirp_filter_.coefficients_for(1 / tau_c1 - 1 / wb_filter_.bm_tau_max);
+		}
+	}
+
+	double Model::operator()(const double px)
+	{
+		const double me_out = me_filter_(px);
+
+		// The output of the control path is cohc * (tau - bm_tau_min) + bm_tau_min, i.e. exactly bm_tau_min when
+		// cohc is 0, and it only feeds back into the control path itself
+		double tau_c1 = wb_filter_.bm_tau_min;
+		const bool decimated = !control_pinned_ && control_decimation_ > 1;
+		// Position with respect to the previous (0) and the last (1) control point
+		double t = 1.0;
+		if (!control_pinned_)
+		{
+			const double wb_out = wb_filter_(me_out);
+			const double ohc_nonlinear_out = boltzman_filter_(wb_out);
+			const double ohc_out = ohc_low_pass_filter_(ohc_nonlinear_out);
+			if (!decimated)
+				tau_c1 = non_linear_after_ohc_filter_(ohc_out);
+			else
+			{
+				const size_t k = n_ % control_decimation_;
+				if (k == 0)
+					advance_control(non_linear_after_ohc_filter_(ohc_out));
+
+				// Linear extrapolation from the last two control points, up to the bounds of tau_c1
+				t = 1.0 + static_cast<double>(k) / static_cast<double>(control_decimation_);
+				tau_c1 = tau_c1_from_ + (tau_c1_to_ - tau_c1_from_) * t;
+				const double bounded = std::min(std::max(tau_c1, wb_filter_.bm_tau_min), wb_filter_.bm_tau_max);
+				if (bounded != tau_c1)
+				{
+					t = (bounded - tau_c1_from_) / (tau_c1_to_ - tau_c1_from_);
+					tau_c1 = bounded;
+				}
+			}
+
+			wb_filter_.shift_poles(tau_c1, n_);
+		}
+		n_++;
+
+		// Without IHC function (cihc = 0), the input of the C1 transduction function is 0, of which the output is 0
+		double c1_ihc = 0.0;
+		if (cihc_ != 0.0)
+		{
+			double c1_filter_out;
+			if (!decimated)
+				c1_filter_out = c1_chirp_filter_(me_out, 1 / tau_c1 - 1 / wb_filter_.bm_tau_max);
+			else if (tau_c1_from_ == tau_c1_to_)
+				c1_filter_out = c1_chirp_filter_.filter(me_out, c1_to_);
+			else
+				c1_filter_out = c1_chirp_filter_.filter(me_out, ChirpCoefficients::interpolate(c1_from_, c1_to_, t));
+			c1_ihc = ltf_1_(cihc_ * c1_filter_out);
+		}
+
+		const double c2_filter_out = c2_chirp_filter_(me_out, 1 / wb_filter_.ratio_bm);
+
+		const double c2_ihc = -ltf_2_(c2_filter_out * fabs(c2_filter_out) * cf_ / 10 * cf_ / 2e3);
+
+		return ihc_low_pass_filter_(c1_ihc + c2_ihc);
+	}
+
+	void Model::run(const double* px, const size_t n, std::vector<double>& output)
+	{
+		output.reserve(output.size() + n);
+		for (size_t i = 0; i < n; i++)
+			output.push_back((*this)(px[i]));
+	}
+
+	int Model::delay_point(const double cf, const double time_resolution)
+	{
+		const double delay = delay_cat(cf); // human uses same delay function
+		return std::max(0, static_cast<int>(ceil(delay / time_resolution)));
+	}
+
+	namespace
+	{
+		// The model state is written field by field, as doubles and 64-bit counts in the byte order of the host
+
+		void put(std::ostream& os, const double x)
+		{
+			os.write(reinterpret_cast<const char*>(&x), sizeof(x));
+		}
+
+		void put_count(std::ostream& os, const size_t n)
+		{
+			const auto x = static_cast<uint64_t>(n);
+			os.write(reinterpret_cast<const char*>(&x), sizeof(x));
+		}
+
+		template <size_t N>
+		void put(std::ostream& os, const std::array<double, N>& x)
+		{
+			for (const double xi : x)
+				put(os, xi);
+		}
+
+		template <size_t N, size_t M>
+		void put(std::ostream& os, const std::array<std::array<double, M>, N>& x)
+		{
+			for (const auto& xi : x)
+				put(os, xi);
+		}
+
+		template <size_t N>
+		void put(std::ostream& os, const std::array<std::complex<double>, N>& x)
+		{
+			for (const auto& xi : x)
+			{
+				put(os, xi.real());
+				put(os, xi.imag());
+			}
+		}
+
+		void put(std::ostream& os, const ChirpCoefficients& c)
+		{
+			put(os, c.norm_gain);
+			put(os, c.zero_minus);
+			put(os, c.zero_twice);
+			put(os, c.zero_plus);
+			put(os, c.pole_output_1);
+			put(os, c.pole_output_2);
+			put(os, c.pole_denominator);
+		}
+
+		void get(std::istream& is, double& x)
+		{
+			if (!is.read(reinterpret_cast<char*>(&x), sizeof(x)))
+				throw std::runtime_error("truncated ihc model state");
+		}
+
+		size_t get_count(std::istream& is)
+		{
+			uint64_t x;
+			if (!is.read(reinterpret_cast<char*>(&x), sizeof(x)))
+				throw std::runtime_error("truncated ihc model state");
+			return static_cast<size_t>(x);
+		}
+
+		template <size_t N>
+		void get(std::istream& is, std::array<double, N>& x)
+		{
+			for (double& xi : x)
+				get(is, xi);
+		}
+
+		template <size_t N, size_t M>
+		void get(std::istream& is, std::array<std::array<double, M>, N>& x)
+		{
+			for (auto& xi : x)
+				get(is, xi);
+		}
+
+		template <size_t N>
+		void get(std::istream& is, std::array<std::complex<double>, N>& x)
+		{
+			for (auto& xi : x)
+			{
+				double re, im;
+				get(is, re);
+				get(is, im);
+				xi = {re, im};
+			}
+		}
+
+		void get(std::istream& is, ChirpCoefficients& c)
+		{
+			get(is, c.norm_gain);
+			get(is, c.zero_minus);
+			get(is, c.zero_twice);
+			get(is, c.zero_plus);
+			get(is, c.pole_output_1);
+			get(is, c.pole_output_2);
+			get(is, c.pole_denominator);
+		}
+
+		void put(std::ostream& os, const ChirpFilter& filter)
+		{
+			put(os, filter.input);
+			put(os, filter.output);
+		}
+
+		void get(std::istream& is, ChirpFilter& filter)
+		{
+			get(is, filter.input);
+			get(is, filter.output);
+			// The cached coefficients are recomputed from the control signal of the next sample
+			filter.has_coefficients = false;
+		}
+
+		template <int Order>
+		void put(std::ostream& os, const LowPassFilter<Order>& filter)
+		{
+			put(os, filter.ohc);
+			put(os, filter.ohc_last);
+		}
+
+		template <int Order>
+		void get(std::istream& is, LowPassFilter<Order>& filter)
+		{
+			get(is, filter.ohc);
+			get(is, filter.ohc_last);
+		}
+
+		void check(const bool matches)
+		{
+			if (!matches)
+				throw std::runtime_error("ihc model state does not match the parameters of the model");
+		}
+	}
+
+	void Model::write_state(std::ostream& os) const
+	{
+		put_count(os, STATE_VERSION);
+
+		put(os, me_filter_.mey1);
+		put(os, me_filter_.mey2);
+		put(os, me_filter_.mey3);
+		put(os, me_filter_.px_cache);
+		put_count(os, me_filter_.i);
+
+		put(os, wb_filter_.phase);
+		put(os, wb_filter_.gtf);
+		put(os, wb_filter_.gtf_last);
+		put(os, wb_filter_.tau_wb);
+		put(os, wb_filter_.wb_gain);
+		put(os, wb_filter_.previous_gain);
+		put_count(os, wb_filter_.gain_delay.size());
+		for (const double gain : wb_filter_.gain_delay)
+			put(os, gain);
+
+		put(os, ohc_low_pass_filter_);
+		put(os, c1_chirp_filter_);
+		put(os, c2_chirp_filter_);
+		put(os, ihc_low_pass_filter_);
+
+		put_count(os, control_decimation_);
+		put(os, tau_c1_from_);
+		put(os, tau_c1_to_);
+		put(os, c1_from_);
+		put(os, c1_to_);
+		put_count(os, n_);
+	}
+
+	void Model::read_state(std::istream& is)
+	{
+		if (get_count(is) != STATE_VERSION)
+			throw std::runtime_error("unsupported ihc model state version");
+
+		get(is, me_filter_.mey1);
+		get(is, me_filter_.mey2);
+		get(is, me_filter_.mey3);
+		get(is, me_filter_.px_cache);
+		me_filter_.i = get_count(is);
+
+		get(is, wb_filter_.phase);
+		get(is, wb_filter_.gtf);
+		get(is, wb_filter_.gtf_last);
+		get(is, wb_filter_.tau_wb);
+		get(is, wb_filter_.wb_gain);
+		get(is, wb_filter_.previous_gain);
+		check(get_count(is) == wb_filter_.gain_delay.size());
+		for (double& gain : wb_filter_.gain_delay)
+			get(is, gain);
+
+		get(is, ohc_low_pass_filter_);
+		get(is, c1_chirp_filter_);
+		get(is, c2_chirp_filter_);
+		get(is, ihc_low_pass_filter_);
+
+		check(get_count(is) == control_decimation_);
+		get(is, tau_c1_from_);
+		get(is, tau_c1_to_);
+		get(is, c1_from_);
+		get(is, c1_to_);
+		n_ = get_count(is);
+	}
+}
+
+
+BRUCE_TARGET_CLONES
 std::vector<double> inner_hair_cell(
 	const stimulus::Stimulus& stimulus,
 	const double cf,
 	const int n_rep,
 	const double cohc,
 	const double cihc,
-	const Species species)
+	const Species species,
+	const size_t control_decimation)
 {
 	if (species == CAT)
 		utils::validate_parameter(cf, 124.9, 40.1e3, "cf");
@@ -457,41 +826,32 @@ std::vector<double> inner_hair_cell(
 	                          std::numeric_limits<double>::infinity(), "stimulus.simulation_duration");
 	utils::validate_parameter(cohc, 0., 1., "cohc");
 	utils::validate_parameter(cihc, 0., 1., "cihc");
+	utils::validate_parameter(control_decimation, size_t{1}, ihc::MAX_CONTROL_DECIMATION, "control_decimation");
 
-	std::vector<double> output(stimulus.n_simulation_timesteps * n_rep);
+	return inner_hair_cell(stimulus, ihc::Model(stimulus.time_resolution, cf, cohc, cihc, species, control_decimation), {}, n_rep);
+}
 
-	ihc::MiddleEarFilter me_filter(stimulus.time_resolution, species);
-	ihc::WideBandGammaToneFilter wb_filter(stimulus.time_resolution, cf, species, cohc);
-	ihc::BoltzmanFilter boltzman_filter{7.0};
-	ihc::LowPassFilter<2> ohc_low_pass_filter(stimulus.time_resolution, 600.);
-	ihc::PostOhcFilter non_linear_after_ohc_filter{cohc, wb_filter.bm_tau_min, wb_filter.bm_tau_max, 7.0};
-	ihc::ChirpFilter c1_chirp_filter{ stimulus.time_resolution, cf, wb_filter.bm_tau_max, true};
-	ihc::ChirpFilter c2_chirp_filter{ stimulus.time_resolution, cf, wb_filter.bm_tau_max, false};
-	ihc::LogarithmicTransductionFunction ltf_1{0.1, 3.0};
-	ihc::LogarithmicTransductionFunction ltf_2{0.2, 1.0};
-	ihc::LowPassFilter<7> ihc_low_pass_filter(stimulus.time_resolution, 3000);
+BRUCE_TARGET_CLONES
+std::vector<double> inner_hair_cell(
+	const stimulus::Stimulus& stimulus,
+	ihc::Model model,
+	const std::vector<double>& prefix_output,
+	const int n_rep)
+{
+	const size_t n_prefix = prefix_output.size();
+	if (n_prefix > stimulus.n_simulation_timesteps)
+		throw std::invalid_argument("the prefix output should fit the stimulus");
 
-	const double delay = ihc::delay_cat(cf); // human uses same delay function
-	const int delay_point = std::max(0, static_cast<int>(ceil(delay / stimulus.time_resolution)));
+	std::vector<double> output(stimulus.n_simulation_timesteps * n_rep);
+	const int delay_point = ihc::Model::delay_point(model.cf(), stimulus.time_resolution);
 
 	for (size_t n = 0; n < stimulus.n_simulation_timesteps; n++)
 	{
-		const double px = n < stimulus.n_stimulation_timesteps ? stimulus.data[n] : 0.0;
-		const double me_out = me_filter(px);
-		const double wb_out = wb_filter(me_out);
-		const double ohc_nonlinear_out = boltzman_filter(wb_out);
-		const double ohc_out = ohc_low_pass_filter(ohc_nonlinear_out);
-		const double tau_c1 = non_linear_after_ohc_filter(ohc_out);
-
-		wb_filter.shift_poles(tau_c1, n);
-
-		const double c1_filter_out = c1_chirp_filter(me_out, 1 / tau_c1 - 1 / wb_filter.bm_tau_max);
-		const double c2_filter_out = c2_chirp_filter(me_out, 1 / wb_filter.ratio_bm);
-
-		const double c1_ihc = ltf_1(cihc * c1_filter_out);
-		const double c2_ihc = -ltf_2(c2_filter_out * fabs(c2_filter_out) * cf / 10 * cf / 2e3);
-
-		const double ihc_out = ihc_low_pass_filter(c1_ihc + c2_ihc);
+		double ihc_out;
+		if (n < n_prefix)
+			ihc_out = prefix_output[n];
+		else
+			ihc_out = model(n < stimulus.n_stimulation_timesteps ? stimulus.data[n] : 0.0);
 
 		if (n + delay_point < stimulus.n_simulation_timesteps)
 			for (int j = 0; j < n_rep; j++)
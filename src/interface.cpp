@@ -2,11 +2,51 @@
 #include <pybind11/functional.h>
 #include <pybind11/numpy.h>
 #include <pybind11/stl.h>
+#include <sstream>
 
 #include "bruce.h"
 
 namespace py = pybind11;
 
+//! Contiguous numpy input, other dtypes/layouts are converted by numpy (only when required)
+template <typename T>
+using input_array = py::array_t<T, py::array::c_style | py::array::forcecast>;
+
+template <typename T>
+utils::Span<T> as_span(const input_array<T> &x)
+{
+    return utils::Span<T>(x.data(), static_cast<size_t>(x.size()));
+}
+
+//! Move a vector into a numpy array, which takes ownership of the data
+py::array_t<double> as_array(std::vector<double> &&x)
+{
+    auto *owner = new std::vector<double>(std::move(x));
+    const py::capsule base(owner, [](void *p)
+                           { delete static_cast<std::vector<double> *>(p); });
+    return py::array_t<double>(owner->size(), owner->data(), base);
+}
+
+//! Read-only numpy view of data owned by base, which is kept alive by the view
+template <typename T>
+py::array_t<T> readonly_view(const std::vector<py::ssize_t> &shape, const T *data, const py::handle &base)
+{
+    py::array_t<T> view(shape, data, base);
+    view.attr("flags").attr("writeable") = false;
+    return view;
+}
+
+//! Property getter returning a read-only numpy view of a vector member, the view keeps the owning object alive
+template <typename C, typename T>
+auto vector_view(std::vector<T> C::*field)
+{
+    return [field](const py::object &self)
+    {
+        const auto &x = self.cast<const C &>().*field;
+        return readonly_view<T>({static_cast<py::ssize_t>(x.size())}, x.data(), self);
+    };
+}
+
 void define_types(py::module &m)
 {
     py::enum_<Species>(m, "Species", py::arithmetic())
@@ -39,10 +79,13 @@ void define_stimulus(py::module m)
 {
     using namespace stimulus;
     py::class_<Stimulus>(m, "Stimulus")
-        .def(py::init<const std::vector<double> &, size_t, double>(), py::arg("data"), py::arg("sampling_rate"), py::arg("simulation_duration"))
-        .def_property_readonly("data", [](const Stimulus& self) {
-            return py::array(self.data.size(), self.data.data());
-        })
+        .def(py::init([](const input_array<double> &data, const size_t sampling_rate, const double simulation_duration)
+                      { return Stimulus(as_span(data), sampling_rate, simulation_duration); }),
+             py::arg("data"), py::arg("sampling_rate"), py::arg("simulation_duration"))
+        .def(py::init([](const input_array<float> &data, const size_t sampling_rate, const double simulation_duration)
+                      { return Stimulus(as_span(data), sampling_rate, simulation_duration); }),
+             py::arg("data"), py::arg("sampling_rate"), py::arg("simulation_duration"))
+        .def_property_readonly("data", vector_view(&Stimulus::data))
         .def_readonly("sampling_rate", &Stimulus::sampling_rate)
         .def_readonly("time_resolution", &Stimulus::time_resolution)
         .def_readonly("stimulus_duration", &Stimulus::stimulus_duration)
@@ -64,30 +107,247 @@ void define_stimulus(py::module m)
     m.def("normalize_db", &normalize_db, py::arg("stim"), py::arg("stim_db") = 65);
 }
 
-py::array_t<double> create_2d_numpy_array(const std::vector<std::vector<double>> &vec)
+//! Numpy view of a (shared) buffer, the view shares ownership of the buffer
+template <typename T>
+py::array_t<T> buffer_view(const std::shared_ptr<T> &buffer, const std::vector<py::ssize_t> &shape, const std::vector<py::ssize_t> &strides)
+{
+    auto *owner = new std::shared_ptr<T>(buffer);
+    const py::capsule base(owner, [](void *p)
+                           { delete static_cast<std::shared_ptr<T> *>(p); });
+    return py::array_t<T>(shape, strides, buffer.get(), base);
+}
+
+//! Zero-copy (n_cf, n_bins) view of the output of a neurogram
+py::array_t<double> neurogram_output(const Neurogram &ng)
 {
-    // Get the dimensions of the input vector
-    size_t rows = vec.size();
-    size_t cols = vec.empty() ? 0 : vec[0].size();
+    const auto buffer = ng.get_output_buffer();
+    if (!buffer)
+        return py::array_t<double>(std::vector<py::ssize_t>{0, 0});
 
-    // Allocate a new numpy array
-    py::array_t<double> result({rows, cols});
+    return buffer_view<double>(
+        buffer,
+        {static_cast<py::ssize_t>(ng.get_cfs().size()), static_cast<py::ssize_t>(ng.n_bins())},
+        {static_cast<py::ssize_t>(ng.row_stride() * sizeof(double)), static_cast<py::ssize_t>(sizeof(double))});
+}
 
-    // Get a pointer to the data in the numpy array
-    double *result_ptr = static_cast<double *>(result.request().ptr);
+//! Handle to a (n_rows, n_cols) float64 array in shared memory, which is pickled (i.e. to another process) by name
+struct SharedArray
+{
+    std::shared_ptr<shared_memory::Segment> segment;
+    size_t n_rows;
+    size_t n_cols;
+    size_t row_stride;
 
-    // Copy the data from the vector to the numpy array
-    for (size_t i = 0; i < rows; ++i)
+    SharedArray(std::shared_ptr<shared_memory::Segment> segment, const size_t n_rows, const size_t n_cols, const size_t row_stride)
+        : segment(std::move(segment)), n_rows(n_rows), n_cols(n_cols), row_stride(row_stride)
     {
-        for (size_t j = 0; j < cols; ++j)
+        if (row_stride < n_cols || (n_rows > 0 && ((n_rows - 1) * row_stride + n_cols) * sizeof(double) > this->segment->size()))
+            throw std::invalid_argument("shared array does not fit in segment " + this->segment->name());
+    }
+
+    //! Zero-copy view of the array, which keeps the segment mapped
+    [[nodiscard]] py::array_t<double> array() const
+    {
+        const std::shared_ptr<double> data(segment, static_cast<double *>(segment->data()));
+        return buffer_view<double>(
+            data,
+            {static_cast<py::ssize_t>(n_rows), static_cast<py::ssize_t>(n_cols)},
+            {static_cast<py::ssize_t>(row_stride * sizeof(double)), static_cast<py::ssize_t>(sizeof(double))});
+    }
+};
+
+//! Per-stage timers of a profiler::Report in seconds, as {"stages": {stage: stats}, "per_cf": [{stage: stats}], "other": {stage: stats}}.
+//! When hardware counters were read, stats includes them as "counters": {event: count} and "ipc", and when allocations
+//! were counted as "allocations": {"count", "bytes", "peak_live"}, which are also given for the whole run.
+py::dict profile_report(const profiler::Report &report)
+{
+    const auto allocations_dict = [](const memory::Allocations &allocations)
+    {
+        return py::dict(
+            py::arg("count") = allocations.count,
+            py::arg("bytes") = allocations.bytes,
+            py::arg("peak_live") = allocations.peak_live);
+    };
+
+    const auto stats_dict = [&](const profiler::Stats &stats)
+    {
+        py::dict result;
+        for (size_t s = 0; s < profiler::N_STAGES; s++)
         {
-            result_ptr[i * cols + j] = vec[i][j];
+            const auto &stat = stats[s];
+            if (stat.count == 0)
+                continue;
+            const double total = static_cast<double>(stat.total) * report.seconds_per_tick;
+            py::dict entry(
+                py::arg("total") = total,
+                py::arg("mean") = total / static_cast<double>(stat.count),
+                py::arg("max") = static_cast<double>(stat.max) * report.seconds_per_tick,
+                py::arg("count") = stat.count);
+            if (!stat.counters.empty())
+            {
+                py::dict counters;
+                for (size_t e = 0; e < perf::N_EVENTS; e++)
+                    if (stat.counters.has(static_cast<perf::Event>(e)))
+                        counters[perf::event_name(static_cast<perf::Event>(e))] = stat.counters.values[e];
+                entry["counters"] = counters;
+                if (stat.counters.has(perf::CYCLES) && stat.counters.has(perf::INSTRUCTIONS))
+                    entry["ipc"] = stat.counters.ipc();
+            }
+            if (stat.allocations.count)
+                entry["allocations"] = allocations_dict(stat.allocations);
+            result[profiler::stage_name(static_cast<profiler::Stage>(s))] = entry;
         }
-    }
+        return result;
+    };
 
+    py::list per_cf;
+    for (const auto &stats : report.per_cf)
+        per_cf.append(stats_dict(stats));
+
+    py::dict result;
+    result["stages"] = stats_dict(report.total);
+    result["per_cf"] = per_cf;
+    result["other"] = stats_dict(report.other);
+    if (report.peak_rss > 0)
+    {
+        result["allocations"] = allocations_dict(report.allocations);
+        result["peak_rss"] = report.peak_rss;
+    }
     return result;
 }
 
+//! Output storage for Neurogram::create, a caller provided (n_cf, n_bins) float64 array with contiguous rows, or a new buffer
+std::pair<std::shared_ptr<double>, size_t> neurogram_storage(
+    const Neurogram &self,
+    const stimulus::Stimulus &sound_wave,
+    const std::optional<py::array> &out)
+{
+    const size_t n_cf = self.get_cfs().size();
+    const size_t n_bins = self.get_n_bins(sound_wave);
+    size_t row_stride = n_bins;
+
+    if (!out.has_value())
+    {
+        auto buffer = Neurogram::allocate_output(n_cf, n_bins, row_stride, self.use_shared_memory);
+        return {std::move(buffer), row_stride};
+    }
+
+    const auto &array = out.value();
+    if (!py::isinstance<py::array_t<double>>(array) || array.ndim() != 2 ||
+        static_cast<size_t>(array.shape(0)) != n_cf || static_cast<size_t>(array.shape(1)) != n_bins ||
+        array.strides(1) != sizeof(double) || array.strides(0) % sizeof(double) != 0 ||
+        (n_cf > 1 && array.strides(0) < static_cast<py::ssize_t>(n_bins * sizeof(double))))
+        throw std::invalid_argument(
+            "out should be a float64 array of shape (" + std::to_string(n_cf) + ", " + std::to_string(n_bins) + ") with contiguous rows");
+
+    auto *data = static_cast<double *>(array.mutable_data());
+    if (n_cf > 1)
+        row_stride = static_cast<size_t>(array.strides(0)) / sizeof(double);
+
+    // The neurogram keeps a reference to the array for as long as it uses it as output
+    std::shared_ptr<double> output(data, [owner = array.inc_ref().ptr()](double *)
+                                   {
+        py::gil_scoped_acquire gil;
+        py::handle(owner).dec_ref(); });
+    return {std::move(output), row_stride};
+}
+
+void create_neurogram(
+    Neurogram &self,
+    const stimulus::Stimulus &sound_wave,
+    const int n_rep,
+    const int n_trials,
+    const Species species,
+    const NoiseType noise_type,
+    const PowerLaw power_law,
+    const std::optional<py::array> &out)
+{
+    auto [output, row_stride] = neurogram_storage(self, sound_wave, out);
+
+    py::gil_scoped_release release;
+    self.create(sound_wave, n_rep, n_trials, species, noise_type, power_law, std::move(output), row_stride);
+}
+
+//! Runs Neurogram::create on a background thread, and yields (cf_index, row) as soon as the row of a CF is complete
+class NeurogramIterator
+{
+    py::object owner_;
+    py::object sound_wave_;
+    Neurogram &ng_;
+    utils::CompletionQueue queue_;
+    std::atomic<bool> done_{false};
+    std::exception_ptr error_;
+    std::thread worker_;
+    size_t n_yielded_ = 0;
+
+public:
+    NeurogramIterator(
+        py::object owner,
+        py::object sound_wave,
+        const int n_rep,
+        const int n_trials,
+        const Species species,
+        const NoiseType noise_type,
+        const PowerLaw power_law,
+        std::shared_ptr<double> output,
+        const size_t row_stride) : owner_(std::move(owner)),
+                                   sound_wave_(std::move(sound_wave)),
+                                   ng_(owner_.cast<Neurogram &>()),
+                                   queue_(std::max<size_t>(1, ng_.get_cfs().size()))
+    {
+        ng_.on_cf_completed = [this](const size_t cf_i)
+        { queue_.push(cf_i); };
+
+        worker_ = std::thread([this, &sound_wave = sound_wave_.cast<const stimulus::Stimulus &>(), n_rep, n_trials, species, noise_type, power_law, output = std::move(output), row_stride]() mutable
+                              {
+            try
+            {
+                ng_.create(sound_wave, n_rep, n_trials, species, noise_type, power_law, std::move(output), row_stride);
+            }
+            catch (...)
+            {
+                error_ = std::current_exception();
+            }
+            ng_.on_cf_completed = nullptr;
+            done_.store(true, std::memory_order_release); });
+    }
+
+    ~NeurogramIterator()
+    {
+        py::gil_scoped_release release;
+        if (worker_.joinable())
+            worker_.join();
+    }
+
+    py::tuple next()
+    {
+        size_t cf_i = 0;
+        bool popped = false;
+        if (n_yielded_ < ng_.get_cfs().size())
+        {
+            py::gil_scoped_release release;
+            popped = queue_.pop(cf_i, done_);
+        }
+
+        if (!popped)
+        {
+            {
+                py::gil_scoped_release release;
+                if (worker_.joinable())
+                    worker_.join();
+            }
+            if (error_)
+                std::rethrow_exception(std::exchange(error_, nullptr));
+            throw py::stop_iteration();
+        }
+
+        n_yielded_++;
+        const auto buffer = ng_.get_output_buffer();
+        const std::shared_ptr<double> row(buffer, buffer.get() + cf_i * ng_.row_stride());
+        return py::make_tuple(cf_i, buffer_view<double>(row, {static_cast<py::ssize_t>(ng_.n_bins())}, {static_cast<py::ssize_t>(sizeof(double))}));
+    }
+};
+
 void define_helper_objects(py::module m)
 {
     py::class_<syn::SynapseOutput>(m, "SynapseOutput")
@@ -95,13 +355,26 @@ void define_helper_objects(py::module m)
         .def_readonly("n_rep", &syn::SynapseOutput::n_rep)
         .def_readonly("n_timesteps", &syn::SynapseOutput::n_timesteps)
         .def_readonly("n_total_timesteps", &syn::SynapseOutput::n_total_timesteps)
-        .def_readonly("psth", &syn::SynapseOutput::psth)
-        .def_readonly("synaptic_output", &syn::SynapseOutput::synaptic_output)
-        .def_readonly("redocking_time", &syn::SynapseOutput::redocking_time)
-        .def_readonly("spike_times", &syn::SynapseOutput::spike_times)
-        .def_readonly("mean_firing_rate", &syn::SynapseOutput::mean_firing_rate)
-        .def_readonly("variance_firing_rate", &syn::SynapseOutput::variance_firing_rate)
-        .def_readonly("mean_relative_refractory_period", &syn::SynapseOutput::mean_relative_refractory_period);
+        .def_property_readonly("psth", vector_view(&syn::SynapseOutput::psth))
+        .def_property_readonly("synaptic_output", vector_view(&syn::SynapseOutput::synaptic_output))
+        .def_property_readonly("redocking_time", vector_view(&syn::SynapseOutput::redocking_time))
+        .def_property_readonly("spike_times", vector_view(&syn::SynapseOutput::spike_times))
+        .def_property_readonly("mean_firing_rate", vector_view(&syn::SynapseOutput::mean_firing_rate))
+        .def_property_readonly("variance_firing_rate", vector_view(&syn::SynapseOutput::variance_firing_rate))
+        .def_property_readonly("mean_relative_refractory_period", vector_view(&syn::SynapseOutput::mean_relative_refractory_period));
+
+    py::class_<syn::SynapseBatchOutput>(m, "SynapseBatchOutput")
+        .def_readonly("n_fibers", &syn::SynapseBatchOutput::n_fibers)
+        .def_readonly("n_trials", &syn::SynapseBatchOutput::n_trials)
+        .def_readonly("n_bins", &syn::SynapseBatchOutput::n_bins)
+        .def_property_readonly("psth", [](const py::object &self)
+                               {
+            const auto &res = self.cast<const syn::SynapseBatchOutput &>();
+            if (res.psth.empty())
+                return readonly_view<double>({0, 0, 0}, nullptr, self);
+            return readonly_view<double>({static_cast<py::ssize_t>(res.n_fibers), static_cast<py::ssize_t>(res.n_trials), static_cast<py::ssize_t>(res.n_bins)}, res.psth.data(), self); })
+        .def_property_readonly("spike_offsets", vector_view(&syn::SynapseBatchOutput::spike_offsets))
+        .def_property_readonly("spike_times", vector_view(&syn::SynapseBatchOutput::spike_times));
 
     py::enum_<FiberType>(m, "FiberType", py::arithmetic())
         .value("LOW", LOW)
@@ -116,6 +389,66 @@ void define_helper_objects(py::module m)
         .def_readwrite("trel", &Fiber::trel)
         .def_readwrite("type", &Fiber::type);
 
+    m.def("_open_shared_array", [](const std::string &name, const size_t n_rows, const size_t n_cols, const size_t row_stride)
+          { return SharedArray(shared_memory::Segment::open(name, true), n_rows, n_cols, row_stride); });
+
+    py::class_<SharedArray>(m, "SharedArray")
+        .def_property_readonly("name", [](const SharedArray &self)
+                               { return self.segment->name(); })
+        .def_property_readonly("shape", [](const SharedArray &self)
+                               { return py::make_tuple(self.n_rows, self.n_cols); })
+        .def_property_readonly("ref_count", [](const SharedArray &self)
+                               { return self.segment->ref_count(); })
+        .def("array", &SharedArray::array)
+        .def("__array__", [](const SharedArray &self, const py::args &, const py::kwargs &)
+             { return self.array(); })
+        .def("__reduce__", [open_array = py::object(m.attr("_open_shared_array"))](const SharedArray &self)
+             {
+                // The pickled handle holds a reference of its own, which is taken over when it is unpickled
+                self.segment->retain();
+                return py::make_tuple(open_array, py::make_tuple(self.segment->name(), self.n_rows, self.n_cols, self.row_stride)); },
+             "Pickle the handle by name, which takes constant time. Every pickled handle must be unpickled exactly once,\n"
+             "as it keeps the segment alive until then.");
+
+    py::class_<NeurogramIterator>(m, "NeurogramIterator")
+        .def("__iter__", [](const py::object &self)
+             { return self; })
+        .def("__next__", &NeurogramIterator::next);
+
+    py::class_<tuning::Schedule>(m, "Schedule")
+        .def(py::init([](const size_t n_threads, const size_t cf_block, const size_t trials_per_task)
+                      { return tuning::Schedule{n_threads, cf_block, trials_per_task}; }),
+             py::arg("n_threads") = 0, py::arg("cf_block") = 0, py::arg("trials_per_task") = 0)
+        .def_readwrite("n_threads", &tuning::Schedule::n_threads)
+        .def_readwrite("cf_block", &tuning::Schedule::cf_block)
+        .def_readwrite("trials_per_task", &tuning::Schedule::trials_per_task)
+        .def("__eq__", &tuning::Schedule::operator==)
+        .def("__repr__", [](const tuning::Schedule &self)
+             { return "Schedule(n_threads=" + std::to_string(self.n_threads) + ", cf_block=" + std::to_string(self.cf_block) +
+                      ", trials_per_task=" + std::to_string(self.trials_per_task) + ")"; });
+
+    py::class_<PrefixState, std::shared_ptr<PrefixState>>(m, "PrefixState",
+                                                         "State of the IHC models of a neurogram after a stimulus prefix, see Neurogram.simulate_prefix")
+        .def_property_readonly("n_samples", [](const PrefixState &self)
+                               { return self.data.size(); })
+        .def_readonly("species", &PrefixState::species)
+        .def_readonly("control_decimation", &PrefixState::control_decimation);
+
+    py::class_<state_index::Index, std::shared_ptr<state_index::Index>>(m, "StateIndex",
+                                                                      "Snapshots of the IHC model state over a recording, see Neurogram.build_index")
+        .def_static("load", [](const std::string &path)
+                    { return std::make_shared<state_index::Index>(state_index::Index::load(path)); },
+                    py::arg("path"))
+        .def("save", &state_index::Index::save, py::arg("path"))
+        .def_property_readonly("interval", [](const state_index::Index &self)
+                               { return static_cast<double>(self.interval) * self.time_resolution; })
+        .def_property_readonly("n_snapshots", [](const state_index::Index &self)
+                               { return self.snapshots.size(); })
+        .def_readonly("n_samples", &state_index::Index::n_samples)
+        .def_readonly("species", &state_index::Index::species)
+        .def_readonly("control_decimation", &state_index::Index::control_decimation)
+        .def_readonly("seed", &state_index::Index::seed);
+
     py::class_<Neurogram>(m, "Neurogram")
         .def(py::init<size_t, size_t, size_t, size_t>(),
              py::arg("n_cf") = 40,
@@ -127,42 +460,148 @@ void define_helper_objects(py::module m)
              py::arg("n_low") = 10,
              py::arg("n_med") = 10,
              py::arg("n_high") = 30)
-        .def("create", &Neurogram::create,
+        .def("create", &create_neurogram,
              py::arg("sound_wave"),
              py::arg("n_rep") = 1,
              py::arg("n_trials") = 1,
              py::arg("species") = HUMAN_SHERA,
              py::arg("noise_type") = RANDOM,
-             py::arg("power_law") = APPROXIMATED
+             py::arg("power_law") = APPROXIMATED,
+             py::arg("out") = py::none()
         )
+        .def("iter_create", [](const py::object &self, const py::object &sound_wave, const int n_rep, const int n_trials, const Species species, const NoiseType noise_type, const PowerLaw power_law, const std::optional<py::array> &out)
+             {
+                auto [output, row_stride] = neurogram_storage(self.cast<const Neurogram &>(), sound_wave.cast<const stimulus::Stimulus &>(), out);
+                return std::make_unique<NeurogramIterator>(self, sound_wave, n_rep, n_trials, species, noise_type, power_law, std::move(output), row_stride); },
+             py::arg("sound_wave"),
+             py::arg("n_rep") = 1,
+             py::arg("n_trials") = 1,
+             py::arg("species") = HUMAN_SHERA,
+             py::arg("noise_type") = RANDOM,
+             py::arg("power_law") = APPROXIMATED,
+             py::arg("out") = py::none(),
+             "Create the neurogram on a background thread, returns an iterator yielding (cf_index, row) for each CF as soon as\n"
+             "its row is complete. The GIL is not held while waiting for the next row.")
+        .def("get_n_bins", &Neurogram::get_n_bins, py::arg("sound_wave"))
         .def("get_fibers", &Neurogram::get_fibers, py::arg("cf_idx"))
-        .def("get_output", [](const Neurogram &self)
-             { return create_2d_numpy_array(self.get_output()); })
+        .def("get_output", &neurogram_output)
+        .def("__array__", [](const Neurogram &self, const py::args &, const py::kwargs &)
+             { return neurogram_output(self); })
         .def("get_cfs", [](const Neurogram &self){
             const auto x = self.get_cfs();
             return py::array(x.size(), x.data());
         })
-        .def_readwrite("bin_width", &Neurogram::bin_width);
+        .def("share_output", [](const Neurogram &self)
+             {
+                auto segment = self.get_output_segment();
+                if (!segment)
+                    throw std::runtime_error("the output is not in shared memory, set use_shared_memory before create");
+                return SharedArray(std::move(segment), self.get_cfs().size(), self.n_bins(), self.row_stride()); },
+             "Handle to the output in shared memory, which can be sent to another process and opened there as a numpy view")
+        .def("profile", [](const Neurogram &self)
+             { return profile_report(self.profile()); },
+             "Per-stage timers (in seconds) of the last call to create, empty unless profiling is enabled (see set_profiling)")
+        .def_readwrite("bin_width", &Neurogram::bin_width)
+        .def_readwrite("use_shared_memory", &Neurogram::use_shared_memory)
+        .def_readwrite("trace_file", &Neurogram::trace_file,
+                       "Path to write the timeline of create to as Chrome trace JSON, when tracing is enabled (see set_tracing)")
+        .def_readwrite("schedule", &Neurogram::schedule,
+                       "Schedule of create, when None it is looked up in the tuning profile (see autotune)")
+        .def_readwrite("use_tuning_profile", &Neurogram::use_tuning_profile)
+        .def("last_schedule", &Neurogram::last_schedule, "The schedule used by the last call to create")
+        .def_property("accuracy_budget", [](const Neurogram &self) -> std::optional<double>
+                      {
+                        if (!self.budget)
+                            return std::nullopt;
+                        return self.budget->max_relative_error; }, [](Neurogram &self, const std::optional<double> &max_relative_error)
+                      {
+                        if (max_relative_error)
+                            self.budget = planner::Budget{*max_relative_error};
+                        else
+                            self.budget.reset(); },
+                      "Largest acceptable relative error of the expected PSTH of a CF. When set, create selects the cheapest\n"
+                      "approximation tiers that fit it, ignoring its power_law argument. None (the default) to use power_law.")
+        .def_readwrite("control_decimation", &Neurogram::control_decimation,
+                       "Samples per evaluation of the OHC control path of the IHC models, 1 (the default) for the full-rate\n"
+                       "model. Also applies when accuracy_budget is set.")
+        .def("plan", [](const Neurogram &self)
+             {
+                const auto &plan = self.plan();
+                py::list tiers;
+                for (unsigned t = 0; t < planner::N_TIERS; t++)
+                    if (plan.uses(static_cast<planner::Tier>(t)))
+                        tiers.append(planner::tier_name(static_cast<planner::Tier>(t)));
+                py::dict result;
+                result["tiers"] = tiers;
+                result["power_law"] = plan.power_law();
+                result["estimated_error"] = plan.estimated_error;
+                result["relative_cost"] = plan.relative_cost;
+                result["relative_memory"] = plan.relative_memory;
+                result["description"] = plan.describe();
+                return result; },
+             "The approximation tiers used by the last call to create, with their estimated error and relative cost")
+        .def("simulate_prefix", [](const Neurogram &self, const stimulus::Stimulus &prefix, const Species species)
+             {
+                py::gil_scoped_release release;
+                return self.simulate_prefix(prefix, species); },
+             py::arg("prefix"), py::arg("species") = HUMAN_SHERA,
+             "Simulate the IHC models of every CF over a stimulus prefix, and capture their state. Assign it to prefix, after\n"
+             "which create continues the IHC models from it for stimuli that start with the prefix. The synapse stage still\n"
+             "runs over the complete stimulus.")
+        .def("build_index", [](const Neurogram &self, const stimulus::Stimulus &sound_wave, const double interval, const Species species)
+             {
+                py::gil_scoped_release release;
+                return std::make_shared<state_index::Index>(self.build_index(sound_wave, species, interval)); },
+             py::arg("sound_wave"), py::arg("interval") = 10.0, py::arg("species") = HUMAN_SHERA,
+             "Simulate the IHC models over a (long) recording, and take a snapshot of their state every interval seconds")
+        .def("create_window", [](Neurogram &self, const stimulus::Stimulus &sound_wave, const state_index::Index &index, const double t0, const double t1,
+                                 const int n_rep, const int n_trials, const Species species, const NoiseType noise_type, const PowerLaw power_law, const double warmup)
+             {
+                py::gil_scoped_release release;
+                self.create_window(sound_wave, index, t0, t1, n_rep, n_trials, species, noise_type, power_law, warmup); },
+             py::arg("sound_wave"),
+             py::arg("index"),
+             py::arg("t0"),
+             py::arg("t1"),
+             py::arg("n_rep") = 1,
+             py::arg("n_trials") = 1,
+             py::arg("species") = HUMAN_SHERA,
+             py::arg("noise_type") = RANDOM,
+             py::arg("power_law") = APPROXIMATED,
+             py::arg("warmup") = 0.25,
+             "Create the neurogram of the window [t0, t1) of a recording, simulating only from the last snapshot in the index\n"
+             "at least warmup seconds before t0. The output starts at window_start(), at most a bin before t0. Only the IHC\n"
+             "output is exact (see window_ihc): the synapse stage restarts at the snapshot, so the spikes match those of a\n"
+             "full run only statistically.")
+        .def("window_ihc", [](const Neurogram &self, const stimulus::Stimulus &sound_wave, const state_index::Index &index, const size_t cf_index,
+                              const double t0, const double t1, const double warmup)
+             { return as_array(self.window_ihc(sound_wave, index, cf_index, t0, t1, warmup)); },
+             py::arg("sound_wave"),
+             py::arg("index"),
+             py::arg("cf_index"),
+             py::arg("t0"),
+             py::arg("t1"),
+             py::arg("warmup") = 0.25,
+             "The IHC output of a CF that create_window computes, from window_start() to t1, which equals that of\n"
+             "inner_hair_cell over the recording once the warm-up exceeds the delay of the model")
+        .def("window_start", &Neurogram::window_start, "Time in s of the first bin of the output")
+        .def_readwrite("prefix", &Neurogram::prefix,
+                       "State after a common stimulus prefix (see simulate_prefix) that create continues from, or None");
 }
 
-void define_model_functions(py::module m)
+template <typename T>
+void define_span_model_functions(py::module m)
 {
-    m.def("inner_hair_cell", &inner_hair_cell,
-          py::arg("stimulus"),
-          py::arg("cf") = 1e3,
-          py::arg("n_rep") = 1,
-          py::arg("cohc") = 1,
-          py::arg("cihc") = 1,
-          py::arg("species") = HUMAN_SHERA);
-
-    m.def("map_to_synapse", &synapse_mapping::map,
+    m.def("map_to_synapse", [](const input_array<T> &ihc_output, const double spontaneous_firing_rate, const double characteristic_frequency, const double time_resolution, const SynapseMapping mapping_function)
+          { return as_array(synapse_mapping::map(as_span(ihc_output), spontaneous_firing_rate, characteristic_frequency, time_resolution, mapping_function)); },
           py::arg("ihc_output"),
           py::arg("spontaneous_firing_rate"),
           py::arg("characteristic_frequency"),
           py::arg("time_resolution"),
           py::arg("mapping_function") = SOFTPLUS);
 
-    m.def("synapse", &synapse,
+    m.def("synapse", [](const input_array<T> &amplitude_ihc, const double cf, const int n_rep, const size_t n_timesteps, const double time_resolution, const NoiseType noise, const PowerLaw pla_impl, const double spontaneous_firing_rate, const double abs_refractory_period, const double rel_refractory_period, const bool calculate_stats)
+          { return std::make_unique<syn::SynapseOutput>(synapse(as_span(amplitude_ihc), cf, n_rep, n_timesteps, time_resolution, noise, pla_impl, spontaneous_firing_rate, abs_refractory_period, rel_refractory_period, calculate_stats)); },
           py::arg("amplitude_ihc"),
           py::arg("cf"),
           py::arg("n_rep"),
@@ -174,14 +613,217 @@ void define_model_functions(py::module m)
           py::arg("abs_refractory_period") = 0.7,
           py::arg("rel_refractory_period") = 0.6,
           py::arg("calculate_stats") = true);
+
+    m.def("synapse_batch", [](const input_array<T> &input, const double cf, const input_array<double> &spontaneous_firing_rates, const input_array<double> &abs_refractory_periods, const input_array<double> &rel_refractory_periods, const int n_trials, const int n_rep, const size_t n_timesteps, const double time_resolution, const NoiseType noise, const PowerLaw pla_impl, const std::optional<SynapseMapping> mapping_function, const size_t n_bins, const bool store_spikes)
+          {
+            py::gil_scoped_release release;
+            return std::make_unique<syn::SynapseBatchOutput>(synapse_batch(
+                as_span(input), cf, as_span(spontaneous_firing_rates), as_span(abs_refractory_periods), as_span(rel_refractory_periods),
+                n_trials, n_rep, n_timesteps, time_resolution, noise, pla_impl,
+                mapping_function.has_value(), mapping_function.value_or(SOFTPLUS), n_bins, store_spikes)); },
+          py::arg("input"),
+          py::arg("cf"),
+          py::arg("spontaneous_firing_rates"),
+          py::arg("abs_refractory_periods"),
+          py::arg("rel_refractory_periods"),
+          py::arg("n_trials") = 1,
+          py::arg("n_rep") = 1,
+          py::arg("n_timesteps") = 0,
+          py::arg("time_resolution") = 1 / 100e3,
+          py::arg("noise") = RANDOM,
+          py::arg("pla_impl") = APPROXIMATED,
+          py::arg("mapping_function") = py::none(),
+          py::arg("n_bins") = 0,
+          py::arg("store_spikes") = false,
+          "Evaluate the synapse model for a population of fibers at a single CF. If mapping_function is given, the input\n"
+          "is the output of inner_hair_cell, which is mapped once per unique spontaneous rate, otherwise it is the mapped input.");
+}
+
+void define_model_functions(py::module m)
+{
+    m.def("inner_hair_cell", [](const stimulus::Stimulus &stimulus, const double cf, const int n_rep, const double cohc, const double cihc, const Species species,
+                                const size_t control_decimation)
+          { return as_array(inner_hair_cell(stimulus, cf, n_rep, cohc, cihc, species, control_decimation)); },
+          py::arg("stimulus"),
+          py::arg("cf") = 1e3,
+          py::arg("n_rep") = 1,
+          py::arg("cohc") = 1,
+          py::arg("cihc") = 1,
+          py::arg("species") = HUMAN_SHERA,
+          py::arg("control_decimation") = 1);
+
+    // double is registered first, such that inputs which need conversion (lists, other dtypes) end up as double
+    define_span_model_functions<double>(m);
+    define_span_model_functions<float>(m);
+}
+
+//! Contiguous access to an object supporting the buffer protocol (i.e. bytes or pickle.PickleBuffer), the GIL must be held
+class ContiguousBuffer
+{
+    Py_buffer view_{};
+    bool valid_ = false;
+
+public:
+    ContiguousBuffer(const py::handle &obj, const bool writable)
+    {
+        valid_ = PyObject_GetBuffer(obj.ptr(), &view_, PyBUF_C_CONTIGUOUS | (writable ? PyBUF_WRITABLE : 0)) == 0;
+        if (!valid_ && !writable)
+            throw py::error_already_set();
+        if (!valid_)
+            PyErr_Clear();
+    }
+
+    ContiguousBuffer(const ContiguousBuffer &) = delete;
+    ContiguousBuffer &operator=(const ContiguousBuffer &) = delete;
+
+    ~ContiguousBuffer()
+    {
+        if (valid_)
+            PyBuffer_Release(&view_);
+    }
+
+    [[nodiscard]] bool valid() const { return valid_; }
+
+    [[nodiscard]] serialize::Buffer get() const
+    {
+        return {view_.buf, static_cast<size_t>(view_.len)};
+    }
+};
+
+//! The buffers passed to a restore function, which stay valid for the lifetime of this object
+struct RestoreBuffers
+{
+    std::vector<std::unique_ptr<ContiguousBuffer>> owners;
+    std::vector<serialize::Buffer> buffers;
+
+    explicit RestoreBuffers(const py::args &args)
+    {
+        for (const auto &arg : args)
+        {
+            buffers.push_back(owners.emplace_back(std::make_unique<ContiguousBuffer>(arg, false))->get());
+        }
+    }
+};
+
+/**
+ * __reduce_ex__ based on the native serialization. The buffers are exported as read-only views of the object's
+ * own storage, so with pickle protocol 5 they are passed (out-of-band, if the pickler has a buffer_callback)
+ * without copying. Older protocols fall back to bytes.
+ */
+template <typename C>
+void define_pickle(const py::object &restore)
+{
+    py::reinterpret_borrow<py::class_<C>>(py::type::of<C>())
+        .def("__reduce_ex__", [restore](const py::object &self, const int protocol)
+             {
+            const auto archive = serialize::archive(self.cast<const C &>());
+            py::list args;
+            args.append(py::bytes(archive.header));
+            for (const auto &buffer : archive.buffers)
+            {
+                if (protocol < 5)
+                {
+                    args.append(py::bytes(static_cast<const char *>(buffer.data), buffer.size));
+                    continue;
+                }
+                const auto view = readonly_view<uint8_t>({static_cast<py::ssize_t>(buffer.size)}, static_cast<const uint8_t *>(buffer.data), self);
+                args.append(py::module_::import("pickle").attr("PickleBuffer")(view));
+            }
+            return py::make_tuple(restore, py::tuple(args)); },
+             py::arg("protocol"));
+}
+
+void define_serialization(py::module m)
+{
+    m.def("_restore_stimulus", [](const py::bytes &header, const py::args &args)
+          { return serialize::restore_stimulus(header, RestoreBuffers(args).buffers); });
+
+    m.def("_restore_synapse_output", [](const py::bytes &header, const py::args &args)
+          { return std::make_unique<syn::SynapseOutput>(serialize::restore_synapse_output(header, RestoreBuffers(args).buffers)); });
+
+    m.def("_restore_neurogram", [](const py::bytes &header, const py::args &args)
+          {
+            const RestoreBuffers restore(args);
+
+            // A writable, aligned output buffer (i.e. a bytearray from in-band pickling) is adopted instead of copied
+            std::shared_ptr<double> output;
+            if (args.size() == 1)
+            {
+                auto *writable = new ContiguousBuffer(args[0], true);
+                const auto buffer = writable->get();
+                if (writable->valid() && reinterpret_cast<uintptr_t>(buffer.data) % Neurogram::ROW_ALIGNMENT == 0)
+                {
+                    output = std::shared_ptr<double>(static_cast<double *>(const_cast<void *>(buffer.data)), [writable](double *)
+                                                     {
+                        py::gil_scoped_acquire gil;
+                        delete writable; });
+                }
+                else
+                {
+                    delete writable;
+                }
+            }
+            return serialize::restore_neurogram(header, restore.buffers, std::move(output)); });
+
+    define_pickle<stimulus::Stimulus>(m.attr("_restore_stimulus"));
+    define_pickle<syn::SynapseOutput>(m.attr("_restore_synapse_output"));
+    define_pickle<Neurogram>(m.attr("_restore_neurogram"));
 }
 
 PYBIND11_MODULE(brucecpp, m)
 {
     m.doc() = "Python wrapper for Bruce hearing model";
     m.def("set_seed", &utils::set_seed);
+    m.def("set_n_threads", &utils::set_n_threads, py::arg("n_threads") = 0);
+    m.def("get_n_threads", []()
+          { return utils::N_THREADS; });
+    m.def("set_profiling", [](const bool enabled, const bool counters, const bool allocations)
+          {
+            profiler::set_enabled(enabled);
+            profiler::set_counters(counters);
+            memory::set_enabled(enabled && allocations); },
+          py::arg("enabled") = true, py::arg("counters") = false, py::arg("allocations") = false,
+          "Enable the per-stage timers reported by Neurogram.profile, which are compiled out unless built with BRUCE_PROFILE.\n"
+          "With counters, hardware performance counters (perf_event_open, Linux only) are read per stage as well, when available.\n"
+          "With allocations, heap allocations and the peak RSS are reported per stage and per run, when built with BRUCE_COUNT_ALLOCATIONS.");
+    m.def("allocation_counting_supported", &memory::supported);
+    m.def("set_tracing", [](const bool enabled, const size_t capacity)
+          {
+            trace::set_capacity(capacity);
+            profiler::set_tracing(enabled); },
+          py::arg("enabled") = true, py::arg("capacity") = size_t{1} << 15,
+          "Record every stage and task of Neurogram.create on a per-thread timeline, of at most capacity events per thread");
+    m.def("chrome_trace", []()
+          {
+            std::ostringstream ss;
+            trace::write_chrome_trace(ss, profiler::seconds_per_tick());
+            return ss.str(); },
+          "The timeline of the last traced Neurogram.create as Chrome trace JSON (chrome://tracing, ui.perfetto.dev)");
+    m.def("hardware_counters_supported", []()
+          { return perf::supported(); });
+    m.def("is_profiling", &profiler::enabled);
+    m.def("autotune", [](std::string path, const size_t repetitions, const bool verbose)
+          {
+            tuning::Options options;
+            options.repetitions = repetitions;
+            options.verbose = verbose;
+            py::gil_scoped_release release;
+            auto profile = std::make_shared<const tuning::Profile>(tuning::autotune(options));
+            if (path.empty())
+                path = tuning::default_path();
+            if (!path.empty())
+                profile->save(path);
+            tuning::set_active_profile(std::move(profile));
+            return path; },
+          py::arg("path") = "", py::arg("repetitions") = 3, py::arg("verbose") = false,
+          "Time short calibration workloads to find the fastest schedule of Neurogram.create per workload shape on this machine,\n"
+          "and use it from now on. The profile is saved to path (by default in the user's cache directory, or BRUCE_TUNING_PROFILE),\n"
+          "from which it is loaded automatically by later runs. Returns the path.");
+    m.def("instruction_set", &dispatch::isa,
+          "The instruction set of the kernels selected for this CPU, \"default\" unless built with BRUCE_DISPATCH");
     define_types(m);
     define_stimulus(m.def_submodule("stimulus"));
     define_helper_objects(m);
     define_model_functions(m);
+    define_serialization(m);
 }
\ No newline at end of file
@@ -138,14 +138,10 @@ void test_adaptive_redocking()
 void plot_neurogram(const stimulus::Stimulus &stim)
 {
 	Neurogram ng(40);
-	ng.create(stim, 1, HUMAN_SHERA, RANDOM, APPROXIMATED);
-	auto [plot_data, dt_fine_timing] = ng.get_fine_timing();
+	ng.create(stim, 1, 1, HUMAN_SHERA, RANDOM, APPROXIMATED);
+	auto plot_data = ng.get_output();
 	plot_data.push_back(ng.get_cfs());
-	utils::plot(plot_data, "colormesh", "fine_timing", "time", "frequency", std::to_string(dt_fine_timing));
-
-	auto [plot_data2, dt_mean_timing] = ng.get_mean_timing();
-	plot_data2.push_back(ng.get_cfs());
-	utils::plot(plot_data2, "colormesh", "mean_timing", "time", "frequency", std::to_string(dt_mean_timing));
+	utils::plot(plot_data, "colormesh", "neurogram", "time", "frequency", std::to_string(ng.bin_width));
 }
 
 void example_neurogram_sin()
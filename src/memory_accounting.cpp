@@ -0,0 +1,224 @@
+#include "memory_accounting.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#if defined(BRUCE_COUNT_ALLOCATIONS) && defined(__GLIBC__)
+#include <malloc.h>
+#define BRUCE_ALLOCATION_HOOKS
+#endif
+
+namespace memory
+{
+	std::atomic<bool> ENABLED{false};
+
+	namespace
+	{
+		std::atomic<uint64_t> total_count{0};
+		std::atomic<uint64_t> total_bytes{0};
+		std::atomic<int64_t> total_live{0};
+		std::atomic<int64_t> total_peak{0};
+	}
+
+	bool supported()
+	{
+#ifdef BRUCE_ALLOCATION_HOOKS
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	void set_enabled(const bool enabled)
+	{
+		ENABLED.store(enabled);
+	}
+
+	bool enabled()
+	{
+		return supported() && ENABLED.load();
+	}
+
+	void reset()
+	{
+		total_count = 0;
+		total_bytes = 0;
+		total_live = 0;
+		total_peak = 0;
+	}
+
+	Allocations totals()
+	{
+		return {total_count.load(), total_bytes.load(), total_peak.load()};
+	}
+
+	void on_allocate(const size_t size)
+	{
+		auto &counters = THREAD_COUNTERS;
+		counters.count++;
+		counters.bytes += size;
+		counters.live += static_cast<int64_t>(size);
+		counters.peak = counters.live > counters.peak ? counters.live : counters.peak;
+
+		total_count.fetch_add(1, std::memory_order_relaxed);
+		total_bytes.fetch_add(size, std::memory_order_relaxed);
+		const int64_t live = total_live.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed) + static_cast<int64_t>(size);
+		for (int64_t peak = total_peak.load(std::memory_order_relaxed);
+			 live > peak && !total_peak.compare_exchange_weak(peak, live, std::memory_order_relaxed);)
+			;
+	}
+
+	void on_deallocate(const size_t size)
+	{
+		THREAD_COUNTERS.live -= static_cast<int64_t>(size);
+		total_live.fetch_sub(static_cast<int64_t>(size), std::memory_order_relaxed);
+	}
+
+	namespace
+	{
+		//! Field of /proc/self/status in bytes, or -1 when not available
+		double proc_status(const std::string &field)
+		{
+#if defined(__linux__)
+			std::ifstream status("/proc/self/status");
+			for (std::string line; std::getline(status, line);)
+				if (line.rfind(field, 0) == 0)
+					return std::stod(line.substr(field.size())) * 1024.0;
+#endif
+			return -1.0;
+		}
+	}
+
+	double current_rss()
+	{
+		return std::max(0.0, proc_status("VmRSS:"));
+	}
+
+	double peak_rss()
+	{
+		// Prefer VmHWM, which (unlike ru_maxrss) is reset by reset_peak_rss
+		const double hwm = proc_status("VmHWM:");
+		if (hwm >= 0)
+			return hwm;
+#if defined(__unix__) || defined(__APPLE__)
+		rusage usage{};
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+			return 0.0;
+#if defined(__APPLE__)
+		return static_cast<double>(usage.ru_maxrss);
+#else
+		return static_cast<double>(usage.ru_maxrss) * 1024.0;
+#endif
+#else
+		return 0.0;
+#endif
+	}
+
+	void reset_peak_rss()
+	{
+#if defined(__linux__)
+		std::ofstream clear_refs("/proc/self/clear_refs");
+		clear_refs << "5";
+#endif
+	}
+}
+
+#ifdef BRUCE_ALLOCATION_HOOKS
+/*
+ * Replacements of the global allocation functions. Blocks are plain malloc blocks, of which the size is taken from
+ * malloc_usable_size, so memory allocated before (or by) the standard versions can safely be released here.
+ */
+namespace
+{
+	void *counted(void *p)
+	{
+		if (p && memory::ENABLED.load(std::memory_order_relaxed))
+			memory::on_allocate(malloc_usable_size(p));
+		return p;
+	}
+
+	void release(void *p) noexcept
+	{
+		if (p && memory::ENABLED.load(std::memory_order_relaxed))
+			memory::on_deallocate(malloc_usable_size(p));
+		std::free(p);
+	}
+
+	void *allocate(const size_t size)
+	{
+		for (;;)
+		{
+			if (void *p = std::malloc(size ? size : 1))
+				return counted(p);
+			const auto handler = std::get_new_handler();
+			if (!handler)
+				throw std::bad_alloc();
+			handler();
+		}
+	}
+
+	void *allocate(const size_t size, const std::align_val_t alignment)
+	{
+		const auto align = std::max(static_cast<size_t>(alignment), sizeof(void *));
+		for (;;)
+		{
+			// aligned_alloc requires the size to be a multiple of the alignment
+			if (void *p = std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align))
+				return counted(p);
+			const auto handler = std::get_new_handler();
+			if (!handler)
+				throw std::bad_alloc();
+			handler();
+		}
+	}
+}
+
+void *operator new(const size_t size) { return allocate(size); }
+void *operator new[](const size_t size) { return allocate(size); }
+void *operator new(const size_t size, const std::align_val_t alignment) { return allocate(size, alignment); }
+void *operator new[](const size_t size, const std::align_val_t alignment) { return allocate(size, alignment); }
+
+void *operator new(const size_t size, const std::nothrow_t &) noexcept
+{
+	try { return allocate(size); }
+	catch (...) { return nullptr; }
+}
+
+void *operator new[](const size_t size, const std::nothrow_t &) noexcept
+{
+	try { return allocate(size); }
+	catch (...) { return nullptr; }
+}
+
+void *operator new(const size_t size, const std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+	try { return allocate(size, alignment); }
+	catch (...) { return nullptr; }
+}
+
+void *operator new[](const size_t size, const std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+	try { return allocate(size, alignment); }
+	catch (...) { return nullptr; }
+}
+
+void operator delete(void *p) noexcept { release(p); }
+void operator delete[](void *p) noexcept { release(p); }
+void operator delete(void *p, size_t) noexcept { release(p); }
+void operator delete[](void *p, size_t) noexcept { release(p); }
+void operator delete(void *p, std::align_val_t) noexcept { release(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { release(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { release(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { release(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { release(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { release(p); }
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept { release(p); }
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept { release(p); }
+#endif
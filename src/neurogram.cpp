@@ -1,7 +1,7 @@
 #include "neurogram.h"
 
+#include <algorithm>
 #include <cassert>
-#include <thread>
 #include "synapse.h"
 #include "synapse_mapping.h"
 
@@ -27,6 +27,39 @@ Neurogram::Neurogram(
 {
 }
 
+Neurogram::Neurogram(
+	std::vector<double> cfs,
+	std::vector<double> db_loss,
+	std::vector<double> coh_cs,
+	std::vector<double> ihc_cs,
+	std::vector<double> ohc_loss,
+	std::array<std::vector<Fiber>, 3> an_population,
+	const double bin_width,
+	std::shared_ptr<double> output,
+	const size_t n_bins,
+	const size_t row_stride,
+	const double window_start) : cfs_(std::move(cfs)),
+							      db_loss_(std::move(db_loss)),
+							      coh_cs_(std::move(coh_cs)),
+							      ihc_cs_(std::move(ihc_cs)),
+							      ohc_loss_(std::move(ohc_loss)),
+							      an_population_(std::move(an_population)),
+							      output_(std::move(output)),
+							      n_bins_(n_bins),
+							      row_stride_(row_stride),
+							      window_start_(window_start),
+							      bin_width(bin_width)
+{
+	const size_t n_cf = cfs_.size();
+	if (db_loss_.size() != n_cf || coh_cs_.size() != n_cf || ihc_cs_.size() != n_cf || ohc_loss_.size() != n_cf)
+		throw std::invalid_argument("hearing loss parameters should have one value per cf");
+	for (const auto &fiber_set : an_population_)
+		if (n_cf == 0 ? !fiber_set.empty() : fiber_set.size() % n_cf != 0)
+			throw std::invalid_argument("an population should contain the same number of fibers for each cf");
+	if (output_ && row_stride_ < n_bins_)
+		throw std::invalid_argument("row_stride should be at least n_bins");
+}
+
 std::vector<Fiber> Neurogram::generate_fiber_set(
 	const size_t n_cf,
 	const size_t n_fibers,
@@ -79,6 +112,104 @@ std::vector<Fiber> Neurogram::get_fibers(const size_t cf_idx) const
 	return fibers;
 }
 
+std::shared_ptr<double> Neurogram::allocate_output(const size_t n_cf, const size_t n_bins, size_t &row_stride, const bool shared)
+{
+	constexpr size_t row_alignment = ROW_ALIGNMENT / sizeof(double);
+	row_stride = (n_bins + row_alignment - 1) / row_alignment * row_alignment;
+
+	const size_t n = std::max<size_t>(1, n_cf * row_stride);
+	if (shared)
+	{
+		// The segment is zero-filled on creation, and its data is aligned to DATA_OFFSET >= ROW_ALIGNMENT bytes
+		static_assert(shared_memory::Segment::DATA_OFFSET % ROW_ALIGNMENT == 0);
+		auto segment = shared_memory::Segment::create(n * sizeof(double));
+		auto *data = static_cast<double *>(segment->data());
+		return {std::move(segment), data};
+	}
+
+	auto *data = static_cast<double *>(::operator new[](n * sizeof(double), std::align_val_t{ROW_ALIGNMENT}));
+	std::fill(data, data + n, 0.0);
+	return {data, [](double *p)
+			{ ::operator delete[](p, std::align_val_t{ROW_ALIGNMENT}); }};
+}
+
+tuning::Schedule Neurogram::resolve_schedule(const size_t n_samples, const int n_trials) const
+{
+	auto result = schedule.value_or(tuning::Schedule{});
+	if (!schedule && use_tuning_profile && !cfs_.empty())
+	{
+		size_t n_fibers = 0;
+		for (const auto &fiber_set : an_population_)
+			n_fibers += fiber_set.size() / cfs_.size();
+		if (const auto profile = tuning::active_profile())
+			result = profile->lookup({cfs_.size(), n_fibers, n_samples, static_cast<size_t>(std::max(n_trials, 1))}).value_or(result);
+	}
+	result.n_threads = result.n_threads ? std::min(result.n_threads, utils::N_THREADS) : utils::N_THREADS;
+	return result;
+}
+
+size_t Neurogram::get_n_bins(const stimulus::Stimulus &sound_wave) const
+{
+	// TODO: check bin width >= sample rate
+	return sound_wave.n_simulation_timesteps / static_cast<size_t>(std::round(bin_width / sound_wave.time_resolution));
+}
+
+bool PrefixState::applies_to(const stimulus::Stimulus &sound_wave, const Species species, const std::vector<double> &cfs,
+							 const std::vector<double> &coh_cs, const std::vector<double> &ihc_cs,
+							 const size_t control_decimation) const
+{
+	return sound_wave.time_resolution == time_resolution && species == this->species && cfs == this->cfs &&
+		   coh_cs == this->coh_cs && ihc_cs == this->ihc_cs && control_decimation == this->control_decimation &&
+		   data.size() <= sound_wave.n_stimulation_timesteps &&
+		   std::equal(data.begin(), data.end(), sound_wave.data.begin());
+}
+
+std::shared_ptr<PrefixState> Neurogram::simulate_prefix(const stimulus::Stimulus &prefix, const Species species) const
+{
+	auto state = std::make_shared<PrefixState>();
+	state->data.assign(prefix.data.begin(), prefix.data.begin() + prefix.n_stimulation_timesteps);
+	state->time_resolution = prefix.time_resolution;
+	state->species = species;
+	state->cfs = cfs_;
+	state->coh_cs = coh_cs_;
+	state->ihc_cs = ihc_cs_;
+	state->control_decimation = control_decimation;
+	state->outputs.resize(cfs_.size());
+	for (size_t cf_i = 0; cf_i < cfs_.size(); cf_i++)
+		state->models.emplace_back(prefix.time_resolution, cfs_[cf_i], coh_cs_[cf_i], ihc_cs_[cf_i], species, state->control_decimation);
+
+	utils::parallel_for(cfs_.size(), [&](const size_t cf_i)
+						{
+		BRUCE_PROFILE_SCOPE(profiler::IHC);
+		state->models[cf_i].run(state->data.data(), state->data.size(), state->outputs[cf_i]); });
+	return state;
+}
+
+const PrefixState *Neurogram::resolve_prefix(const stimulus::Stimulus &sound_wave, const Species species) const
+{
+	if (!prefix)
+		return nullptr;
+	if (!prefix->applies_to(sound_wave, species, cfs_, coh_cs_, ihc_cs_, control_decimation))
+		throw std::invalid_argument("the stimulus does not start with the prefix, or was created with other parameters");
+	return prefix.get();
+}
+
+std::vector<double> Neurogram::evaluate_ihc(
+	const stimulus::Stimulus &sound_wave,
+	const int n_rep,
+	const Species species,
+	const size_t cf_i,
+	const PrefixState *prefix_state) const
+{
+	BRUCE_PROFILE_SCOPE(profiler::IHC);
+	auto ihc = prefix_state
+				   ? inner_hair_cell(sound_wave, prefix_state->models[cf_i], prefix_state->outputs[cf_i], n_rep)
+				   : inner_hair_cell(sound_wave, cfs_[cf_i], n_rep, coh_cs_[cf_i], ihc_cs_[cf_i], species, control_decimation);
+
+	assert(ihc.size() / n_rep == sound_wave.n_simulation_timesteps);
+	return ihc;
+}
+
 void Neurogram::evaluate_fiber(
 	const stimulus::Stimulus &sound_wave,
 	const std::vector<double> &ihc,
@@ -89,13 +220,32 @@ void Neurogram::evaluate_fiber(
 	const Fiber &fiber,
 	const size_t cf_i)
 {
-	const auto pla = synapse_mapping::map(
-		ihc,
-		fiber.spont,
-		cfs_[cf_i],
-		sound_wave.time_resolution,
-		SOFTPLUS);
+	evaluate_fiber(sound_wave, utils::Span<double>(ihc), n_rep, n_trials, noise_type, power_law, fiber, cf_i);
+}
 
+template <typename T>
+void Neurogram::evaluate_fiber(
+	const stimulus::Stimulus &sound_wave,
+	const utils::Span<T> ihc,
+	const int n_rep,
+	const int n_trials,
+	const NoiseType noise_type,
+	const PowerLaw power_law,
+	const Fiber &fiber,
+	const size_t cf_i)
+{
+	std::vector<double> pla;
+	{
+		BRUCE_PROFILE_SCOPE(profiler::MAPPING);
+		pla = synapse_mapping::map(
+			ihc,
+			fiber.spont,
+			cfs_[cf_i],
+			sound_wave.time_resolution,
+			SOFTPLUS);
+	}
+
+	std::vector<double> output(n_bins_, 0.0);
 	for(int i = 0; i < n_trials; i++) {
 		const auto out = synapse(
 			pla,
@@ -109,14 +259,23 @@ void Neurogram::evaluate_fiber(
 			fiber.tabs,
 			fiber.trel,
 			false);
-		auto output = utils::make_bins(out.psth, output_[0].size());
-		mutex_.lock();
-		utils::add(output_[cf_i], output);
-		mutex_.unlock();
+		BRUCE_PROFILE_SCOPE(profiler::BINNING);
+		utils::add(output, utils::make_bins(out.psth, n_bins_));
 	}
 
+	double *row = output_.get() + cf_i * row_stride_;
+	std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+	{
+		BRUCE_PROFILE_SCOPE(profiler::LOCK_WAIT);
+		lock.lock();
+	}
+	for (size_t i = 0; i < n_bins_; i++)
+		row[i] += output[i];
 }
 
+template void Neurogram::evaluate_fiber<double>(const stimulus::Stimulus &, utils::Span<double>, int, int, NoiseType, PowerLaw, const Fiber &, size_t);
+template void Neurogram::evaluate_fiber<float>(const stimulus::Stimulus &, utils::Span<float>, int, int, NoiseType, PowerLaw, const Fiber &, size_t);
+
 void Neurogram::evaluate_cf(
 	const stimulus::Stimulus &sound_wave,
 	const int n_rep,
@@ -126,39 +285,293 @@ void Neurogram::evaluate_cf(
 	const PowerLaw power_law,
 	const size_t cf_i)
 {
-	const auto fibers = get_fibers(cf_i);
+	BRUCE_PROFILE_CF(cf_i);
+	const auto ihc = evaluate_ihc(sound_wave, n_rep, species, cf_i, resolve_prefix(sound_wave, species));
 
-	const auto ihc = inner_hair_cell(
-		sound_wave, cfs_[cf_i], n_rep, coh_cs_[cf_i], ihc_cs_[cf_i], species);
+	for (const auto &fiber : get_fibers(cf_i))
+		evaluate_fiber(sound_wave, ihc, n_rep, n_trials, noise_type, power_law, fiber, cf_i);
+}
 
-	assert(ihc.size() / n_rep == sound_wave.n_simulation_timesteps);
+void Neurogram::create(
+	const stimulus::Stimulus &sound_wave,
+	const int n_rep,
+	const int n_trials,
+	const Species species,
+	const NoiseType noise_type,
+	const PowerLaw power_law)
+{
+	size_t row_stride;
+	auto output = allocate_output(cfs_.size(), get_n_bins(sound_wave), row_stride, use_shared_memory);
+	create(sound_wave, n_rep, n_trials, species, noise_type, power_law, std::move(output), row_stride);
+}
 
-	std::vector<std::thread> threads(fibers.size());
-	for (size_t f_id = 0; f_id < fibers.size(); f_id++)
-		threads[f_id] = std::thread(
-			&Neurogram::evaluate_fiber, this, sound_wave, ihc, n_rep, n_trials, noise_type, power_law, fibers[f_id], cf_i);
+void Neurogram::create(
+	const stimulus::Stimulus &sound_wave,
+	const int n_rep,
+	const int n_trials,
+	const Species species,
+	const NoiseType noise_type,
+	const PowerLaw power_law,
+	std::shared_ptr<double> output,
+	const size_t row_stride)
+{
+	// The streams of the tasks are drawn from GENERATOR, such that consecutive calls differ, but a seeded call does not
+	// depend on the number of threads
+	const TaskSeed task_seed{utils::SEED, static_cast<size_t>(utils::GENERATOR()) << 32};
+	run(sound_wave, n_rep, n_trials, species, noise_type, power_law, std::move(output), row_stride, resolve_prefix(sound_wave, species), task_seed);
+	window_start_ = 0.0;
+}
 
-	for (auto &th : threads)
-		th.join();
+state_index::Index Neurogram::build_index(const stimulus::Stimulus &sound_wave, const Species species, const double interval) const
+{
+	utils::validate_parameter(interval, sound_wave.time_resolution, std::numeric_limits<double>::infinity(), "interval");
+
+	state_index::Index index;
+	index.time_resolution = sound_wave.time_resolution;
+	index.species = species;
+	index.cfs = cfs_;
+	index.coh_cs = coh_cs_;
+	index.ihc_cs = ihc_cs_;
+	index.control_decimation = control_decimation;
+	index.seed = utils::SEED;
+	index.interval = static_cast<size_t>(std::round(interval / sound_wave.time_resolution));
+	index.n_samples = sound_wave.n_simulation_timesteps;
+
+	const auto initial_model = [&](const size_t cf_i)
+	{
+		return ihc::Model(sound_wave.time_resolution, cfs_[cf_i], coh_cs_[cf_i], ihc_cs_[cf_i], species, index.control_decimation);
+	};
+	index.snapshots.resize(std::max<size_t>(1, (index.n_samples + index.interval - 1) / index.interval));
+	for (size_t i = 0; i < index.snapshots.size(); i++)
+	{
+		index.snapshots[i].sample = i * index.interval;
+		for (size_t cf_i = 0; cf_i < cfs_.size(); cf_i++)
+			index.snapshots[i].models.push_back(initial_model(cf_i));
+	}
+
+	utils::parallel_for(cfs_.size(), [&](const size_t cf_i)
+						{
+		BRUCE_PROFILE_SCOPE(profiler::IHC);
+		auto model = initial_model(cf_i);
+		for (size_t n = 0; n < index.n_samples; n++)
+		{
+			if (n % index.interval == 0)
+				index.snapshots[n / index.interval].models[cf_i] = model;
+			model(n < sound_wave.n_stimulation_timesteps ? sound_wave.data[n] : 0.0);
+		} });
+	return index;
 }
 
-void Neurogram::create(
+Neurogram::Window Neurogram::resolve_window(
+	const stimulus::Stimulus &sound_wave,
+	const state_index::Index &index,
+	const double t0,
+	const double t1,
+	const Species species,
+	const double warmup) const
+{
+	if (index.time_resolution != sound_wave.time_resolution || index.species != species || index.cfs != cfs_ ||
+		index.coh_cs != coh_cs_ || index.ihc_cs != ihc_cs_ || index.control_decimation != control_decimation ||
+		index.n_samples != sound_wave.n_simulation_timesteps)
+		throw std::invalid_argument("the state index was built for another recording, species or neurogram");
+	if (!(t0 >= 0.0 && t0 < t1 && warmup >= 0.0))
+		throw std::invalid_argument("the window should satisfy 0 <= t0 < t1, with a warmup of at least 0");
+
+	const double time_resolution = sound_wave.time_resolution;
+	const size_t bin_size = std::max<size_t>(1, static_cast<size_t>(std::round(bin_width / time_resolution)));
+	// Sample indices, tolerating rounding errors of times given at sample boundaries
+	const size_t first = std::min(static_cast<size_t>(std::floor(t0 / time_resolution + 1e-6)), index.n_samples);
+	const size_t last = std::min(static_cast<size_t>(std::ceil(t1 / time_resolution - 1e-6)), index.n_samples);
+	const auto n_warmup = static_cast<size_t>(std::ceil(warmup / time_resolution));
+	const auto &snapshot = index.before(first > n_warmup ? first - n_warmup : 0);
+	const size_t begin = snapshot.sample;
+
+	// The recording from the snapshot to the end of the window
+	const size_t n_stimulation = sound_wave.n_stimulation_timesteps;
+	stimulus::Stimulus window(
+		std::vector<double>(sound_wave.data.begin() + std::min(begin, n_stimulation), sound_wave.data.begin() + std::min(last, n_stimulation)),
+		sound_wave.sampling_rate, static_cast<double>(last - begin) * time_resolution);
+	window.n_simulation_timesteps = last - begin;
+
+	// The bins of the warm-up, before the one that holds t0, are dropped
+	const size_t skip = (first - begin) / bin_size;
+	if (skip >= get_n_bins(window))
+		throw std::invalid_argument("the window should hold at least one bin of the recording");
+	return {&snapshot, static_cast<size_t>(&snapshot - index.snapshots.data()), std::move(window), skip, bin_size};
+}
+
+void Neurogram::create_window(
 	const stimulus::Stimulus &sound_wave,
+	const state_index::Index &index,
+	const double t0,
+	const double t1,
 	const int n_rep,
 	const int n_trials,
 	const Species species,
 	const NoiseType noise_type,
-	const PowerLaw power_law)
+	const PowerLaw power_law,
+	const double warmup)
 {
-	// TODO: check bin width >= sample rate
-	const size_t unfiltered_n_bins = sound_wave.n_simulation_timesteps / static_cast<size_t>(std::round(bin_width / sound_wave.time_resolution));
-	output_ = std::vector(cfs_.size(), std::vector(unfiltered_n_bins, 0.0));
+	const auto window = resolve_window(sound_wave, index, t0, t1, species, warmup);
+	const size_t n_bins = get_n_bins(window.stimulus);
+
+	const PrefixState state{{}, sound_wave.time_resolution, species, cfs_, coh_cs_, ihc_cs_, index.control_decimation, window.snapshot->models, std::vector<std::vector<double>>(cfs_.size())};
+	size_t row_stride;
+	auto window_output = allocate_output(cfs_.size(), n_bins, row_stride, use_shared_memory);
+	run(window.stimulus, n_rep, n_trials, species, noise_type, power_law, std::move(window_output), row_stride, &state,
+		TaskSeed{index.seed, window.snapshot_i << 32});
 
-	std::vector<std::thread> threads(cfs_.size());
+	auto output = allocate_output(cfs_.size(), n_bins - window.skip, row_stride, use_shared_memory);
 	for (size_t cf_i = 0; cf_i < cfs_.size(); cf_i++)
-		threads[cf_i] = std::thread(
-			&Neurogram::evaluate_cf, this, sound_wave, n_rep, n_trials, species, noise_type, power_law, cf_i);
+		std::copy(row(cf_i) + window.skip, row(cf_i) + n_bins, output.get() + cf_i * row_stride);
+	output_ = std::move(output);
+	n_bins_ = n_bins - window.skip;
+	row_stride_ = row_stride;
+	window_start_ = static_cast<double>(window.snapshot->sample + window.skip * window.bin_size) * sound_wave.time_resolution;
+}
+
+std::vector<double> Neurogram::window_ihc(
+	const stimulus::Stimulus &sound_wave,
+	const state_index::Index &index,
+	const size_t cf_i,
+	const double t0,
+	const double t1,
+	const double warmup) const
+{
+	if (cf_i >= cfs_.size())
+		throw std::invalid_argument("cf_i should be the index of a CF of the neurogram");
+	const auto window = resolve_window(sound_wave, index, t0, t1, index.species, warmup);
+	const auto ihc = inner_hair_cell(window.stimulus, window.snapshot->models[cf_i], {}, 1);
+	return {ihc.begin() + static_cast<std::ptrdiff_t>(window.skip * window.bin_size), ihc.end()};
+}
 
-	for (auto &th : threads)
-		th.join();
+void Neurogram::run(
+	const stimulus::Stimulus &sound_wave,
+	const int n_rep,
+	const int n_trials,
+	const Species species,
+	const NoiseType noise_type,
+	const PowerLaw power_law,
+	std::shared_ptr<double> output,
+	const size_t row_stride,
+	const PrefixState *prefix_state,
+	const TaskSeed task_seed)
+{
+	n_bins_ = get_n_bins(sound_wave);
+	if (row_stride < n_bins_)
+		throw std::invalid_argument("row_stride should be at least the number of bins");
+
+	output_ = std::move(output);
+	row_stride_ = row_stride;
+	profile_ = {};
+	const bool profiling = profiler::enabled();
+	if (profiling)
+		profiler::reset();
+	const bool accounting = memory::enabled();
+	if (accounting)
+	{
+		memory::reset();
+		memory::reset_peak_rss();
+	}
+	const bool tracing = profiler::tracing_enabled();
+	const uint64_t start = profiler::ticks();
+	if (tracing)
+		trace::clear();
+
+	for (size_t cf_i = 0; cf_i < cfs_.size(); cf_i++)
+		std::fill(output_.get() + cf_i * row_stride_, output_.get() + cf_i * row_stride_ + n_bins_, 0.0);
+
+	last_schedule_ = resolve_schedule(sound_wave.n_simulation_timesteps, n_trials);
+	plan_ = budget ? planner::plan(*budget) : planner::fixed(power_law);
+	utils::validate_parameter(control_decimation, size_t{1}, ihc::MAX_CONTROL_DECIMATION, "control_decimation");
+	const PowerLaw pla_impl = plan_.power_law();
+	const bool float_ihc = plan_.uses(planner::FLOAT_IHC);
+	const size_t n_threads = last_schedule_.n_threads;
+	const size_t cf_block = last_schedule_.cf_block ? last_schedule_.cf_block : std::max<size_t>(cfs_.size(), 1);
+	const int trials_per_task = last_schedule_.trials_per_task ? static_cast<int>(last_schedule_.trials_per_task) : std::max(n_trials, 1);
+
+	// A task evaluates (a number of trials of) a single fiber, and adds to the row of its CF
+	struct Task
+	{
+		size_t cf_i;
+		Fiber fiber;
+		int n_trials;
+	};
+
+	// The IHC output of a CF, in ihc_float instead when the plan keeps it in single precision
+	std::vector<std::vector<double>> ihc(cfs_.size());
+	std::vector<std::vector<float>> ihc_float(float_ihc ? cfs_.size() : 0);
+	std::vector<std::atomic<size_t>> remaining(cfs_.size());
+	size_t n_previous_tasks = 0;
+	for (size_t first = 0; first < cfs_.size(); first += cf_block)
+	{
+		const size_t last = std::min(cfs_.size(), first + cf_block);
+
+		// The IHC output of every CF is shared by all of its fibers, so it is computed first
+		utils::parallel_for(last - first, [&](const size_t i)
+							{
+			const size_t cf_i = first + i;
+			BRUCE_PROFILE_CF(cf_i);
+			ihc[cf_i] = evaluate_ihc(sound_wave, n_rep, species, cf_i, prefix_state);
+			if (float_ihc)
+			{
+				ihc_float[cf_i].assign(ihc[cf_i].begin(), ihc[cf_i].end());
+				std::vector<double>().swap(ihc[cf_i]);
+			} }, n_threads);
+
+		std::vector<Task> tasks;
+		for (size_t cf_i = first; cf_i < last; cf_i++)
+		{
+			const auto fibers = get_fibers(cf_i);
+			const size_t n_tasks = tasks.size();
+			for (const auto &fiber : fibers)
+			{
+				tasks.push_back({cf_i, fiber, std::min(trials_per_task, n_trials)});
+				for (int trial = trials_per_task; trial < n_trials; trial += trials_per_task)
+					tasks.push_back({cf_i, fiber, std::min(trials_per_task, n_trials - trial)});
+			}
+			remaining[cf_i] = tasks.size() - n_tasks;
+
+			if (fibers.empty() && on_cf_completed)
+				on_cf_completed(cf_i);
+		}
+
+		utils::parallel_for(tasks.size(), [&](const size_t t)
+							{
+			const auto &task = tasks[t];
+			utils::GeneratorScope generator(task_seed.seed, task_seed.first_stream + n_previous_tasks + t);
+			BRUCE_PROFILE_CF(task.cf_i);
+			BRUCE_TRACE_SCOPE("fiber", task.cf_i);
+			if (float_ihc)
+				evaluate_fiber(sound_wave, utils::Span<float>(ihc_float[task.cf_i]), n_rep, task.n_trials, noise_type, pla_impl, task.fiber, task.cf_i);
+			else
+				evaluate_fiber(sound_wave, utils::Span<double>(ihc[task.cf_i]), n_rep, task.n_trials, noise_type, pla_impl, task.fiber, task.cf_i);
+
+			// Release the IHC output as soon as the last task of a CF has been evaluated
+			if (--remaining[task.cf_i] == 0)
+			{
+				std::vector<double>().swap(ihc[task.cf_i]);
+				if (float_ihc)
+					std::vector<float>().swap(ihc_float[task.cf_i]);
+				if (on_cf_completed)
+					on_cf_completed(task.cf_i);
+			} }, n_threads);
+		n_previous_tasks += tasks.size();
+	}
+
+	// Worker threads have flushed their timers when they exited
+	profiler::clear_cf();
+	if (profiling)
+		profile_ = profiler::collect();
+	if (accounting)
+	{
+		profile_.allocations = memory::totals();
+		profile_.peak_rss = memory::peak_rss();
+	}
+	if (tracing)
+	{
+		trace::emit({"create", start, profiler::ticks(), -1});
+		if (!trace_file.empty())
+			trace::write_chrome_trace(trace_file, profiler::seconds_per_tick());
+	}
 }
@@ -0,0 +1,166 @@
+#include "perf_counters.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace perf
+{
+	const char *event_name(const Event event)
+	{
+		switch (event)
+		{
+		case CYCLES:
+			return "cycles";
+		case INSTRUCTIONS:
+			return "instructions";
+		case CACHE_MISSES:
+			return "cache_misses";
+		case BRANCH_MISSES:
+			return "branch_misses";
+		case FP_ASSISTS:
+			return "fp_assists";
+		default:
+			return "unknown";
+		}
+	}
+
+#if defined(__linux__)
+	namespace
+	{
+		int open_event(const uint32_t type, const uint64_t config, const int group_fd)
+		{
+			perf_event_attr attr{};
+			attr.size = sizeof(attr);
+			attr.type = type;
+			attr.config = config;
+			attr.disabled = group_fd == -1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+		}
+
+		bool event_config(const Event event, uint32_t &type, uint64_t &config)
+		{
+			type = PERF_TYPE_HARDWARE;
+			switch (event)
+			{
+			case CYCLES:
+				config = PERF_COUNT_HW_CPU_CYCLES;
+				return true;
+			case INSTRUCTIONS:
+				config = PERF_COUNT_HW_INSTRUCTIONS;
+				return true;
+			case CACHE_MISSES:
+				config = PERF_COUNT_HW_CACHE_MISSES;
+				return true;
+			case BRANCH_MISSES:
+				config = PERF_COUNT_HW_BRANCH_MISSES;
+				return true;
+			case FP_ASSISTS:
+			{
+				const char *code = std::getenv("BRUCE_PERF_FP_ASSIST");
+				if (!code || !*code)
+					return false;
+				type = PERF_TYPE_RAW;
+				config = std::strtoull(code, nullptr, 0);
+				return config != 0;
+			}
+			default:
+				return false;
+			}
+		}
+	}
+
+	CounterGroup::CounterGroup()
+	{
+		fds_.fill(-1);
+		for (size_t e = 0; e < N_EVENTS; e++)
+		{
+			uint32_t type;
+			uint64_t config;
+			if (!event_config(static_cast<Event>(e), type, config))
+				continue;
+			const int fd = open_event(type, config, leader_);
+			if (fd == -1)
+				continue;
+			if (leader_ == -1)
+				leader_ = fd;
+			fds_[e] = fd;
+			order_[n_open_++] = static_cast<Event>(e);
+			available_ |= 1u << e;
+		}
+		if (leader_ != -1)
+		{
+			ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		}
+	}
+
+	CounterGroup::~CounterGroup()
+	{
+		for (const int fd : fds_)
+			if (fd != -1)
+				close(fd);
+	}
+
+	Counts CounterGroup::read() const
+	{
+		Counts counts;
+		if (leader_ == -1)
+			return counts;
+
+		// {nr, time_enabled, time_running, values[nr]}
+		uint64_t buffer[3 + N_EVENTS];
+		const auto n_read = ::read(leader_, buffer, sizeof(buffer));
+		if (n_read < static_cast<ssize_t>(3 * sizeof(uint64_t)) || buffer[0] != n_open_)
+			return counts;
+
+		const double scale = buffer[2] ? static_cast<double>(buffer[1]) / static_cast<double>(buffer[2]) : 0.0;
+		for (size_t i = 0; i < n_open_; i++)
+			counts.values[order_[i]] = static_cast<uint64_t>(static_cast<double>(buffer[3 + i]) * scale);
+		counts.available = buffer[2] ? available_ : 0;
+		return counts;
+	}
+
+	bool supported(std::string *why)
+	{
+		const int fd = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1);
+		if (fd == -1)
+		{
+			if (why)
+				*why = std::string("perf_event_open: ") + std::strerror(errno);
+			return false;
+		}
+		close(fd);
+		return true;
+	}
+#else
+	CounterGroup::CounterGroup()
+	{
+		fds_.fill(-1);
+	}
+
+	CounterGroup::~CounterGroup() = default;
+
+	Counts CounterGroup::read() const
+	{
+		return {};
+	}
+
+	bool supported(std::string *why)
+	{
+		if (why)
+			*why = "hardware counters are only supported on Linux";
+		return false;
+	}
+#endif
+}
@@ -0,0 +1,158 @@
+#include "planner.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+
+#include "inner_hair_cell.h"
+#include "synapse.h"
+#include "synapse_mapping.h"
+
+namespace planner
+{
+	namespace
+	{
+		std::mutex characterization_mutex;
+
+		// Measured with characterize on the default workload (see characterization)
+		Characterization current = {{
+			{3.8e-2, 0.48, 1.0},
+			{4.6e-9, 1.0, 0.5},
+		}};
+
+		double relative_l1_error(const std::vector<double> &x, const std::vector<double> &reference)
+		{
+			double error = 0.0, norm = 0.0;
+			for (size_t i = 0; i < reference.size(); i++)
+			{
+				error += std::abs(x[i] - reference[i]);
+				norm += std::abs(reference[i]);
+			}
+			return norm > 0.0 ? error / norm : error;
+		}
+	}
+
+	const char *tier_name(const Tier tier)
+	{
+		switch (tier)
+		{
+		case APPROXIMATE_POWER_LAW:
+			return "approximate_power_law";
+		case FLOAT_IHC:
+			return "float_ihc";
+		default:
+			return "unknown";
+		}
+	}
+
+	std::string Plan::describe() const
+	{
+		std::string result;
+		for (unsigned t = 0; t < N_TIERS; t++)
+			if (uses(static_cast<Tier>(t)))
+				result += (result.empty() ? "" : "+") + std::string(tier_name(static_cast<Tier>(t)));
+		return result.empty() ? "exact" : result;
+	}
+
+	Characterization characterization()
+	{
+		std::lock_guard<std::mutex> lock(characterization_mutex);
+		return current;
+	}
+
+	void set_characterization(const Characterization &characterization)
+	{
+		std::lock_guard<std::mutex> lock(characterization_mutex);
+		current = characterization;
+	}
+
+	Characterization characterize(const stimulus::Stimulus &stim, const std::vector<double> &cfs,
+								  const std::vector<double> &sponts, const double bin_width)
+	{
+		using Clock = std::chrono::steady_clock;
+		constexpr double tabs = 0.7e-3;
+		constexpr double trel = 0.6e-3;
+		const size_t n_bins = stim.n_simulation_timesteps / static_cast<size_t>(std::round(bin_width / stim.time_resolution));
+
+		// Expected PSTH (the noiseless synaptic output) of a variant, and the time it took
+		const auto expected_psth = [&](const auto &ihc, const double cf, const double spont, const PowerLaw power_law, double &seconds)
+		{
+			const auto start = Clock::now();
+			const auto mapped = synapse_mapping::map(ihc, spont, cf, stim.time_resolution, SOFTPLUS);
+			const auto out = synapse(mapped, cf, 1, stim.n_simulation_timesteps, stim.time_resolution, ONES, power_law, spont, tabs, trel, false);
+			seconds += std::chrono::duration<double>(Clock::now() - start).count();
+			return utils::make_bins(out.synaptic_output, n_bins);
+		};
+
+		// IHC output of a CF, and the time it took
+		const auto timed_ihc = [&](const double cf, double &seconds)
+		{
+			const auto start = Clock::now();
+			auto ihc = inner_hair_cell(stim, cf, 1, 1.0, 1.0, HUMAN_SHERA);
+			seconds = std::chrono::duration<double>(Clock::now() - start).count();
+			return ihc;
+		};
+
+		Characterization result{};
+		double exact_seconds = 0.0;
+		std::array<double, N_TIERS> seconds{};
+		for (const double cf : cfs)
+		{
+			double ihc_seconds;
+			const auto ihc = timed_ihc(cf, ihc_seconds);
+			const std::vector<float> ihc_float(ihc.begin(), ihc.end());
+
+			// The IHC output of a CF is shared by its fibers, the costs are those of a CF with a single fiber
+			const auto n_fibers = static_cast<double>(sponts.size());
+			exact_seconds += n_fibers * ihc_seconds;
+			for (size_t t = 0; t < N_TIERS; t++)
+				seconds[t] += n_fibers * ihc_seconds;
+
+			for (const double spont : sponts)
+			{
+				const auto exact = expected_psth(utils::Span<double>(ihc), cf, spont, ACTUAL, exact_seconds);
+				const std::array<std::vector<double>, N_TIERS> approximations = {
+					expected_psth(utils::Span<double>(ihc), cf, spont, APPROXIMATED, seconds[APPROXIMATE_POWER_LAW]),
+					expected_psth(utils::Span<float>(ihc_float), cf, spont, ACTUAL, seconds[FLOAT_IHC])};
+				for (size_t t = 0; t < N_TIERS; t++)
+					result[t].error = std::max(result[t].error, relative_l1_error(approximations[t], exact));
+			}
+		}
+		for (size_t t = 0; t < N_TIERS; t++)
+			result[t].cost = exact_seconds > 0.0 ? seconds[t] / exact_seconds : 1.0;
+		result[FLOAT_IHC].memory = static_cast<double>(sizeof(float)) / sizeof(double);
+		return result;
+	}
+
+	Plan plan(const Budget &budget, const Characterization &characterization)
+	{
+		Plan best;
+		for (unsigned tiers = 0; tiers < (1u << N_TIERS); tiers++)
+		{
+			Plan candidate{tiers, 0.0, 1.0, 1.0};
+			for (unsigned t = 0; t < N_TIERS; t++)
+				if (candidate.uses(static_cast<Tier>(t)))
+				{
+					candidate.estimated_error += characterization[t].error;
+					candidate.relative_cost *= characterization[t].cost;
+					candidate.relative_memory *= characterization[t].memory;
+				}
+			if (candidate.estimated_error > budget.max_relative_error)
+				continue;
+
+			const bool same_cost = std::abs(candidate.relative_cost - best.relative_cost) <= COST_TOLERANCE * best.relative_cost;
+			if (same_cost ? candidate.relative_memory < best.relative_memory : candidate.relative_cost < best.relative_cost)
+				best = candidate;
+		}
+		return best;
+	}
+
+	Plan fixed(const PowerLaw power_law, const Characterization &characterization)
+	{
+		if (power_law == ACTUAL)
+			return {};
+		const auto &stat = characterization[APPROXIMATE_POWER_LAW];
+		return {1u << APPROXIMATE_POWER_LAW, stat.error, stat.cost, stat.memory};
+	}
+}
@@ -2,8 +2,10 @@
 
 namespace pla
 {
+	template <typename T>
+	BRUCE_TARGET_CLONES
 	void approximate(
-		const std::vector<double>& amplitude_ihc,
+		const utils::Span<T> amplitude_ihc,
 		const std::vector<double>& random_numbers,
 		const int n,
 		const double alpha1,
@@ -62,8 +64,10 @@ namespace pla
 		}
 	}
 
+	template <typename T>
+	BRUCE_TARGET_CLONES
 	void actual(
-		const std::vector<double>& amplitude_ihc,
+		const utils::Span<T> amplitude_ihc,
 		const std::vector<double>& random_numbers,
 		const int n,
 		const double alpha1,
@@ -93,8 +97,9 @@ namespace pla
 		}
 	}
 
+	template <typename T>
 	std::vector<double> power_law(
-		const std::vector<double>& amplitude_ihc,
+		const utils::Span<T> amplitude_ihc,
 		const NoiseType noise,
 		const PowerLaw impl,
 		const double spontaneous_firing_rate,
@@ -111,8 +116,13 @@ namespace pla
 		constexpr double beta2 = 1e-1;
 
 		const int n = static_cast<int>(floor((n_total_timesteps + 2.0 * delay_point) * time_resolution * sampling_frequency));
-		const auto random_numbers = utils::fast_fractional_gaussian_noise(n, noise, spontaneous_firing_rate);
+		std::vector<double> random_numbers;
+		{
+			BRUCE_PROFILE_SCOPE(profiler::FGN);
+			random_numbers = utils::fast_fractional_gaussian_noise(n, noise, spontaneous_firing_rate);
+		}
 
+		BRUCE_PROFILE_SCOPE(profiler::POWER_LAW);
 		std::vector<double> synapse_out(n);
 		if (impl == APPROXIMATED)
 			approximate(amplitude_ihc, random_numbers, n, alpha1, alpha2, synapse_out);
@@ -121,4 +131,11 @@ namespace pla
 
 		return synapse_out;
 	}
+
+	template void approximate<double>(utils::Span<double>, const std::vector<double>&, int, double, double, std::vector<double>&);
+	template void approximate<float>(utils::Span<float>, const std::vector<double>&, int, double, double, std::vector<double>&);
+	template void actual<double>(utils::Span<double>, const std::vector<double>&, int, double, double, double, double, double, std::vector<double>&);
+	template void actual<float>(utils::Span<float>, const std::vector<double>&, int, double, double, double, double, double, std::vector<double>&);
+	template std::vector<double> power_law<double>(utils::Span<double>, NoiseType, PowerLaw, double, double, double, double, int);
+	template std::vector<double> power_law<float>(utils::Span<float>, NoiseType, PowerLaw, double, double, double, double, int);
 }
@@ -0,0 +1,293 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+namespace profiler
+{
+	std::atomic<unsigned> MODE{0};
+
+	namespace
+	{
+		void set_mode(const Mode mode, const bool enabled)
+		{
+			if (enabled)
+				MODE.fetch_or(mode);
+			else
+				MODE.fetch_and(~static_cast<unsigned>(mode));
+		}
+
+		bool has_mode(const Mode mode)
+		{
+#ifdef BRUCE_PROFILE
+			return MODE.load() & mode;
+#else
+			(void)mode;
+			return false;
+#endif
+		}
+	}
+
+	namespace
+	{
+		std::mutex global_mutex;
+		Report global;
+
+		void merge_into(std::vector<Stats> &target, const std::vector<Stats> &source)
+		{
+			if (target.size() < source.size())
+				target.resize(source.size());
+			for (size_t i = 0; i < source.size(); i++)
+				for (size_t s = 0; s < N_STAGES; s++)
+					target[i][s].merge(source[i][s]);
+		}
+
+		//! Timers of a single thread, merged into the global report on flush or thread exit
+		struct ThreadBuffer
+		{
+			std::vector<Stats> per_cf;
+			Stats other{};
+			bool has_cf = false;
+			size_t cf = 0;
+			//! Opened on the first read, a thread only pays for the counters when they are used
+			std::unique_ptr<perf::CounterGroup> counters;
+
+			void flush()
+			{
+				if (per_cf.empty() && std::all_of(other.begin(), other.end(), [](const Stat &s)
+												  { return s.count == 0; }))
+					return;
+
+				std::lock_guard<std::mutex> lock(global_mutex);
+				merge_into(global.per_cf, per_cf);
+				for (size_t s = 0; s < N_STAGES; s++)
+					global.other[s].merge(other[s]);
+				clear();
+			}
+
+			void clear()
+			{
+				per_cf.clear();
+				other = {};
+			}
+
+			~ThreadBuffer()
+			{
+				flush();
+			}
+		};
+
+		ThreadBuffer &buffer()
+		{
+			thread_local ThreadBuffer buffer;
+			return buffer;
+		}
+	}
+
+	const char *stage_name(const Stage stage)
+	{
+		switch (stage)
+		{
+		case IHC:
+			return "ihc";
+		case MAPPING:
+			return "mapping";
+		case FGN:
+			return "fgn";
+		case POWER_LAW:
+			return "power_law";
+		case UPSAMPLE:
+			return "upsample";
+		case SPIKE_GENERATION:
+			return "spike_generation";
+		case BINNING:
+			return "binning";
+		case LOCK_WAIT:
+			return "lock_wait";
+		default:
+			return "unknown";
+		}
+	}
+
+	double seconds_per_tick()
+	{
+#ifdef BRUCE_PROFILE_TSC
+		static const double value = []()
+		{
+			using Clock = std::chrono::steady_clock;
+			const auto t0 = Clock::now();
+			const auto c0 = ticks();
+			while (Clock::now() - t0 < std::chrono::milliseconds(10))
+				;
+			const auto c1 = ticks();
+			const double seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+			return seconds / static_cast<double>(c1 - c0);
+		}();
+		return value;
+#else
+		return static_cast<double>(std::chrono::steady_clock::period::num) / std::chrono::steady_clock::period::den;
+#endif
+	}
+
+	bool Report::empty() const
+	{
+		return std::all_of(total.begin(), total.end(), [](const Stat &s)
+						   { return s.count == 0; }) &&
+			   std::all_of(other.begin(), other.end(), [](const Stat &s)
+						   { return s.count == 0; });
+	}
+
+	std::string Report::summary() const
+	{
+		perf::Counts counted;
+		bool allocations_counted = false;
+		for (size_t s = 0; s < N_STAGES; s++)
+		{
+			counted += total[s].counters;
+			counted += other[s].counters;
+			allocations_counted |= total[s].allocations.count + other[s].allocations.count > 0;
+		}
+
+		std::ostringstream ss;
+		ss << std::left << std::setw(18) << "stage" << std::right << std::setw(10) << "count"
+		   << std::setw(14) << "total [ms]" << std::setw(14) << "mean [us]" << std::setw(14) << "max [us]";
+		if (counted.has(perf::CYCLES) && counted.has(perf::INSTRUCTIONS))
+			ss << std::setw(8) << "ipc";
+		for (const auto event : {perf::CACHE_MISSES, perf::BRANCH_MISSES, perf::FP_ASSISTS})
+			if (counted.has(event))
+				ss << std::setw(16) << perf::event_name(event);
+		if (allocations_counted)
+			ss << std::setw(10) << "allocs" << std::setw(14) << "alloc [MB]" << std::setw(14) << "peak [MB]";
+		ss << "\n";
+
+		for (size_t s = 0; s < N_STAGES; s++)
+		{
+			Stat stat = total[s];
+			stat.merge(other[s]);
+			if (stat.count == 0)
+				continue;
+			ss << std::left << std::setw(18) << stage_name(static_cast<Stage>(s)) << std::right << std::setw(10) << stat.count
+			   << std::fixed << std::setprecision(3)
+			   << std::setw(14) << static_cast<double>(stat.total) * seconds_per_tick * 1e3
+			   << std::setw(14) << static_cast<double>(stat.total) / static_cast<double>(stat.count) * seconds_per_tick * 1e6
+			   << std::setw(14) << static_cast<double>(stat.max) * seconds_per_tick * 1e6;
+			if (counted.has(perf::CYCLES) && counted.has(perf::INSTRUCTIONS))
+				ss << std::setw(8) << std::setprecision(2) << stat.counters.ipc();
+			for (const auto event : {perf::CACHE_MISSES, perf::BRANCH_MISSES, perf::FP_ASSISTS})
+				if (counted.has(event))
+					ss << std::setw(16) << stat.counters.values[event];
+			if (allocations_counted)
+				ss << std::setw(10) << stat.allocations.count
+				   << std::setw(14) << static_cast<double>(stat.allocations.bytes) / (1 << 20)
+				   << std::setw(14) << static_cast<double>(stat.allocations.peak_live) / (1 << 20);
+			ss << "\n";
+		}
+		if (allocations.count || peak_rss > 0)
+			ss << std::fixed << std::setprecision(3) << "allocations: " << allocations.count
+			   << ", allocated: " << static_cast<double>(allocations.bytes) / (1 << 20) << " MB"
+			   << ", peak live: " << static_cast<double>(allocations.peak_live) / (1 << 20) << " MB"
+			   << ", peak rss: " << peak_rss / (1 << 20) << " MB\n";
+		return ss.str();
+	}
+
+	void set_enabled(const bool enabled)
+	{
+		set_mode(TIMERS, enabled);
+	}
+
+	bool enabled()
+	{
+		return has_mode(TIMERS);
+	}
+
+	void set_cf(const size_t cf_i)
+	{
+		auto &b = buffer();
+		b.has_cf = true;
+		b.cf = cf_i;
+	}
+
+	void clear_cf()
+	{
+		buffer().has_cf = false;
+	}
+
+	void set_counters(const bool enabled)
+	{
+		set_mode(COUNTERS, enabled);
+	}
+
+	bool counters_enabled()
+	{
+		return has_mode(TIMERS) && has_mode(COUNTERS);
+	}
+
+	void set_tracing(const bool enabled)
+	{
+		set_mode(TRACING, enabled);
+	}
+
+	bool tracing_enabled()
+	{
+		return has_mode(TRACING);
+	}
+
+	perf::Counts read_counters()
+	{
+		auto &b = buffer();
+		if (!b.counters)
+			b.counters = std::make_unique<perf::CounterGroup>();
+		return b.counters->read();
+	}
+
+	void record(const Stage stage, const unsigned mode, const uint64_t begin, const uint64_t end, const perf::Counts *counters, const memory::Allocations *allocations)
+	{
+		auto &b = buffer();
+		if (mode & TRACING)
+			trace::emit({stage_name(stage), begin, end, b.has_cf ? static_cast<int64_t>(b.cf) : -1});
+		if (!(mode & TIMERS))
+			return;
+
+		Stat *stat = &b.other[stage];
+		if (b.has_cf)
+		{
+			if (b.per_cf.size() <= b.cf)
+				b.per_cf.resize(b.cf + 1);
+			stat = &b.per_cf[b.cf][stage];
+		}
+		stat->add(end - begin);
+		if (counters)
+			stat->counters += *counters;
+		if (allocations)
+			stat->allocations.merge(*allocations);
+	}
+
+	void flush()
+	{
+		buffer().flush();
+	}
+
+	void reset()
+	{
+		buffer().clear();
+		std::lock_guard<std::mutex> lock(global_mutex);
+		global = {};
+	}
+
+	Report collect()
+	{
+		flush();
+		std::lock_guard<std::mutex> lock(global_mutex);
+		Report report = global;
+		report.total = {};
+		for (const auto &stats : report.per_cf)
+			for (size_t s = 0; s < N_STAGES; s++)
+				report.total[s].merge(stats[s]);
+		report.seconds_per_tick = seconds_per_tick();
+		return report;
+	}
+}
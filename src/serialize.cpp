@@ -0,0 +1,457 @@
+#include "serialize.h"
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+
+namespace serialize
+{
+	namespace
+	{
+		//! Appends raw values to a header
+		struct Writer
+		{
+			std::string data;
+
+			template <typename T>
+			void put(const T value)
+			{
+				data.append(reinterpret_cast<const char *>(&value), sizeof(T));
+			}
+
+			void put(const std::vector<double> &values)
+			{
+				put<uint64_t>(values.size());
+				data.append(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(double));
+			}
+
+			void put(const std::vector<Fiber> &fibers)
+			{
+				put<uint64_t>(fibers.size());
+				for (const auto &fiber : fibers)
+				{
+					put(fiber.spont);
+					put(fiber.tabs);
+					put(fiber.trel);
+					put<uint32_t>(fiber.type);
+				}
+			}
+		};
+
+		//! Reads raw values from a header, throwing on truncated input
+		struct Reader
+		{
+			const std::string &data;
+			size_t pos = 0;
+
+			//! Check that n elements of size bytes remain, without overflowing on a corrupted count
+			void check(const size_t n, const size_t size = 1) const
+			{
+				if (n > (data.size() - pos) / size)
+					throw std::runtime_error("serialize: truncated header");
+			}
+
+			template <typename T>
+			T get()
+			{
+				check(sizeof(T));
+				T value;
+				std::memcpy(&value, data.data() + pos, sizeof(T));
+				pos += sizeof(T);
+				return value;
+			}
+
+			std::vector<double> get_vector()
+			{
+				const auto n = get<uint64_t>();
+				check(n, sizeof(double));
+				std::vector<double> values(n);
+				std::memcpy(values.data(), data.data() + pos, n * sizeof(double));
+				pos += n * sizeof(double);
+				return values;
+			}
+
+			std::vector<Fiber> get_fibers()
+			{
+				const auto n = get<uint64_t>();
+				check(n, 3 * sizeof(double) + sizeof(uint32_t));
+				std::vector<Fiber> fibers(n);
+				for (auto &fiber : fibers)
+				{
+					fiber.spont = get<double>();
+					fiber.tabs = get<double>();
+					fiber.trel = get<double>();
+					const auto type = get<uint32_t>();
+					if (type > HIGH)
+						throw std::runtime_error("serialize: invalid fiber type");
+					fiber.type = static_cast<FiberType>(type);
+				}
+				return fibers;
+			}
+		};
+
+		Writer start_header(const ObjectType type)
+		{
+			Writer writer;
+			writer.put(MAGIC);
+			writer.put(VERSION);
+			writer.put(static_cast<uint32_t>(type));
+			return writer;
+		}
+
+		Reader open_header(const std::string &header, const ObjectType type)
+		{
+			if (get_type(header) != type)
+				throw std::runtime_error("serialize: unexpected object type");
+			return Reader{header, 3 * sizeof(uint32_t)};
+		}
+
+		Buffer as_buffer(const std::vector<double> &x)
+		{
+			return {x.data(), x.size() * sizeof(double)};
+		}
+
+		void copy_buffer(const Buffer &buffer, std::vector<double> &x, const size_t n)
+		{
+			if (buffer.size % sizeof(double) != 0 || buffer.size / sizeof(double) != n)
+				throw std::runtime_error("serialize: buffer size does not match header");
+			x.resize(n);
+			if (n != 0)
+				std::memcpy(x.data(), buffer.data, buffer.size);
+		}
+
+		void check_n_buffers(const std::vector<Buffer> &buffers, const size_t n)
+		{
+			if (buffers.size() != n)
+				throw std::runtime_error("serialize: unexpected number of buffers");
+		}
+
+		//! Parsed neurogram header
+		struct NeurogramHeader
+		{
+			double bin_width;
+			std::vector<double> cfs;
+			std::vector<double> db_loss;
+			std::vector<double> coh_cs;
+			std::vector<double> ihc_cs;
+			std::vector<double> ohc_loss;
+			std::array<std::vector<Fiber>, 3> an_population;
+			double window_start;
+			size_t control_decimation;
+			bool use_tuning_profile;
+			std::optional<tuning::Schedule> schedule;
+			std::optional<planner::Budget> budget;
+			size_t n_bins;
+			size_t row_stride;
+			bool has_output;
+
+			[[nodiscard]] size_t output_size() const
+			{
+				return cfs.size() * row_stride * sizeof(double);
+			}
+		};
+
+		NeurogramHeader parse_neurogram(const std::string &header)
+		{
+			auto reader = open_header(header, ObjectType::NEUROGRAM);
+			NeurogramHeader result;
+			result.bin_width = reader.get<double>();
+			result.cfs = reader.get_vector();
+			result.db_loss = reader.get_vector();
+			result.coh_cs = reader.get_vector();
+			result.ihc_cs = reader.get_vector();
+			result.ohc_loss = reader.get_vector();
+			for (auto &fiber_set : result.an_population)
+				fiber_set = reader.get_fibers();
+			result.window_start = reader.get<double>();
+			result.control_decimation = reader.get<uint64_t>();
+			result.use_tuning_profile = reader.get<uint8_t>() != 0;
+			if (reader.get<uint8_t>() != 0)
+			{
+				tuning::Schedule schedule;
+				schedule.n_threads = reader.get<uint64_t>();
+				schedule.cf_block = reader.get<uint64_t>();
+				schedule.trials_per_task = reader.get<uint64_t>();
+				result.schedule = schedule;
+			}
+			if (reader.get<uint8_t>() != 0)
+				result.budget = planner::Budget{reader.get<double>()};
+			result.n_bins = reader.get<uint64_t>();
+			result.row_stride = reader.get<uint64_t>();
+			result.has_output = reader.get<uint8_t>() != 0;
+			// The rows of the output are copied before the neurogram checks its shape
+			if (result.has_output)
+			{
+				if (result.row_stride < result.n_bins)
+					throw std::runtime_error("serialize: row stride smaller than the number of bins");
+				if (!result.cfs.empty() && result.row_stride > SIZE_MAX / sizeof(double) / result.cfs.size())
+					throw std::runtime_error("serialize: output size overflows");
+			}
+			return result;
+		}
+
+		std::unique_ptr<Neurogram> make_neurogram(NeurogramHeader &&h, std::shared_ptr<double> output)
+		{
+			auto neurogram = std::make_unique<Neurogram>(
+				std::move(h.cfs), std::move(h.db_loss), std::move(h.coh_cs), std::move(h.ihc_cs), std::move(h.ohc_loss),
+				std::move(h.an_population), h.bin_width, std::move(output), h.n_bins, h.row_stride, h.window_start);
+			neurogram->control_decimation = h.control_decimation;
+			neurogram->use_tuning_profile = h.use_tuning_profile;
+			neurogram->schedule = h.schedule;
+			neurogram->budget = h.budget;
+			return neurogram;
+		}
+
+		template <typename T>
+		T read_value(std::istream &is)
+		{
+			T value;
+			if (!is.read(reinterpret_cast<char *>(&value), sizeof(T)))
+				throw std::runtime_error("serialize: unexpected end of stream");
+			return value;
+		}
+
+		void read_bytes(std::istream &is, void *data, const size_t size)
+		{
+			if (size != 0 && !is.read(static_cast<char *>(data), static_cast<std::streamsize>(size)))
+				throw std::runtime_error("serialize: unexpected end of stream");
+		}
+
+		//! An archive read from a stream, which owns its buffers
+		struct StoredArchive
+		{
+			std::string header;
+			std::vector<std::vector<double>> storage;
+			std::vector<Buffer> buffers;
+		};
+
+		StoredArchive read_archive(std::istream &is)
+		{
+			StoredArchive archive;
+			archive.header.resize(read_value<uint64_t>(is));
+			read_bytes(is, archive.header.data(), archive.header.size());
+
+			const auto n_buffers = read_value<uint64_t>(is);
+			for (uint64_t i = 0; i < n_buffers; i++)
+			{
+				const auto size = read_value<uint64_t>(is);
+				if (size % sizeof(double) != 0)
+					throw std::runtime_error("serialize: invalid buffer size");
+				auto &data = archive.storage.emplace_back(size / sizeof(double));
+				read_bytes(is, data.data(), size);
+			}
+			for (const auto &data : archive.storage)
+				archive.buffers.push_back(as_buffer(data));
+			return archive;
+		}
+	}
+
+	ObjectType get_type(const std::string &header)
+	{
+		Reader reader{header};
+		if (reader.get<uint32_t>() != MAGIC)
+			throw std::runtime_error("serialize: invalid magic number");
+		const auto version = reader.get<uint32_t>();
+		if (version != VERSION)
+			throw std::runtime_error("serialize: unsupported format version " + std::to_string(version));
+		const auto type = reader.get<uint32_t>();
+		if (type < static_cast<uint32_t>(ObjectType::STIMULUS) || type > static_cast<uint32_t>(ObjectType::NEUROGRAM))
+			throw std::runtime_error("serialize: invalid object type");
+		return static_cast<ObjectType>(type);
+	}
+
+	Archive archive(const stimulus::Stimulus &stim)
+	{
+		auto writer = start_header(ObjectType::STIMULUS);
+		writer.put<uint64_t>(stim.sampling_rate);
+		writer.put(stim.simulation_duration);
+		writer.put<uint64_t>(stim.data.size());
+		return {std::move(writer.data), {as_buffer(stim.data)}};
+	}
+
+	stimulus::Stimulus restore_stimulus(const std::string &header, const std::vector<Buffer> &buffers)
+	{
+		auto reader = open_header(header, ObjectType::STIMULUS);
+		const auto sampling_rate = reader.get<uint64_t>();
+		const auto simulation_duration = reader.get<double>();
+		const auto n = reader.get<uint64_t>();
+
+		check_n_buffers(buffers, 1);
+		std::vector<double> data;
+		copy_buffer(buffers[0], data, n);
+		return {std::move(data), sampling_rate, simulation_duration};
+	}
+
+	Archive archive(const syn::SynapseOutput &output)
+	{
+		const std::vector<const std::vector<double> *> fields = {
+			&output.psth, &output.synaptic_output, &output.redocking_time, &output.spike_times,
+			&output.mean_firing_rate, &output.variance_firing_rate, &output.mean_relative_refractory_period};
+
+		auto writer = start_header(ObjectType::SYNAPSE_OUTPUT);
+		writer.put<int32_t>(output.n_rep);
+		writer.put<int32_t>(output.n_timesteps);
+
+		Archive result;
+		for (const auto *field : fields)
+		{
+			writer.put<uint64_t>(field->size());
+			result.buffers.push_back(as_buffer(*field));
+		}
+		result.header = std::move(writer.data);
+		return result;
+	}
+
+	syn::SynapseOutput restore_synapse_output(const std::string &header, const std::vector<Buffer> &buffers)
+	{
+		auto reader = open_header(header, ObjectType::SYNAPSE_OUTPUT);
+		const auto n_rep = reader.get<int32_t>();
+		const auto n_timesteps = reader.get<int32_t>();
+		if (n_rep < 0 || n_timesteps < 0)
+			throw std::runtime_error("serialize: invalid synapse output dimensions");
+
+		syn::SynapseOutput output(n_rep, n_timesteps);
+		const std::vector<std::vector<double> *> fields = {
+			&output.psth, &output.synaptic_output, &output.redocking_time, &output.spike_times,
+			&output.mean_firing_rate, &output.variance_firing_rate, &output.mean_relative_refractory_period};
+
+		check_n_buffers(buffers, fields.size());
+		for (size_t i = 0; i < fields.size(); i++)
+			copy_buffer(buffers[i], *fields[i], reader.get<uint64_t>());
+		return output;
+	}
+
+	Archive archive(const Neurogram &neurogram)
+	{
+		const auto output = neurogram.get_output_buffer();
+		const auto n_cf = neurogram.get_cfs().size();
+
+		auto writer = start_header(ObjectType::NEUROGRAM);
+		writer.put(neurogram.bin_width);
+		writer.put(neurogram.get_cfs());
+		writer.put(neurogram.get_db_loss());
+		writer.put(neurogram.get_coh_cs());
+		writer.put(neurogram.get_ihc_cs());
+		writer.put(neurogram.get_ohc_loss());
+		for (const auto &fiber_set : neurogram.get_an_population())
+			writer.put(fiber_set);
+		writer.put(neurogram.window_start());
+		writer.put<uint64_t>(neurogram.control_decimation);
+		writer.put<uint8_t>(neurogram.use_tuning_profile);
+		writer.put<uint8_t>(neurogram.schedule.has_value());
+		if (neurogram.schedule)
+		{
+			writer.put<uint64_t>(neurogram.schedule->n_threads);
+			writer.put<uint64_t>(neurogram.schedule->cf_block);
+			writer.put<uint64_t>(neurogram.schedule->trials_per_task);
+		}
+		writer.put<uint8_t>(neurogram.budget.has_value());
+		if (neurogram.budget)
+			writer.put(neurogram.budget->max_relative_error);
+		writer.put<uint64_t>(neurogram.n_bins());
+		writer.put<uint64_t>(neurogram.row_stride());
+		writer.put<uint8_t>(output != nullptr);
+
+		Archive result{std::move(writer.data), {}};
+		if (output)
+			result.buffers.push_back({output.get(), n_cf * neurogram.row_stride() * sizeof(double)});
+		return result;
+	}
+
+	std::unique_ptr<Neurogram> restore_neurogram(
+		const std::string &header,
+		const std::vector<Buffer> &buffers,
+		std::shared_ptr<double> output)
+	{
+		auto h = parse_neurogram(header);
+		check_n_buffers(buffers, h.has_output);
+		if (!h.has_output)
+			return make_neurogram(std::move(h), nullptr);
+
+		if (buffers[0].size != h.output_size())
+			throw std::runtime_error("serialize: buffer size does not match header");
+
+		// Storage that is not aligned like that of create can not be adopted
+		const bool aligned = reinterpret_cast<uintptr_t>(output.get()) % Neurogram::ROW_ALIGNMENT == 0 &&
+							 h.row_stride * sizeof(double) % Neurogram::ROW_ALIGNMENT == 0;
+		if (!output || !aligned)
+		{
+			// Copy row by row, as the restored buffer may use a different row padding
+			size_t row_stride;
+			output = Neurogram::allocate_output(h.cfs.size(), h.n_bins, row_stride);
+			const auto *src = static_cast<const double *>(buffers[0].data);
+			for (size_t i = 0; i < h.cfs.size(); i++)
+				std::memcpy(output.get() + i * row_stride, src + i * h.row_stride, h.n_bins * sizeof(double));
+			h.row_stride = row_stride;
+		}
+		return make_neurogram(std::move(h), std::move(output));
+	}
+
+	void write(std::ostream &os, const Archive &archive)
+	{
+		const auto put = [&os](const void *data, const size_t size)
+		{ os.write(static_cast<const char *>(data), static_cast<std::streamsize>(size)); };
+
+		const uint64_t header_size = archive.header.size();
+		put(&header_size, sizeof(header_size));
+		put(archive.header.data(), archive.header.size());
+
+		const uint64_t n_buffers = archive.buffers.size();
+		put(&n_buffers, sizeof(n_buffers));
+		for (const auto &buffer : archive.buffers)
+		{
+			const uint64_t size = buffer.size;
+			put(&size, sizeof(size));
+			put(buffer.data, buffer.size);
+		}
+		if (!os)
+			throw std::runtime_error("serialize: failed to write to stream");
+	}
+
+	stimulus::Stimulus read_stimulus(std::istream &is)
+	{
+		const auto archive = read_archive(is);
+		return restore_stimulus(archive.header, archive.buffers);
+	}
+
+	syn::SynapseOutput read_synapse_output(std::istream &is)
+	{
+		const auto archive = read_archive(is);
+		return restore_synapse_output(archive.header, archive.buffers);
+	}
+
+	std::unique_ptr<Neurogram> read_neurogram(std::istream &is)
+	{
+		std::string header(read_value<uint64_t>(is), '\0');
+		read_bytes(is, header.data(), header.size());
+		auto h = parse_neurogram(header);
+
+		if (read_value<uint64_t>(is) != static_cast<uint64_t>(h.has_output))
+			throw std::runtime_error("serialize: unexpected number of buffers");
+		if (!h.has_output)
+			return make_neurogram(std::move(h), nullptr);
+
+		if (read_value<uint64_t>(is) != h.output_size())
+			throw std::runtime_error("serialize: buffer size does not match header");
+
+		// Read the output straight into aligned storage, skipping the intermediate copy of read_archive
+		size_t row_stride;
+		auto output = Neurogram::allocate_output(h.cfs.size(), h.n_bins, row_stride);
+		if (row_stride == h.row_stride)
+		{
+			read_bytes(is, output.get(), h.output_size());
+		}
+		else
+		{
+			std::vector<double> row(h.row_stride);
+			for (size_t i = 0; i < h.cfs.size(); i++)
+			{
+				read_bytes(is, row.data(), row.size() * sizeof(double));
+				std::memcpy(output.get() + i * row_stride, row.data(), h.n_bins * sizeof(double));
+			}
+			h.row_stride = row_stride;
+		}
+		return make_neurogram(std::move(h), std::move(output));
+	}
+}
@@ -0,0 +1,157 @@
+#include "shared_memory.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define BRUCE_POSIX_SHM
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace shared_memory
+{
+	struct Segment::Header
+	{
+		uint64_t magic;
+		uint64_t size;
+		std::atomic<uint64_t> ref_count;
+	};
+
+	namespace
+	{
+		constexpr uint64_t MAGIC = 0x4d48534543555242; // "BRUCESHM"
+
+		[[noreturn]] void fail(const std::string &what, const std::string &name)
+		{
+			throw std::runtime_error("shared_memory: " + what + " " + name + ": " + std::strerror(errno));
+		}
+
+		std::string unique_name()
+		{
+			static std::atomic<uint64_t> counter{0};
+			static const uint64_t salt = std::random_device()();
+#ifdef BRUCE_POSIX_SHM
+			const auto pid = static_cast<uint64_t>(getpid());
+#else
+			const uint64_t pid = 0;
+#endif
+			// Names are kept short, as macOS limits them to 31 characters
+			return "/bruce-" + std::to_string(pid) + "-" + std::to_string(salt % 100000) + "-" + std::to_string(counter++);
+		}
+	}
+
+	Segment::Segment(std::string name, const size_t size, const bool create, const bool adopt_reference) : name_(std::move(name))
+	{
+		static_assert(sizeof(Header) <= DATA_OFFSET);
+		static_assert(std::atomic<uint64_t>::is_always_lock_free, "the reference count must be lock-free to be shared between processes");
+
+#ifdef BRUCE_POSIX_SHM
+		const int fd = shm_open(name_.c_str(), create ? O_CREAT | O_EXCL | O_RDWR : O_RDWR, 0600);
+		if (fd < 0)
+			fail(create ? "cannot create" : "cannot open", name_);
+
+		size_t mapped_size = DATA_OFFSET + size;
+		if (create)
+		{
+			if (ftruncate(fd, static_cast<off_t>(mapped_size)) != 0)
+			{
+				close(fd);
+				shm_unlink(name_.c_str());
+				fail("cannot resize", name_);
+			}
+		}
+		else
+		{
+			struct stat st{};
+			if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < DATA_OFFSET)
+			{
+				close(fd);
+				throw std::runtime_error("shared_memory: invalid segment " + name_);
+			}
+			mapped_size = static_cast<size_t>(st.st_size);
+		}
+
+		void *base = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (base == MAP_FAILED)
+		{
+			if (create)
+				shm_unlink(name_.c_str());
+			fail("cannot map", name_);
+		}
+
+		header_ = static_cast<Header *>(base);
+		if (create)
+		{
+			// ftruncate zero-fills, so only the header needs to be written
+			header_->magic = MAGIC;
+			header_->size = size;
+			new (&header_->ref_count) std::atomic<uint64_t>(1);
+		}
+		else if (header_->magic != MAGIC || header_->size + DATA_OFFSET > mapped_size)
+		{
+			munmap(base, mapped_size);
+			throw std::runtime_error("shared_memory: invalid segment " + name_);
+		}
+		else if (!adopt_reference && header_->ref_count.fetch_add(1) == 0)
+		{
+			// The last reference was released concurrently, the segment is being destroyed
+			header_->ref_count.fetch_sub(1);
+			munmap(base, mapped_size);
+			throw std::runtime_error("shared_memory: segment " + name_ + " was released");
+		}
+		size_ = header_->size;
+#else
+		(void)size;
+		(void)create;
+		(void)adopt_reference;
+		throw std::runtime_error("shared_memory: not supported on this platform");
+#endif
+	}
+
+	Segment::~Segment()
+	{
+#ifdef BRUCE_POSIX_SHM
+		if (header_->ref_count.fetch_sub(1) == 1)
+			shm_unlink(name_.c_str());
+		munmap(header_, DATA_OFFSET + size_);
+#endif
+	}
+
+	std::shared_ptr<Segment> Segment::make_shared(Segment *segment)
+	{
+		return std::shared_ptr<Segment>(segment, Deleter{segment});
+	}
+
+	std::shared_ptr<Segment> Segment::create(const size_t size)
+	{
+		return make_shared(new Segment(unique_name(), size, true, false));
+	}
+
+	std::shared_ptr<Segment> Segment::open(const std::string &name, const bool adopt_reference)
+	{
+		return make_shared(new Segment(name, 0, false, adopt_reference));
+	}
+
+	void Segment::retain() const
+	{
+		header_->ref_count.fetch_add(1);
+	}
+
+	size_t Segment::ref_count() const
+	{
+		return header_->ref_count.load();
+	}
+
+	void *Segment::data() const
+	{
+		return reinterpret_cast<char *>(header_) + DATA_OFFSET;
+	}
+}
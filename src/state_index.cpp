@@ -0,0 +1,133 @@
+#include "state_index.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace state_index
+{
+	namespace
+	{
+		constexpr char MAGIC[8] = {'B', 'R', 'C', 'E', 'I', 'D', 'X', '\0'};
+		constexpr uint32_t VERSION = 4;
+		//! Written after the version, read back differently on a host with another byte order
+		constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+		template <typename T>
+		void put(std::ostream &os, const T value)
+		{
+			os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+		}
+
+		void put(std::ostream &os, const std::vector<double> &values)
+		{
+			put<uint64_t>(os, values.size());
+			os.write(reinterpret_cast<const char *>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(double)));
+		}
+
+		template <typename T>
+		T get(std::istream &is)
+		{
+			T value;
+			if (!is.read(reinterpret_cast<char *>(&value), sizeof(T)))
+				throw std::runtime_error("truncated state index");
+			return value;
+		}
+
+		std::vector<double> get_vector(std::istream &is)
+		{
+			const auto n = get<uint64_t>(is);
+			if (n > (uint64_t{1} << 32))
+				throw std::runtime_error("malformed state index");
+			std::vector<double> values(n);
+			if (!is.read(reinterpret_cast<char *>(values.data()), static_cast<std::streamsize>(n * sizeof(double))))
+				throw std::runtime_error("truncated state index");
+			return values;
+		}
+	}
+
+	const Snapshot &Index::before(const size_t sample) const
+	{
+		if (snapshots.empty())
+			throw std::invalid_argument("the state index holds no snapshots");
+		const auto it = std::upper_bound(snapshots.begin(), snapshots.end(), sample, [](const size_t s, const Snapshot &snapshot)
+										 { return s < snapshot.sample; });
+		return it == snapshots.begin() ? *it : *(it - 1);
+	}
+
+	void Index::save(const std::string &path) const
+	{
+		std::ofstream os(path, std::ios::binary);
+		if (!os)
+			throw std::runtime_error("cannot write state index to " + path);
+
+		os.write(MAGIC, sizeof(MAGIC));
+		put(os, VERSION);
+		put(os, BYTE_ORDER_MARK);
+		put(os, time_resolution);
+		put<uint32_t>(os, species);
+		put(os, cfs);
+		put(os, coh_cs);
+		put(os, ihc_cs);
+		put<uint64_t>(os, control_decimation);
+		put<int32_t>(os, seed);
+		put<uint64_t>(os, interval);
+		put<uint64_t>(os, n_samples);
+		put<uint64_t>(os, snapshots.size());
+		for (const auto &snapshot : snapshots)
+		{
+			put<uint64_t>(os, snapshot.sample);
+			for (const auto &model : snapshot.models)
+				model.write_state(os);
+		}
+		if (!os)
+			throw std::runtime_error("cannot write state index to " + path);
+	}
+
+	Index Index::load(const std::string &path)
+	{
+		std::ifstream is(path, std::ios::binary);
+		if (!is)
+			throw std::runtime_error("cannot read state index " + path);
+
+		char magic[sizeof(MAGIC)];
+		if (!is.read(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || get<uint32_t>(is) != VERSION)
+			throw std::runtime_error("not a state index (version " + std::to_string(VERSION) + "): " + path);
+		if (get<uint32_t>(is) != BYTE_ORDER_MARK)
+			throw std::runtime_error("state index written on a host with another byte order: " + path);
+
+		Index index;
+		index.time_resolution = get<double>(is);
+		const auto species = get<uint32_t>(is);
+		if (species < CAT || species > HUMAN_GLASSBERG_MOORE)
+			throw std::runtime_error("malformed state index " + path);
+		index.species = static_cast<Species>(species);
+		index.cfs = get_vector(is);
+		index.coh_cs = get_vector(is);
+		index.ihc_cs = get_vector(is);
+		if (index.coh_cs.size() != index.cfs.size() || index.ihc_cs.size() != index.cfs.size())
+			throw std::runtime_error("malformed state index " + path);
+		index.control_decimation = get<uint64_t>(is);
+		if (index.control_decimation < 1 || index.control_decimation > ihc::MAX_CONTROL_DECIMATION)
+			throw std::runtime_error("malformed state index " + path);
+		index.seed = get<int32_t>(is);
+		index.interval = get<uint64_t>(is);
+		index.n_samples = get<uint64_t>(is);
+
+		const auto n_snapshots = get<uint64_t>(is);
+		for (uint64_t i = 0; i < n_snapshots; i++)
+		{
+			Snapshot snapshot;
+			snapshot.sample = get<uint64_t>(is);
+			for (size_t cf_i = 0; cf_i < index.cfs.size(); cf_i++)
+			{
+				snapshot.models.emplace_back(index.time_resolution, index.cfs[cf_i], index.coh_cs[cf_i], index.ihc_cs[cf_i], index.species, index.control_decimation);
+				snapshot.models.back().read_state(is);
+			}
+			index.snapshots.push_back(std::move(snapshot));
+		}
+		return index;
+	}
+}
@@ -48,6 +48,7 @@ namespace syn
 
 
 	template <size_t nSites>
+	BRUCE_TARGET_CLONES
 	int spike_generator(
 		const double time_resolution,
 		const double spontaneous_firing_rate,
@@ -62,39 +63,55 @@ namespace syn
 		const double t_rd_init = t_rd_rest + 0.02e-3 * spontaneous_firing_rate - t_rd_jump;
 		/* Initial value of the mean redocking time */
 
-		std::array<double, nSites> elapsed_time{};
-		std::array<double, nSites> previous_release_times{};
-		std::array<double, nSites> previous_release_times_bins{};
-		std::array<double, nSites> current_release_times{};
-		std::array<double, nSites> one_site_redocking{};
+		/* The state of the release sites is kept in integer time steps (ticks): a release happens at a time step,
+		 * so the release times are ticks, and the durations that are drawn (redocking and refractory times, and
+		 * the unit rate intervals) are converted to ticks once, when they are drawn, rather than every step */
+		const double steps_per_second = 1.0 / time_resolution;
+		const double redocking_decay = time_resolution / tau;
+
+		std::array<int, nSites> initial_release_ticks{};
+		std::array<int, nSites> previous_release_ticks{};
+		std::array<int, nSites> elapsed_ticks{};
+		/* The redocking of a site occurs after floor(redocking time) elapsed ticks, and the site senses the input
+		 * once ceil(redocking time) ticks have elapsed */
+		std::array<int, nSites> redocking_ticks{};
+		std::array<int, nSites> sensing_ticks{};
+		/* The integral of the synaptic output since the last release of a site, and the threshold at which the
+		 * site releases: its unit rate interval in time steps, times nSites, as each site senses 1/nSites of the
+		 * rate */
 		std::array<double, nSites> x_sum{};
-		std::array<double, nSites> unit_rate_interval{};
+		std::array<double, nSites> release_threshold{};
 
+		const auto draw_redocking = [&](const size_t site, const double redocking_period)
+		{
+			const double redocking_time = -redocking_period * log(utils::rand1()) * steps_per_second;
+			redocking_ticks[site] = static_cast<int>(redocking_time);
+			sensing_ticks[site] = static_cast<int>(ceil(redocking_time));
+		};
 
 		/* Initial  preRelease_initialGuessTimeBins associated to nsites release sites */
 		for (size_t i = 0; i < nSites; i++)
 		{
-			one_site_redocking[i] = -t_rd_init * log(utils::rand1());
-			previous_release_times_bins[i] = std::max(static_cast<double>(-res.n_total_timesteps),
+			draw_redocking(i, t_rd_init);
+			initial_release_ticks[i] = static_cast<int>(std::max(static_cast<double>(-res.n_total_timesteps),
 				ceil((nSites / std::max(res.synaptic_output[0], 0.1) + t_rd_init)
-					* log(utils::rand1()) / time_resolution));
+					* log(utils::rand1()) * steps_per_second)));
 		}
 
-		std::sort(previous_release_times_bins.begin(), previous_release_times_bins.end());
-
-		/* Consider the initial previous_release_times to be  the preReleaseTimeBinsSorted *time_resolution */
-		for (size_t i = 0; i < nSites; i++)
-			previous_release_times[i] = previous_release_times_bins[i] * time_resolution;
+		std::sort(initial_release_ticks.begin(), initial_release_ticks.end());
 
+		/* Consider the initial previous release times to be the sorted initial guesses */
+		previous_release_ticks = initial_release_ticks;
 
 		/* The position of first spike, also where the process is started - continued from the past */
-		const int k_init = static_cast<int>(previous_release_times_bins[0]);
+		const int k_init = initial_release_ticks[0];
 
-		/* Current refractory time */
-		double t_ref = abs_refractory_period - rel_refractory_period * log(utils::rand1());
+		/* The initial refractory time is not used, it is drawn such that the random stream is that of the
+		 * reference implementation */
+		utils::rand1();
 
-		/*initial refractory regions */
-		double current_refractory_period = static_cast<double>(k_init) * time_resolution;
+		/* End of the current refractory period, releases before it do not spike */
+		int refractory_end_tick = k_init;
 
 		int spike_count = 0;
 
@@ -108,16 +125,12 @@ namespace syn
 
 		for (int k = k_init; k < res.n_total_timesteps; ++k)
 		{
+			const double synaptic_output = res.synaptic_output[std::max(0, k)];
 			for (size_t site_no = 0; site_no < nSites; site_no++)
 			{
-				if (k > previous_release_times_bins[site_no])
+				if (k > initial_release_ticks[site_no])
 				{
-					/* redocking times do not necessarily occur exactly at time step value - calculate the
-					 * number of integer steps for the elapsed time and redocking time */
-					const int one_site_redocking_rounded = static_cast<int>(one_site_redocking[site_no] /
-						time_resolution);
-					const int elapsed_time_rounded = static_cast<int>(elapsed_time[site_no] / time_resolution);
-					if (one_site_redocking_rounded == elapsed_time_rounded)
+					if (redocking_ticks[site_no] == elapsed_ticks[site_no])
 					{
 						/* Jump  trd by t_rd_jump if a redocking event has occurred   */
 						current_redocking_period = previous_redocking_period + t_rd_jump;
@@ -128,58 +141,51 @@ namespace syn
 
 					/* to be sure that for each site , the code start from its
 					 * associated previous release time :*/
-					elapsed_time[site_no] = elapsed_time[site_no] + time_resolution;
+					++elapsed_ticks[site_no];
 				}
 
 
 				/*the elapsed time passes  the one time redocking (the redocking is finished),
 				 * In this case the synaptic vesicle starts sensing the input
 				 * for each site integration starts after the redocking is finished for the corresponding site)*/
-				if (elapsed_time[site_no] >= one_site_redocking[site_no])
-				{
-					x_sum[site_no] = x_sum[site_no] + res.synaptic_output[std::max(0, k)] / nSites;
-					/* There are  nSites integrals each vesicle senses 1/ nosites of  the whole rate */
-				}
+				if (elapsed_ticks[site_no] >= sensing_ticks[site_no])
+					x_sum[site_no] += synaptic_output;
 
-				if ((x_sum[site_no] >= unit_rate_interval[site_no]) && (k >= previous_release_times_bins[site_no]))
+				if ((x_sum[site_no] >= release_threshold[site_no]) && (k >= initial_release_ticks[site_no]))
 				{
 					/* An event- a release  happened for the siteNo*/
 
-					one_site_redocking[site_no] = -current_redocking_period * log(utils::rand1());
-					current_release_times[site_no] = previous_release_times[site_no] + elapsed_time[site_no];
-					elapsed_time[site_no] = 0;
+					draw_redocking(site_no, current_redocking_period);
+					const int release_tick = previous_release_ticks[site_no] + elapsed_ticks[site_no];
+					elapsed_ticks[site_no] = 0;
 
-					if ((current_release_times[site_no] >= current_refractory_period))
+					if (release_tick >= refractory_end_tick)
 					{
-						if (current_release_times[site_no] >= 0)
+						if (release_tick >= 0)
 						{
-							const auto spike_time = current_release_times[site_no];
-							const auto spike_index = static_cast<int>(fmod(
-								spike_time, time_resolution * res.n_timesteps) / time_resolution);
-							res.spike_times.push_back(spike_time);
-							++res.psth[spike_index];
+							res.spike_times.push_back(release_tick * time_resolution);
+							++res.psth[release_tick % res.n_timesteps];
 							spike_count++;
 						}
 
-						const double t_rel_k = std::min(
-							rel_refractory_period * 100 / res.synaptic_output[std::max(0, k)], rel_refractory_period);
+						const double t_rel_k = std::min(rel_refractory_period * 100 / synaptic_output, rel_refractory_period);
 
-						t_ref = abs_refractory_period - t_rel_k * log(utils::rand1());
+						const double t_ref = abs_refractory_period - t_rel_k * log(utils::rand1());
 
-						current_refractory_period = current_release_times[site_no] + t_ref;
+						refractory_end_tick = release_tick + static_cast<int>(ceil(t_ref * steps_per_second));
 					}
 
-					previous_release_times[site_no] = current_release_times[site_no];
+					previous_release_ticks[site_no] = release_tick;
 
 					x_sum[site_no] = 0;
-					unit_rate_interval[site_no] = static_cast<int>(-log(utils::rand1()) / time_resolution);
+					release_threshold[site_no] = static_cast<double>(static_cast<int>(-log(utils::rand1()) * steps_per_second)) * nSites;
 				}
 			}
 
 			/* Decay the adaptive mean redocking time towards the resting value if no redocking events occurred in this time step */
 			if ((t_rd_decay == 1) && (rd_first == 1))
 			{
-				current_redocking_period = previous_redocking_period - (time_resolution / tau) * (
+				current_redocking_period = previous_redocking_period - redocking_decay * (
 					previous_redocking_period -
 					t_rd_rest);
 				previous_redocking_period = current_redocking_period;
@@ -195,6 +201,8 @@ namespace syn
 		return spike_count;
 	}
 
+	template int spike_generator<4>(double, double, double, double, SynapseOutput&);
+
 	double instantaneous_variance(const double synaptic_output, const double redocking_time, const double absolute_refractory_period, const double relative_refractory_period)
 	{
 		const double s2 = synaptic_output * synaptic_output;
@@ -262,8 +270,9 @@ namespace syn
 }
 
 
+template <typename T>
 syn::SynapseOutput synapse(
-	const std::vector<double>& amplitude_ihc, // resampled power law mapping of ihc output, see map_to_synapse
+	const utils::Span<T> amplitude_ihc, // resampled power law mapping of ihc output, see map_to_synapse
 	const double cf,
 	const int n_rep,
 	const size_t n_timesteps,
@@ -291,11 +300,14 @@ syn::SynapseOutput synapse(
 	const auto pla_out = pla::power_law(amplitude_ihc, noise, pla_impl, spontaneous_firing_rate, sampling_frequency,
 		delay_point, time_resolution, res.n_total_timesteps);
 
-	up_sample_synaptic_output(pla_out, time_resolution, sampling_frequency, delay_point, res);
-
+	{
+		BRUCE_PROFILE_SCOPE(profiler::UPSAMPLE);
+		up_sample_synaptic_output(pla_out, time_resolution, sampling_frequency, delay_point, res);
+	}
 
 	///*======  Synaptic Release/Spike Generation Parameters ======*/
 	constexpr int n_sites = 4; /* Number of synaptic release sites */
+	BRUCE_PROFILE_SCOPE(profiler::SPIKE_GENERATION);
 	const int n_spikes = syn::spike_generator<n_sites>(time_resolution, spontaneous_firing_rate, abs_refractory_period,
 		rel_refractory_period, res);
 
@@ -305,3 +317,124 @@ syn::SynapseOutput synapse(
 
 	return res;
 }
+
+template syn::SynapseOutput synapse<double>(utils::Span<double>, double, int, size_t, double, NoiseType, PowerLaw, double, double, double, bool);
+template syn::SynapseOutput synapse<float>(utils::Span<float>, double, int, size_t, double, NoiseType, PowerLaw, double, double, double, bool);
+
+syn::SynapseOutput synapse(
+	const std::vector<double>& amplitude_ihc,
+	const double cf,
+	const int n_rep,
+	const size_t n_timesteps,
+	const double time_resolution,
+	const NoiseType noise,
+	const PowerLaw pla_impl,
+	const double spontaneous_firing_rate,
+	const double abs_refractory_period,
+	const double rel_refractory_period,
+	const bool calculate_stats
+)
+{
+	return synapse(utils::Span<double>(amplitude_ihc), cf, n_rep, n_timesteps, time_resolution, noise, pla_impl,
+		spontaneous_firing_rate, abs_refractory_period, rel_refractory_period, calculate_stats);
+}
+
+template <typename T>
+syn::SynapseBatchOutput synapse_batch(
+	const utils::Span<T> input,
+	const double cf,
+	const utils::Span<double> spontaneous_firing_rates,
+	const utils::Span<double> abs_refractory_periods,
+	const utils::Span<double> rel_refractory_periods,
+	const int n_trials,
+	const int n_rep,
+	size_t n_timesteps,
+	const double time_resolution,
+	const NoiseType noise,
+	const PowerLaw pla_impl,
+	const bool map_input,
+	const SynapseMapping mapping_function,
+	const size_t n_bins,
+	const bool store_spikes
+)
+{
+	const size_t n_fibers = spontaneous_firing_rates.size();
+	if (abs_refractory_periods.size() != n_fibers || rel_refractory_periods.size() != n_fibers)
+		throw std::invalid_argument("spontaneous_firing_rates, abs_refractory_periods and rel_refractory_periods should have equal size");
+
+	utils::validate_parameter(n_trials, 1, std::numeric_limits<int>::max(), "n_trials");
+	utils::validate_parameter(n_rep, 1, std::numeric_limits<int>::max(), "n_rep");
+
+	if (n_timesteps == 0)
+	{
+		if (!map_input)
+			throw std::invalid_argument("n_timesteps should be given when the input is already mapped");
+		n_timesteps = input.size() / static_cast<size_t>(n_rep);
+	}
+	utils::validate_parameter(n_bins, size_t{ 0 }, n_timesteps, "n_bins");
+
+	const size_t n_rows = n_fibers * static_cast<size_t>(n_trials);
+
+	syn::SynapseBatchOutput res{ n_fibers, static_cast<size_t>(n_trials), n_bins == 0 ? n_timesteps : n_bins, {}, {}, {} };
+	if (!store_spikes)
+		res.psth.resize(n_rows * res.n_bins);
+
+	// The mapped input only depends on the spontaneous rate, so it is shared by fibers with the same rate
+	std::vector<double> unique_sponts;
+	std::vector<size_t> spont_index(n_fibers);
+	std::vector<std::vector<double>> mapped_inputs;
+	if (map_input)
+	{
+		unique_sponts.assign(spontaneous_firing_rates.begin(), spontaneous_firing_rates.end());
+		std::sort(unique_sponts.begin(), unique_sponts.end());
+		unique_sponts.erase(std::unique(unique_sponts.begin(), unique_sponts.end()), unique_sponts.end());
+
+		for (size_t f = 0; f < n_fibers; f++)
+			spont_index[f] = std::lower_bound(unique_sponts.begin(), unique_sponts.end(), spontaneous_firing_rates[f]) - unique_sponts.begin();
+
+		mapped_inputs.resize(unique_sponts.size());
+		utils::parallel_for(unique_sponts.size(), [&](const size_t i)
+		{
+			mapped_inputs[i] = synapse_mapping::map(input, unique_sponts[i], cf, time_resolution, mapping_function);
+		});
+	}
+
+	// Every row draws from a generator of its own, so the output does not depend on the scheduling of the rows
+	const int seed = utils::SEED;
+	std::vector<std::vector<double>> spike_times(store_spikes ? n_rows : 0);
+	utils::parallel_for(n_rows, [&](const size_t r)
+	{
+		utils::GeneratorScope generator(seed, r);
+		const size_t f = r / static_cast<size_t>(n_trials);
+		auto out = map_input
+			? synapse(utils::Span<double>(mapped_inputs[spont_index[f]]), cf, n_rep, n_timesteps, time_resolution, noise, pla_impl,
+				spontaneous_firing_rates[f], abs_refractory_periods[f], rel_refractory_periods[f], false)
+			: synapse(input, cf, n_rep, n_timesteps, time_resolution, noise, pla_impl,
+				spontaneous_firing_rates[f], abs_refractory_periods[f], rel_refractory_periods[f], false);
+
+		if (store_spikes)
+			spike_times[r] = std::move(out.spike_times);
+		else if (n_bins == 0)
+			std::copy(out.psth.begin(), out.psth.end(), res.psth.begin() + r * res.n_bins);
+		else
+		{
+			const auto binned = utils::make_bins(out.psth, n_bins);
+			std::copy(binned.begin(), binned.end(), res.psth.begin() + r * res.n_bins);
+		}
+	});
+
+	if (store_spikes)
+	{
+		res.spike_offsets.resize(n_rows + 1, 0);
+		for (size_t r = 0; r < n_rows; r++)
+			res.spike_offsets[r + 1] = res.spike_offsets[r] + spike_times[r].size();
+
+		res.spike_times.reserve(res.spike_offsets.back());
+		for (const auto& st : spike_times)
+			res.spike_times.insert(res.spike_times.end(), st.begin(), st.end());
+	}
+	return res;
+}
+
+template syn::SynapseBatchOutput synapse_batch<double>(utils::Span<double>, double, utils::Span<double>, utils::Span<double>, utils::Span<double>, int, int, size_t, double, NoiseType, PowerLaw, bool, SynapseMapping, size_t, bool);
+template syn::SynapseBatchOutput synapse_batch<float>(utils::Span<float>, double, utils::Span<double>, utils::Span<double>, utils::Span<double>, int, int, size_t, double, NoiseType, PowerLaw, bool, SynapseMapping, size_t, bool);
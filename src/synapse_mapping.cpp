@@ -1,3 +1,4 @@
+#include "dispatch.h"
 #include "resample.h"
 #include "synapse_mapping.h"
 
@@ -59,8 +60,10 @@ namespace synapse_mapping
 		}
 	}
 
+	template <typename T>
+	BRUCE_TARGET_CLONES
 	std::vector<double> map(
-		const std::vector<double>& ihc_output,
+		const utils::Span<T> ihc_output,
 		const double spontaneous_firing_rate,
 		const double characteristic_frequency,
 		const double time_resolution,
@@ -93,4 +96,18 @@ namespace synapse_mapping
 		const int down_factor = static_cast<int>(ceil(1 / (time_resolution * sampling_frequency)));
 		return resample(1, down_factor, output_signal);
 	}
+
+	template std::vector<double> map<double>(utils::Span<double>, double, double, double, SynapseMapping);
+	template std::vector<double> map<float>(utils::Span<float>, double, double, double, SynapseMapping);
+
+	std::vector<double> map(
+		const std::vector<double>& ihc_output,
+		const double spontaneous_firing_rate,
+		const double characteristic_frequency,
+		const double time_resolution,
+		const SynapseMapping mapping_function
+	)
+	{
+		return map(utils::Span<double>(ihc_output), spontaneous_firing_rate, characteristic_frequency, time_resolution, mapping_function);
+	}
 }
@@ -0,0 +1,125 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+
+namespace trace
+{
+	namespace
+	{
+		std::mutex registry_mutex;
+		std::vector<std::shared_ptr<RingBuffer>> registry;
+		uint32_t next_thread_id = 0;
+		std::atomic<size_t> capacity{1 << 15};
+
+		RingBuffer &buffer()
+		{
+			thread_local std::shared_ptr<RingBuffer> buffer = []()
+			{
+				std::lock_guard<std::mutex> lock(registry_mutex);
+				auto b = std::make_shared<RingBuffer>(capacity.load(), next_thread_id++);
+				registry.push_back(b);
+				return b;
+			}();
+			return *buffer;
+		}
+	}
+
+	RingBuffer::RingBuffer(const size_t capacity, const uint32_t thread_id)
+		: events_(size_t{1} << static_cast<size_t>(std::ceil(std::log2(std::max<size_t>(capacity, 2))))), thread_id_(thread_id)
+	{
+	}
+
+	std::vector<Event> RingBuffer::events() const
+	{
+		const uint64_t head = head_.load(std::memory_order_acquire);
+		const uint64_t n = std::min<uint64_t>(head, events_.size());
+		std::vector<Event> result;
+		result.reserve(n);
+		for (uint64_t i = head - n; i < head; i++)
+			result.push_back(events_[i & (events_.size() - 1)]);
+		return result;
+	}
+
+	uint64_t RingBuffer::n_dropped() const
+	{
+		const uint64_t head = head_.load(std::memory_order_acquire);
+		return head > events_.size() ? head - events_.size() : 0;
+	}
+
+	void emit(const Event &event)
+	{
+		buffer().push(event);
+	}
+
+	void set_capacity(const size_t n)
+	{
+		capacity = n;
+	}
+
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		// Buffers only referenced by the registry belong to threads that have exited
+		registry.erase(std::remove_if(registry.begin(), registry.end(), [](const std::shared_ptr<RingBuffer> &b)
+									  { return b.use_count() == 1; }),
+					   registry.end());
+		for (const auto &b : registry)
+			b->clear();
+	}
+
+	void write_chrome_trace(std::ostream &os, const double seconds_per_tick)
+	{
+		std::vector<std::pair<uint32_t, std::vector<Event>>> threads;
+		uint64_t n_dropped = 0;
+		{
+			std::lock_guard<std::mutex> lock(registry_mutex);
+			for (const auto &b : registry)
+			{
+				threads.emplace_back(b->thread_id(), b->events());
+				n_dropped += b->n_dropped();
+			}
+		}
+
+		uint64_t origin = std::numeric_limits<uint64_t>::max();
+		for (const auto &[tid, events] : threads)
+			for (const auto &e : events)
+				origin = std::min(origin, e.begin);
+
+		const double us_per_tick = seconds_per_tick * 1e6;
+		os << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\": \"ms\", \"otherData\": {\"dropped_events\": "
+		   << n_dropped << "}, \"traceEvents\": [";
+		bool first = true;
+		for (const auto &[tid, events] : threads)
+		{
+			if (events.empty())
+				continue;
+			os << (first ? "\n" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << tid
+			   << ", \"args\": {\"name\": \"thread " << tid << "\"}}";
+			first = false;
+			for (const auto &e : events)
+			{
+				os << ",\n{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << tid
+				   << ", \"ts\": " << static_cast<double>(e.begin - origin) * us_per_tick
+				   << ", \"dur\": " << static_cast<double>(e.end - e.begin) * us_per_tick;
+				if (e.cf >= 0)
+					os << ", \"args\": {\"cf\": " << e.cf << "}";
+				os << "}";
+			}
+		}
+		os << "\n]}\n";
+	}
+
+	void write_chrome_trace(const std::string &path, const double seconds_per_tick)
+	{
+		std::ofstream os(path);
+		if (!os)
+			throw std::runtime_error("cannot write trace to " + path);
+		write_chrome_trace(os, seconds_per_tick);
+	}
+}
@@ -0,0 +1,246 @@
+#include "tuning.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "neurogram.h"
+#include "stimulus.h"
+
+namespace tuning
+{
+	namespace
+	{
+		constexpr const char *FORMAT = "bruce-tuning-profile";
+		constexpr int VERSION = 1;
+
+		std::mutex active_mutex;
+		bool active_loaded = false;
+		std::shared_ptr<const Profile> active;
+
+		double log_ratio(const size_t a, const size_t b)
+		{
+			return std::log(static_cast<double>(std::max<size_t>(a, 1)) / static_cast<double>(std::max<size_t>(b, 1)));
+		}
+
+		std::vector<size_t> default_thread_counts()
+		{
+			const size_t n_cores = std::max<size_t>(1, std::thread::hardware_concurrency());
+			std::vector<size_t> counts;
+			for (size_t p = 1; p < n_cores; p *= 2)
+				counts.push_back(p);
+			counts.push_back(n_cores);
+			return counts;
+		}
+
+		std::vector<Shape> default_shapes()
+		{
+			return {{8, 5, 5000, 1}, {64, 5, 5000, 1}, {4, 50, 5000, 1}, {4, 5, 5000, 20}, {8, 5, 50000, 1}};
+		}
+
+		//! The fastest of repetitions runs of create with a schedule, in seconds
+		double time_schedule(Neurogram &ng, const stimulus::Stimulus &stim, const Shape &shape, const Schedule &schedule, const size_t repetitions)
+		{
+			ng.schedule = schedule;
+			double best = std::numeric_limits<double>::infinity();
+			for (size_t i = 0; i < std::max<size_t>(repetitions, 1); i++)
+			{
+				const auto start = std::chrono::steady_clock::now();
+				ng.create(stim, 1, static_cast<int>(shape.n_trials), HUMAN_SHERA, RANDOM, APPROXIMATED);
+				best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+			}
+			return best;
+		}
+	}
+
+	double Shape::distance(const Shape &other) const
+	{
+		const double d[] = {log_ratio(n_cf, other.n_cf), log_ratio(n_fibers, other.n_fibers),
+							log_ratio(n_samples, other.n_samples), log_ratio(n_trials, other.n_trials)};
+		return std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2] + d[3] * d[3]);
+	}
+
+	Profile::Profile(std::string machine) : machine_(std::move(machine))
+	{
+	}
+
+	void Profile::add(const Entry &entry)
+	{
+		for (auto &e : entries_)
+			if (e.shape.distance(entry.shape) == 0.0)
+			{
+				e = entry;
+				return;
+			}
+		entries_.push_back(entry);
+	}
+
+	std::optional<Schedule> Profile::lookup(const Shape &shape) const
+	{
+		const Entry *nearest = nullptr;
+		for (const auto &e : entries_)
+			if (!nearest || e.shape.distance(shape) < nearest->shape.distance(shape))
+				nearest = &e;
+		if (!nearest)
+			return std::nullopt;
+		return nearest->schedule;
+	}
+
+	void Profile::save(const std::string &path) const
+	{
+		const auto directory = std::filesystem::path(path).parent_path();
+		std::error_code error;
+		if (!directory.empty())
+			std::filesystem::create_directories(directory, error);
+
+		std::ofstream os(path);
+		if (!os)
+			throw std::runtime_error("cannot write tuning profile to " + path);
+		os << FORMAT << " " << VERSION << "\nmachine " << machine_
+		   << "\n# n_cf n_fibers n_samples n_trials -> n_threads cf_block trials_per_task seconds\n";
+		for (const auto &e : entries_)
+			os << e.shape.n_cf << " " << e.shape.n_fibers << " " << e.shape.n_samples << " " << e.shape.n_trials << " "
+			   << e.schedule.n_threads << " " << e.schedule.cf_block << " " << e.schedule.trials_per_task << " " << e.seconds << "\n";
+	}
+
+	Profile Profile::load(const std::string &path)
+	{
+		std::ifstream is(path);
+		if (!is)
+			throw std::runtime_error("cannot read tuning profile " + path);
+
+		std::string format, machine;
+		int version = 0;
+		is >> format >> version >> machine;
+		if (format != FORMAT || version != VERSION || machine != "machine")
+			throw std::runtime_error("not a tuning profile (version " + std::to_string(VERSION) + "): " + path);
+		std::getline(is >> std::ws, machine);
+
+		Profile profile(machine);
+		for (std::string line; std::getline(is, line);)
+		{
+			if (line.empty() || line[0] == '#')
+				continue;
+			std::istringstream ss(line);
+			Entry e;
+			if (!(ss >> e.shape.n_cf >> e.shape.n_fibers >> e.shape.n_samples >> e.shape.n_trials >> e.schedule.n_threads >> e.schedule.cf_block >> e.schedule.trials_per_task >> e.seconds))
+				throw std::runtime_error("malformed line in tuning profile " + path + ": " + line);
+			profile.add(e);
+		}
+		return profile;
+	}
+
+	std::string machine_id()
+	{
+		std::string model = "unknown";
+#if defined(__linux__)
+		std::ifstream cpuinfo("/proc/cpuinfo");
+		for (std::string line; std::getline(cpuinfo, line);)
+			if (line.rfind("model name", 0) == 0)
+			{
+				model = line.substr(line.find(':') + 2);
+				break;
+			}
+#endif
+		return model + " / " + std::to_string(std::thread::hardware_concurrency()) + " threads";
+	}
+
+	std::string default_path()
+	{
+		if (const char *path = std::getenv("BRUCE_TUNING_PROFILE"))
+			return path;
+		if (const char *cache = std::getenv("XDG_CACHE_HOME"); cache && *cache)
+			return (std::filesystem::path(cache) / "bruce" / "tuning_profile.txt").string();
+		if (const char *home = std::getenv("HOME"); home && *home)
+			return (std::filesystem::path(home) / ".cache" / "bruce" / "tuning_profile.txt").string();
+		return "";
+	}
+
+	std::shared_ptr<const Profile> active_profile()
+	{
+		std::lock_guard<std::mutex> lock(active_mutex);
+		if (!active_loaded)
+		{
+			active_loaded = true;
+			const auto path = default_path();
+			std::error_code error;
+			if (!path.empty() && std::filesystem::exists(path, error))
+			{
+				try
+				{
+					auto profile = std::make_shared<Profile>(Profile::load(path));
+					if (profile->machine() == machine_id())
+						active = std::move(profile);
+				}
+				catch (const std::runtime_error &e)
+				{
+					std::cerr << "ignoring tuning profile: " << e.what() << std::endl;
+				}
+			}
+		}
+		return active;
+	}
+
+	void set_active_profile(std::shared_ptr<const Profile> profile)
+	{
+		std::lock_guard<std::mutex> lock(active_mutex);
+		active_loaded = true;
+		active = std::move(profile);
+	}
+
+	Profile autotune(const Options &options)
+	{
+		const auto shapes = options.shapes.empty() ? default_shapes() : options.shapes;
+		// Create uses at most utils::N_THREADS threads
+		auto thread_counts = options.thread_counts.empty() ? default_thread_counts() : options.thread_counts;
+		for (auto &n_threads : thread_counts)
+			n_threads = std::min(std::max<size_t>(n_threads, 1), utils::N_THREADS);
+		std::sort(thread_counts.begin(), thread_counts.end());
+		thread_counts.erase(std::unique(thread_counts.begin(), thread_counts.end()), thread_counts.end());
+
+		Profile profile(machine_id());
+		for (const auto &shape : shapes)
+		{
+			const double simulation_duration = static_cast<double>(shape.n_samples) / 100e3;
+			const auto stim = stimulus::ramped_sine_wave(0.9 * simulation_duration, simulation_duration, 100000, 2.5e-3, 0.0, 1e3, 60.0);
+			const size_t n_low = shape.n_fibers / 5;
+			Neurogram ng(shape.n_cf, n_low, n_low, shape.n_fibers - 2 * n_low);
+
+			Entry best{shape, {}, std::numeric_limits<double>::infinity()};
+			const auto consider = [&](const Schedule &schedule)
+			{
+				const double seconds = time_schedule(ng, stim, shape, schedule, options.repetitions);
+				if (options.verbose)
+					std::cout << "n_cf=" << shape.n_cf << " n_fibers=" << shape.n_fibers << " n_samples=" << shape.n_samples
+							  << " n_trials=" << shape.n_trials << ": n_threads=" << schedule.n_threads << " cf_block=" << schedule.cf_block
+							  << " trials_per_task=" << schedule.trials_per_task << " " << seconds * 1e3 << " ms" << std::endl;
+				if (seconds < best.seconds)
+					best = {shape, schedule, seconds};
+			};
+
+			for (const size_t n_threads : thread_counts)
+				consider({n_threads, 0, 0});
+
+			const size_t p = best.schedule.n_threads;
+			for (const size_t cf_block : {p, 2 * p, 4 * p})
+				if (cf_block < shape.n_cf)
+					consider({p, cf_block, 0});
+
+			const auto schedule = best.schedule;
+			for (size_t trials_per_task = shape.n_trials / 2; trials_per_task >= 1; trials_per_task /= 2)
+				consider({schedule.n_threads, schedule.cf_block, trials_per_task});
+
+			profile.add(best);
+		}
+		return profile;
+	}
+}
@@ -1,4 +1,5 @@
 #include <filesystem>
+#include <cstdint>
 #include <fstream>
 #include "utils.h"
 #include "resample.h"
@@ -40,11 +41,15 @@ namespace
 		return z_mag;
 	}
 
+	thread_local utils::GeneratorScope *active_scope = nullptr;
+
 	void fill_gaussian(std::vector<double> &x)
 	{
-		static std::normal_distribution<double> d(0, 1.0);
+		thread_local std::normal_distribution<double> d(0, 1.0);
+		auto &normal = active_scope ? active_scope->normal : d;
+		auto &generator = utils::generator();
 		for (auto &xi : x)
-			xi = d(utils::GENERATOR);
+			xi = normal(generator);
 	}
 
 	void fill_noise_vectors(std::vector<double> &zr1, std::vector<double> &zr2, const NoiseType noise)
@@ -76,7 +81,7 @@ namespace
 				-0.087690563274934, 0.231624682299529, -0.563183338456413, -1.188876899529859};
 			break;
 		case FIXED_SEED:
-			utils::GENERATOR.seed(42);
+			utils::generator().seed(42);
 			[[fallthrough]];
 		default:
 			fill_gaussian(zr1);
@@ -96,31 +101,56 @@ namespace utils
 		GENERATOR.seed(SEED);
 	}
 
+	GeneratorScope::GeneratorScope(const int seed, const size_t stream) : previous_(active_scope)
+	{
+		std::seed_seq sequence{static_cast<uint32_t>(seed), static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32)};
+		generator.seed(sequence);
+		active_scope = this;
+	}
+
+	GeneratorScope::~GeneratorScope()
+	{
+		active_scope = previous_;
+	}
+
+	std::mt19937 &generator()
+	{
+		return active_scope ? active_scope->generator : GENERATOR;
+	}
+
+	size_t N_THREADS = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+	void set_n_threads(const size_t n_threads)
+	{
+		N_THREADS = n_threads == 0 ? std::max<size_t>(1, std::thread::hardware_concurrency()) : n_threads;
+	}
+
 	template <typename D>
 	std::vector<double> random(const size_t n, D &d)
 	{
+		auto &g = generator();
 		std::vector<double> r(n);
 		for (auto &ri : r)
-			ri = d(GENERATOR);
+			ri = d(g);
 		return r;
 	}
 
 	double rand1()
 	{
 		thread_local std::uniform_real_distribution<double> d(0, 1.0);
-		return d(GENERATOR);
+		return d(generator());
 	}
 
 	double randn1()
 	{
 		thread_local std::normal_distribution<double> d(0, 1.0);
-		return d(GENERATOR);
+		return (active_scope ? active_scope->normal : d)(generator());
 	}
 
 	std::vector<double> randn(const size_t n)
 	{
 		thread_local std::normal_distribution<double> d(0, 1.0);
-		return random(n, d);
+		return random(n, active_scope ? active_scope->normal : d);
 	}
 
 	std::vector<double> fast_fractional_gaussian_noise(const int n_out, const NoiseType noise, const double mu)
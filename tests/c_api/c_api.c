@@ -0,0 +1,116 @@
+/*
+ * Checks the C interface (bruce_c.h) from C: error codes, zero-copy creation into caller buffers, batches and results.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bruce_c.h"
+
+static int n_failures = 0;
+
+#define CHECK(condition)                                                           \
+	do                                                                             \
+	{                                                                              \
+		if (!(condition))                                                          \
+		{                                                                          \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			n_failures++;                                                          \
+		}                                                                          \
+	} while (0)
+
+static double total(const double *data, size_t n_cf, size_t n_bins, size_t row_stride)
+{
+	double sum = 0.0;
+	for (size_t i = 0; i < n_cf; i++)
+		for (size_t j = 0; j < n_bins; j++)
+			sum += data[i * row_stride + j];
+	return sum;
+}
+
+int main(void)
+{
+	CHECK(bruce_abi_version() == BRUCE_C_ABI_VERSION);
+	bruce_set_n_threads(2);
+	CHECK(bruce_get_n_threads() == 2);
+
+	double samples[5000];
+	for (size_t i = 0; i < 5000; i++)
+		samples[i] = 0.02 * sin(2.0 * 3.141592653589793 * 1e3 * (double)i / 1e5);
+
+	/* Errors are reported as status codes with a message */
+	bruce_stimulus *invalid = NULL;
+	CHECK(bruce_stimulus_new(samples, 5000, 100000, 0.01, &invalid) == BRUCE_ERROR_INVALID_ARGUMENT);
+	CHECK(invalid == NULL);
+	CHECK(strlen(bruce_last_error()) > 0);
+	CHECK(bruce_stimulus_from_file("does_not_exist.wav", 1.0, &invalid) == BRUCE_ERROR_IO);
+	CHECK(bruce_engine_n_cf(NULL, NULL) == BRUCE_ERROR_INVALID_ARGUMENT);
+
+	bruce_stimulus *stimuli[2] = {NULL, NULL};
+	CHECK(bruce_stimulus_new(samples, 5000, 100000, 0.06, &stimuli[0]) == BRUCE_OK);
+	CHECK(bruce_stimulus_ramped_sine_wave(0.05, 0.06, 100000, 2.5e-3, 5e-3, 4e3, 60.0, &stimuli[1]) == BRUCE_OK);
+	size_t n_simulation = 0;
+	CHECK(bruce_stimulus_size(stimuli[0], NULL, &n_simulation) == BRUCE_OK && n_simulation == 6000);
+
+	const double cfs[3] = {500.0, 1e3, 4e3};
+	bruce_engine *engine = NULL;
+	CHECK(bruce_engine_new(cfs, 3, 1, 1, 2, &engine) == BRUCE_OK);
+	bruce_engine *default_engine = NULL;
+	CHECK(bruce_engine_new(NULL, 5, 0, 0, 1, &default_engine) == BRUCE_OK);
+	size_t n_cf = 0;
+	CHECK(bruce_engine_n_cf(default_engine, &n_cf) == BRUCE_OK && n_cf == 5);
+	bruce_engine_free(default_engine);
+
+	size_t n_bins = 0;
+	CHECK(bruce_engine_n_bins(engine, stimuli[0], &n_bins) == BRUCE_OK && n_bins > 0);
+
+	bruce_create_params params = bruce_default_create_params();
+	params.n_trials = 2;
+
+	/* Batch creation into caller buffers, with padded rows */
+	const size_t row_stride = n_bins + 3;
+	double *outputs[2];
+	for (size_t i = 0; i < 2; i++)
+	{
+		outputs[i] = (double *)malloc(3 * row_stride * sizeof(double));
+		for (size_t j = 0; j < 3 * row_stride; j++)
+			outputs[i][j] = -1.0;
+	}
+	size_t failed_index = 0;
+	CHECK(bruce_engine_create_batch(engine, (const bruce_stimulus *const *)stimuli, 2, &params, outputs, NULL, row_stride, &failed_index) == BRUCE_OK);
+	CHECK(failed_index == 2);
+	for (size_t i = 0; i < 2; i++)
+	{
+		CHECK(total(outputs[i], 3, n_bins, row_stride) > 0.0);
+		CHECK(outputs[i][row_stride - 1] == -1.0);
+	}
+
+	/* A row stride smaller than the number of bins is rejected */
+	CHECK(bruce_engine_create(engine, stimuli[0], &params, outputs[0], n_bins - 1) == BRUCE_ERROR_INVALID_ARGUMENT);
+	params.species = (bruce_species)7;
+	CHECK(bruce_engine_create(engine, stimuli[0], &params, outputs[0], row_stride) == BRUCE_ERROR_INVALID_ARGUMENT);
+	params.species = BRUCE_HUMAN_SHERA;
+
+	/* Results outlive the engine */
+	bruce_result *result = NULL;
+	CHECK(bruce_engine_run(engine, stimuli[1], &params, &result) == BRUCE_OK);
+	bruce_engine_free(engine);
+	const double *data = NULL;
+	size_t result_cf = 0, result_bins = 0, result_stride = 0;
+	CHECK(bruce_result_data(result, &data, &result_cf, &result_bins, &result_stride) == BRUCE_OK);
+	CHECK(data != NULL && result_cf == 3 && result_bins == n_bins && result_stride >= n_bins);
+	CHECK(total(data, result_cf, result_bins, result_stride) > 0.0);
+	bruce_result_free(result);
+
+	for (size_t i = 0; i < 2; i++)
+	{
+		bruce_stimulus_free(stimuli[i]);
+		free(outputs[i]);
+	}
+
+	if (n_failures)
+		fprintf(stderr, "%d checks failed\n", n_failures);
+	return n_failures ? 1 : 0;
+}
@@ -0,0 +1,397 @@
+/*
+ * Golden-output regression harness. Compares the outputs of the model against reference outputs stored in
+ * tests/golden/data, such that changes to the numerics (i.e. SIMD, float32 or approximations) are caught.
+ *
+ *	bruce_golden [--data DIR] [--generate] [--exact] [--filter NAME] [--rtol X] [--atol X] [--alpha X] [--seed N]
+ *	             [--control-decimation N]
+ *
+ * Deterministic outputs (IHC traces, mapped drives and power law outputs with ONES noise) are compared element wise,
+ * and pass when max|x - ref| <= atol + rtol * max|ref|. Stochastic outputs (binned PSTHs of many trials, and the
+ * rates of a neurogram per CF) are compared statistically: a two-sample Kolmogorov-Smirnov test on the rate per
+ * trial, and the overlap of the confidence intervals of the mean of every bin. Both are performed at significance
+ * level alpha, Bonferroni corrected for the number of bins. The stochastic outputs are seeded with seed, which can be
+ * varied to check that a change does not only pass for a single random stream.
+ *
+ * With --generate, the reference outputs are (re)written instead, which should only be done for an intended change
+ * of the model output. With --exact, every output (including the stochastic ones, which draw the same streams for
+ * the same seed) must be bit for bit equal to the reference, to compare two builds that should be identical.
+ *
+ * With --control-decimation, the models of the ihc cases evaluate their control path every N samples (see
+ * ihc::Model), an approximation that is checked against the references of the full-rate model with a looser tolerance.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "bruce.h"
+
+namespace
+{
+	namespace fs = std::filesystem;
+
+	constexpr char MAGIC[4] = {'B', 'R', 'G', 'D'};
+	constexpr uint32_t VERSION = 1;
+	constexpr double DURATION = 0.02;
+	constexpr double SIMULATION_DURATION = 0.03;
+	constexpr size_t SAMPLING_RATE = 100000;
+	constexpr double SYNAPSE_SAMPLING_FREQUENCY = 10e3;
+	constexpr double TABS = 0.7e-3;
+	constexpr double TREL = 0.6e-3;
+	constexpr int N_TRIALS = 100;
+	constexpr size_t N_BINS = 30;
+	constexpr int N_NEUROGRAMS = 20;
+
+	const std::vector<double> CFS{250, 1e3, 4e3, 12e3};
+	//! The mapped drive is padded with 3 delay points, which are long at low CFs, so those are left out of the synapse cases
+	const std::vector<double> SYNAPSE_CFS{1e3, 4e3, 12e3};
+	const std::vector<double> SPONTS{0.1, 4, 100};
+	//! (cohc, cihc) of the hearing loss cases, without OHC and/or IHC function the IHC model skips its dead stages
+	const std::vector<std::pair<double, double>> HEARING_LOSS{{0, 1}, {1, 0}, {0, 0}, {0.5, 0.5}};
+	constexpr double HIGH_SPONT = 100;
+	constexpr int POPULATION_SEED = 42;
+
+	struct Options
+	{
+		fs::path data = fs::path(PROJECT_ROOT) / "tests" / "golden" / "data";
+		bool generate = false;
+		bool exact = false;
+		std::string filter;
+		double rtol = 1e-9;
+		double atol = 1e-12;
+		double alpha = 1e-3;
+		int seed = 42;
+		size_t control_decimation = 1;
+	};
+
+	//! Row major matrix, for stochastic outputs the rows are independent samples (trials)
+	struct Matrix
+	{
+		size_t n_rows = 0;
+		size_t n_cols = 0;
+		std::vector<double> data;
+
+		[[nodiscard]] double operator()(const size_t r, const size_t c) const
+		{
+			return data[r * n_cols + c];
+		}
+	};
+
+	Matrix row(std::vector<double> x)
+	{
+		return {1, x.size(), std::move(x)};
+	}
+
+	void write_matrix(const fs::path &path, const Matrix &m)
+	{
+		fs::create_directories(path.parent_path());
+		std::ofstream os(path, std::ios::binary);
+		const uint64_t shape[2] = {m.n_rows, m.n_cols};
+		os.write(MAGIC, sizeof(MAGIC));
+		os.write(reinterpret_cast<const char *>(&VERSION), sizeof(VERSION));
+		os.write(reinterpret_cast<const char *>(shape), sizeof(shape));
+		os.write(reinterpret_cast<const char *>(m.data.data()), static_cast<std::streamsize>(m.data.size() * sizeof(double)));
+		if (!os)
+			throw std::runtime_error("cannot write " + path.string());
+	}
+
+	Matrix read_matrix(const fs::path &path)
+	{
+		std::ifstream is(path, std::ios::binary);
+		char magic[4];
+		uint32_t version;
+		uint64_t shape[2];
+		is.read(magic, sizeof(magic));
+		is.read(reinterpret_cast<char *>(&version), sizeof(version));
+		is.read(reinterpret_cast<char *>(shape), sizeof(shape));
+		if (!is || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || version != VERSION)
+			throw std::runtime_error("missing or invalid reference " + path.string() + ", run with --generate");
+
+		Matrix m{shape[0], shape[1], std::vector<double>(shape[0] * shape[1])};
+		is.read(reinterpret_cast<char *>(m.data.data()), static_cast<std::streamsize>(m.data.size() * sizeof(double)));
+		if (!is)
+			throw std::runtime_error("truncated reference " + path.string());
+		return m;
+	}
+
+	//! Inverse of the standard normal cdf, by bisection
+	double normal_quantile(const double p)
+	{
+		double lo = -40.0, hi = 40.0;
+		for (int i = 0; i < 200; i++)
+		{
+			const double mid = (lo + hi) / 2.0;
+			(0.5 * std::erfc(-mid / std::sqrt(2.0)) < p ? lo : hi) = mid;
+		}
+		return (lo + hi) / 2.0;
+	}
+
+	//! Two-sample Kolmogorov-Smirnov statistic
+	double ks_statistic(std::vector<double> a, std::vector<double> b)
+	{
+		std::sort(a.begin(), a.end());
+		std::sort(b.begin(), b.end());
+		double d = 0.0;
+		size_t i = 0, j = 0;
+		while (i < a.size() && j < b.size())
+		{
+			const double x = std::min(a[i], b[j]);
+			while (i < a.size() && a[i] == x)
+				i++;
+			while (j < b.size() && b[j] == x)
+				j++;
+			d = std::max(d, std::abs(static_cast<double>(i) / a.size() - static_cast<double>(j) / b.size()));
+		}
+		return d;
+	}
+
+	struct Checker
+	{
+		Options options;
+		size_t n_checked = 0;
+		size_t n_failed = 0;
+
+		[[nodiscard]] bool enabled(const std::string &name) const
+		{
+			return options.filter.empty() || name.find(options.filter) != std::string::npos;
+		}
+
+		void report(const std::string &name, const bool passed, const std::string &details)
+		{
+			n_checked++;
+			n_failed += !passed;
+			std::cout << (passed ? "ok   " : "FAIL ") << std::left << std::setw(44) << name << details << std::endl;
+		}
+
+		//! Compare element wise against the reference of name, or store it
+		void deterministic(const std::string &name, const std::function<Matrix()> &compute)
+		{
+			if (!enabled(name))
+				return;
+			const auto path = options.data / (name + ".bin");
+			const Matrix x = compute();
+			if (options.generate)
+			{
+				write_matrix(path, x);
+				return report(name, true, "written");
+			}
+
+			const Matrix ref = read_matrix(path);
+			if (ref.n_rows != x.n_rows || ref.n_cols != x.n_cols)
+				return report(name, false, "shape mismatch");
+
+			double max_ref = 0.0, max_err = 0.0;
+			for (size_t i = 0; i < ref.data.size(); i++)
+			{
+				max_ref = std::max(max_ref, std::abs(ref.data[i]));
+				max_err = std::max(max_err, std::isfinite(x.data[i]) ? std::abs(x.data[i] - ref.data[i]) : INFINITY);
+			}
+			std::ostringstream ss;
+			ss << std::scientific << std::setprecision(2) << "max abs err " << max_err << ", rel " << (max_ref > 0 ? max_err / max_ref : max_err);
+			report(name, options.exact ? std::memcmp(x.data.data(), ref.data.data(), x.data.size() * sizeof(double)) == 0
+										: max_err <= options.atol + options.rtol * max_ref,
+				   ss.str());
+		}
+
+		/**
+		 * Compare the distribution of the trials (rows) against the reference of name, or store it: a KS test on the
+		 * row sums, and the confidence interval overlap of the column means.
+		 */
+		void stochastic(const std::string &name, const std::function<Matrix()> &compute)
+		{
+			if (!enabled(name))
+				return;
+			utils::set_seed(options.seed);
+			if (options.exact)
+				return deterministic(name, compute);
+			const auto path = options.data / (name + ".bin");
+			const Matrix x = compute();
+			if (options.generate)
+			{
+				write_matrix(path, x);
+				return report(name, true, "written");
+			}
+
+			const Matrix ref = read_matrix(path);
+			if (ref.n_cols != x.n_cols)
+				return report(name, false, "shape mismatch");
+
+			const auto row_sums = [](const Matrix &m)
+			{
+				std::vector<double> sums(m.n_rows, 0.0);
+				for (size_t r = 0; r < m.n_rows; r++)
+					for (size_t c = 0; c < m.n_cols; c++)
+						sums[r] += m(r, c);
+				return sums;
+			};
+			const double n = static_cast<double>(x.n_rows), m = static_cast<double>(ref.n_rows);
+			const double d = ks_statistic(row_sums(x), row_sums(ref));
+			const double d_critical = std::sqrt(-std::log(options.alpha / 2.0) / 2.0) * std::sqrt((n + m) / (n * m));
+
+			const double z = normal_quantile(1.0 - options.alpha / (2.0 * static_cast<double>(x.n_cols)));
+			size_t n_disjoint = 0;
+			for (size_t c = 0; c < x.n_cols; c++)
+			{
+				const auto mean_se = [c](const Matrix &s)
+				{
+					double sum = 0.0, sum_sq = 0.0;
+					for (size_t r = 0; r < s.n_rows; r++)
+					{
+						sum += s(r, c);
+						sum_sq += s(r, c) * s(r, c);
+					}
+					const double k = static_cast<double>(s.n_rows);
+					const double mean = sum / k;
+					const double var = k > 1 ? std::max(0.0, (sum_sq - k * mean * mean) / (k - 1)) : 0.0;
+					return std::make_pair(mean, std::sqrt(var / k));
+				};
+				const auto [mx, sx] = mean_se(x);
+				const auto [mr, sr] = mean_se(ref);
+				// Allow for a tiny absolute slack, such that bins that are (almost) always empty compare equal
+				n_disjoint += std::abs(mx - mr) > z * (sx + sr) + 1e-12;
+			}
+
+			std::ostringstream ss;
+			ss << std::fixed << std::setprecision(3) << "ks " << d << " (critical " << d_critical << "), "
+			   << n_disjoint << "/" << x.n_cols << " disjoint intervals";
+			report(name, d <= d_critical && n_disjoint == 0, ss.str());
+		}
+	};
+
+	stimulus::Stimulus tone(const double f0)
+	{
+		return stimulus::ramped_sine_wave(DURATION, SIMULATION_DURATION, SAMPLING_RATE, 2.5e-3, 5e-3, f0, 60.0);
+	}
+
+	std::string label(const double x)
+	{
+		std::ostringstream ss;
+		ss << x;
+		return ss.str();
+	}
+
+	void check_deterministic(Checker &checker)
+	{
+		for (const auto species : {HUMAN_SHERA, CAT})
+			for (const double cf : CFS)
+			{
+				const std::string name = std::string(species == CAT ? "cat" : "human_shera") + "/" + label(cf);
+				checker.deterministic("ihc/" + name, [&]()
+									  { return row(inner_hair_cell(tone(cf), cf, 1, 1.0, 1.0, species, checker.options.control_decimation)); });
+				for (const auto &loss : HEARING_LOSS)
+					checker.deterministic("ihc_loss/" + name + "/" + label(loss.first) + "_" + label(loss.second), [&]()
+										  { return row(inner_hair_cell(tone(cf), cf, 1, loss.first, loss.second, species)); });
+			}
+
+		for (const double cf : SYNAPSE_CFS)
+		{
+			const auto stim = tone(cf);
+			const auto ihc = inner_hair_cell(stim, cf, 1, 1.0, 1.0, HUMAN_SHERA);
+			for (const auto &[mapping, name] : {std::make_pair(SOFTPLUS, "softplus"), std::make_pair(EXPONENTIAL, "exponential"), std::make_pair(BOLTZMAN, "boltzman")})
+				checker.deterministic("mapped/" + std::string(name) + "/" + label(cf), [&]()
+									  { return row(synapse_mapping::map(ihc, HIGH_SPONT, cf, stim.time_resolution, mapping)); });
+
+			for (const double spont : SPONTS)
+			{
+				const auto mapped = synapse_mapping::map(ihc, spont, cf, stim.time_resolution, SOFTPLUS);
+				const int delay_point = static_cast<int>(std::floor(7500 / (cf / 1e3)));
+				for (const auto &[impl, name] : {std::make_pair(APPROXIMATED, "approximated"), std::make_pair(ACTUAL, "actual")})
+				{
+					checker.deterministic("power_law/" + std::string(name) + "/" + label(cf) + "/" + label(spont), [&]()
+										  { return row(pla::power_law(utils::Span<double>(mapped), ONES, impl, spont, SYNAPSE_SAMPLING_FREQUENCY,
+																	  delay_point, stim.time_resolution, static_cast<int>(stim.n_simulation_timesteps))); });
+					checker.deterministic("synaptic_output/" + std::string(name) + "/" + label(cf) + "/" + label(spont), [&]()
+										  { return row(synapse(mapped, cf, 1, stim.n_simulation_timesteps, stim.time_resolution, ONES, impl,
+															   spont, TABS, TREL, false)
+														   .synaptic_output); });
+				}
+			}
+		}
+	}
+
+	Matrix binned_psth(const double cf, const double spont)
+	{
+		const auto stim = tone(cf);
+		const auto ihc = inner_hair_cell(stim, cf, 1, 1.0, 1.0, HUMAN_SHERA);
+		std::vector<double> sponts{spont}, tabs{TABS}, trel{TREL};
+		auto out = synapse_batch(utils::Span<double>(ihc), cf, utils::Span<double>(sponts), utils::Span<double>(tabs),
+								 utils::Span<double>(trel), N_TRIALS, 1, stim.n_simulation_timesteps, stim.time_resolution,
+								 RANDOM, APPROXIMATED, true, SOFTPLUS, N_BINS);
+		return {out.n_trials, out.n_bins, std::move(out.psth)};
+	}
+
+	void check_stochastic(Checker &checker)
+	{
+		for (const double cf : CFS)
+			checker.stochastic("psth/" + label(cf) + "/" + label(HIGH_SPONT), [&]()
+							   { return binned_psth(cf, HIGH_SPONT); });
+		for (const double spont : SPONTS)
+			if (spont != HIGH_SPONT)
+				checker.stochastic("psth/1000/" + label(spont), [&]()
+								   { return binned_psth(1e3, spont); });
+
+		checker.stochastic("neurogram/rates", [&]()
+						   {
+			// The fiber parameters are drawn on construction, which should not vary with the seed of the trials
+			const auto stim = tone(1e3);
+			utils::set_seed(POPULATION_SEED);
+			Neurogram ng(CFS, 1, 1, 1);
+			utils::set_seed(checker.options.seed);
+			Matrix rates{N_NEUROGRAMS, CFS.size(), {}};
+			for (int i = 0; i < N_NEUROGRAMS; i++)
+			{
+				ng.create(stim, 1, 1, HUMAN_SHERA, RANDOM, APPROXIMATED);
+				for (const auto &cf_row : ng.get_output())
+					rates.data.push_back(utils::sum(cf_row) / stim.simulation_duration);
+			}
+			return rates; });
+	}
+}
+
+int main(const int argc, char **argv)
+{
+	Checker checker;
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const auto value = [&]() -> std::string
+		{
+			if (i + 1 >= argc)
+				throw std::invalid_argument("missing value for " + arg);
+			return argv[++i];
+		};
+		if (arg == "--data")
+			checker.options.data = value();
+		else if (arg == "--generate")
+			checker.options.generate = true;
+		else if (arg == "--exact")
+			checker.options.exact = true;
+		else if (arg == "--filter")
+			checker.options.filter = value();
+		else if (arg == "--rtol")
+			checker.options.rtol = std::stod(value());
+		else if (arg == "--atol")
+			checker.options.atol = std::stod(value());
+		else if (arg == "--alpha")
+			checker.options.alpha = std::stod(value());
+		else if (arg == "--seed")
+			checker.options.seed = std::stoi(value());
+		else if (arg == "--control-decimation")
+			checker.options.control_decimation = std::stoul(value());
+		else
+		{
+			std::cout << "usage: " << argv[0] << " [--data DIR] [--generate] [--exact] [--filter NAME] [--rtol X] [--atol X] [--alpha X] [--seed N] [--control-decimation N]\n";
+			return arg == "--help" ? 0 : 1;
+		}
+	}
+
+	check_deterministic(checker);
+	check_stochastic(checker);
+	std::cout << checker.n_checked - checker.n_failed << "/" << checker.n_checked << " passed" << std::endl;
+	return checker.n_failed ? 1 : 0;
+}
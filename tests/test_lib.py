@@ -1,7 +1,13 @@
+import json
 import os 
+import pickle
+import struct
 import unittest
 
+import numpy as np
+
 import bruce
+import bruce.bench
 
 
 class TestCase(unittest.TestCase):
@@ -14,6 +20,73 @@ class TestCase(unittest.TestCase):
         self.assertAlmostEqual(stim.stimulus_duration, 0.275)
         self.assertEqual(stim.sampling_rate, int(100e3))
 
+    def test_numpy_inputs(self):
+        stim = bruce.stimulus.ramped_sine_wave(.05, .1, int(100e3), 2.5e-3, 5e-3, int(1e3), 60.0)
+        stim32 = bruce.stimulus.Stimulus(stim.data.astype(np.float32), stim.sampling_rate, stim.simulation_duration)
+        self.assertEqual(stim32.n_stimulation_timesteps, stim.n_stimulation_timesteps)
+
+        ihc = bruce.inner_hair_cell(stim, 1e3)
+        self.assertIsInstance(ihc, np.ndarray)
+        self.assertEqual(ihc.size, stim.n_simulation_timesteps)
+
+        pla = bruce.map_to_synapse(ihc, 100, 1e3, stim.time_resolution)
+        pla32 = bruce.map_to_synapse(ihc.astype(np.float32), 100, 1e3, stim.time_resolution)
+        self.assertTrue(np.allclose(pla, pla32, rtol=1e-3))
+
+        out = bruce.synapse(
+            pla32, 1e3, 1, stim.n_simulation_timesteps, stim.time_resolution, bruce.ONES,
+            abs_refractory_period=0.7e-3, rel_refractory_period=0.6e-3
+        )
+        self.assertEqual(len(out.psth), stim.n_simulation_timesteps)
+
+    def test_inner_hair_cell_control_decimation(self):
+        stim = bruce.stimulus.ramped_sine_wave(.05, .1, int(100e3), 2.5e-3, 5e-3, int(1e3), 60.0)
+        ihc = bruce.inner_hair_cell(stim, 1e3)
+        decimated = bruce.inner_hair_cell(stim, 1e3, control_decimation=4)
+        self.assertEqual(decimated.size, ihc.size)
+        self.assertLess(np.abs(decimated - ihc).sum() / np.abs(ihc).sum(), 0.05)
+
+        # The error grows with the level, the documented bound is that of a CF two octaves below the tone at 90 dB
+        loud = bruce.stimulus.ramped_sine_wave(.05, .1, int(100e3), 2.5e-3, 5e-3, int(1e3), 90.0)
+        ihc = bruce.inner_hair_cell(loud, 250)
+        decimated = bruce.inner_hair_cell(loud, 250, control_decimation=4)
+        self.assertLess(np.abs(decimated - ihc).sum() / np.abs(ihc).sum(), 0.5)
+
+        with self.assertRaises(ValueError):
+            bruce.inner_hair_cell(stim, 1e3, control_decimation=0)
+        with self.assertRaises(ValueError):
+            bruce.inner_hair_cell(stim, 1e3, control_decimation=5)
+
+    def test_synapse_output_views(self):
+        stim = bruce.stimulus.ramped_sine_wave(.05, .1, int(100e3), 2.5e-3, 5e-3, int(1e3), 60.0)
+        pla = bruce.map_to_synapse(bruce.inner_hair_cell(stim, 1e3), 100, 1e3, stim.time_resolution)
+        out = bruce.synapse(
+            pla, 1e3, 1, stim.n_simulation_timesteps, stim.time_resolution,
+            abs_refractory_period=0.7e-3, rel_refractory_period=0.6e-3
+        )
+        synaptic_output = out.synaptic_output
+        self.assertIsInstance(synaptic_output, np.ndarray)
+        self.assertEqual(synaptic_output.size, out.n_total_timesteps)
+        self.assertFalse(synaptic_output.flags.writeable)
+        self.assertTrue(np.shares_memory(synaptic_output, out.synaptic_output))
+
+        del out
+        self.assertTrue(np.isfinite(synaptic_output).all())
+
+    def test_synapse_batch(self):
+        stim = bruce.stimulus.ramped_sine_wave(.05, .1, int(100e3), 2.5e-3, 5e-3, int(1e3), 60.0)
+        ihc = bruce.inner_hair_cell(stim, 1e3)
+        spont = np.array([100.0, 100.0, 4.0])
+        tabs = np.full(3, 0.7e-3)
+        trel = np.full(3, 0.6e-3)
+
+        out = bruce.synapse_batch(ihc, 1e3, spont, tabs, trel, n_trials=2, mapping_function=bruce.SOFTPLUS, n_bins=100)
+        self.assertEqual(out.psth.shape, (3, 2, 100))
+
+        spikes = bruce.synapse_batch(ihc, 1e3, spont, tabs, trel, n_trials=2, mapping_function=bruce.SOFTPLUS, store_spikes=True)
+        self.assertEqual(spikes.spike_offsets.size, 3 * 2 + 1)
+        self.assertEqual(spikes.spike_offsets[-1], spikes.spike_times.size)
+
     def test_read_stimulus(self):
         root = os.path.dirname(os.path.dirname(__file__))
         stim = bruce.stimulus.from_file(os.path.join(root, "data/defineit.wav"), False)
@@ -30,6 +103,220 @@ class TestCase(unittest.TestCase):
         binned_output = ng.get_output()
         self.assertEqual(binned_output.shape[0], 2)
         self.assertEqual(binned_output.shape[1], int(stim.n_simulation_timesteps / (ng.bin_width / stim.time_resolution)))
+
+    def test_neurogram_output_buffer(self):
+        stim = bruce.stimulus.ramped_sine_wave(.05, .1, int(100e3), 2.5e-3, 5e-3, int(5e3), 60.0)
+        ng = bruce.Neurogram(3, 1, 1, 1)
+        ng.create(stim)
+
+        output = ng.get_output()
+        self.assertEqual(output.shape, (3, ng.get_n_bins(stim)))
+        self.assertTrue(np.shares_memory(output, np.asarray(ng)))
+
+        out = np.empty((3, ng.get_n_bins(stim)))
+        ng.create(stim, out=out)
+        self.assertTrue(np.shares_memory(out, ng.get_output()))
+        self.assertGreater(out.sum(), 0)
+
+        with self.assertRaises(ValueError):
+            ng.create(stim, out=np.empty((2, 2)))
+
+    def test_neurogram_iter_create(self):
+        stim = bruce.stimulus.ramped_sine_wave(.05, .1, int(100e3), 2.5e-3, 5e-3, int(5e3), 60.0)
+        ng = bruce.Neurogram(4, 1, 1, 1)
+
+        rows = dict(ng.iter_create(stim))
+        self.assertEqual(sorted(rows), [0, 1, 2, 3])
+        output = ng.get_output()
+        for cf_i, row in rows.items():
+            self.assertTrue(np.array_equal(row, output[cf_i]))
+
+    def test_neurogram_shared_memory(self):
+        stim = bruce.stimulus.ramped_sine_wave(.05, .1, int(100e3), 2.5e-3, 5e-3, int(5e3), 60.0)
+        ng = bruce.Neurogram(2, 1, 1, 1)
+        ng.use_shared_memory = True
+        ng.create(stim)
+
+        handle = ng.share_output()
+        self.assertEqual(handle.shape, (2, ng.get_n_bins(stim)))
+        self.assertTrue(np.array_equal(handle.array(), ng.get_output()))
+
+        # Unpickling maps the same segment (i.e. in a worker process), which outlives the neurogram
+        handle2 = pickle.loads(pickle.dumps(handle))
+        self.assertEqual(handle2.name, handle.name)
+        output = ng.get_output().copy()
+        del ng, handle
+        self.assertTrue(np.array_equal(np.asarray(handle2), output))
+        self.assertEqual(handle2.ref_count, 1)
+
+    def test_neurogram_profile(self):
+        stim = bruce.stimulus.ramped_sine_wave(.05, .1, int(100e3), 2.5e-3, 5e-3, int(5e3), 60.0)
+        ng = bruce.Neurogram(2, 1, 1, 1)
+        ng.create(stim)
+        self.assertEqual(ng.profile()["stages"], {})
+
+        bruce.set_profiling(True)
+        try:
+            self.assertTrue(bruce.is_profiling())
+            ng.create(stim)
+        finally:
+            bruce.set_profiling(False)
+
+        profile = ng.profile()
+        self.assertEqual(len(profile["per_cf"]), 2)
+        for stage in ("ihc", "mapping", "power_law", "spike_generation"):
+            self.assertEqual(profile["stages"][stage]["count"], 2 if stage == "ihc" else 6)
+            self.assertGreater(profile["stages"][stage]["total"], 0)
+
+    def test_neurogram_trace(self):
+        stim = bruce.stimulus.ramped_sine_wave(.05, .1, int(100e3), 2.5e-3, 5e-3, int(5e3), 60.0)
+        ng = bruce.Neurogram(2, 1, 1, 1)
+        bruce.set_tracing(True)
+        try:
+            ng.create(stim)
+        finally:
+            bruce.set_tracing(False)
+
+        events = json.loads(bruce.chrome_trace())["traceEvents"]
+        names = [e["name"] for e in events if e["ph"] == "X"]
+        self.assertEqual(names.count("fiber"), 6)
+        self.assertEqual(names.count("ihc"), 2)
+        self.assertEqual(names.count("create"), 1)
+
+    def test_neurogram_schedule(self):
+        stim = bruce.stimulus.ramped_sine_wave(.05, .1, int(100e3), 2.5e-3, 5e-3, int(5e3), 60.0)
+        ng = bruce.Neurogram(4, 1, 1, 1)
+        ng.schedule = bruce.Schedule(n_threads=1, cf_block=2, trials_per_task=1)
+        ng.create(stim, n_trials=3)
+        self.assertEqual(ng.last_schedule(), bruce.Schedule(1, 2, 1))
+        self.assertGreater(ng.get_output().sum(), 0)
+
+    def test_bench(self):
+        results = bruce.bench.run(warmup=0, repetitions=1, min_time=0.0, name_filter="stimulus", quick=True)["results"]
+        self.assertIn("stimulus/construct/float32", {r["name"] for r in results})
+        self.assertTrue(all(r["median_s"] > 0 for r in results))
+        json.dumps(results)
+
+    def test_neurogram_prefix(self):
+        stim = bruce.stimulus.ramped_sine_wave(.05, .1, int(100e3), 2.5e-3, 5e-3, int(5e3), 60.0)
+        prefix = bruce.stimulus.Stimulus(stim.data[:3000], int(100e3), .03)
+        ng = bruce.Neurogram(2, 1, 1, 1)
+        # The fiber tasks draw from generators of their own, so the output does not depend on the number of threads
+        bruce.set_n_threads(1)
+        bruce.set_seed(7)
+        ng.create(stim)
+        expected = ng.get_output()
+        bruce.set_n_threads()
+
+        ng.prefix = ng.simulate_prefix(prefix)
+        self.assertEqual(ng.prefix.n_samples, 3000)
+        bruce.set_seed(7)
+        ng.create(stim)
+        self.assertTrue(np.array_equal(ng.get_output(), expected))
+
+        with self.assertRaises(ValueError):
+            ng.create(bruce.stimulus.Stimulus(np.zeros(5000), int(100e3), .1))
+
+    def test_neurogram_window(self):
+        stim = bruce.stimulus.ramped_sine_wave(.25, .3, int(100e3), 2.5e-3, 5e-3, int(1e3), 60.0)
+        ng = bruce.Neurogram(2, 1, 1, 1)
+        index = ng.build_index(stim, interval=.1)
+        self.assertEqual(index.n_snapshots, 3)
+
+        path = "state_index_test.bin"
+        try:
+            index.save(path)
+            index = bruce.StateIndex.load(path)
+        finally:
+            os.remove(path)
+
+        ng.create_window(stim, index, .2, .25, warmup=.05)
+        self.assertAlmostEqual(ng.window_start(), .2)
+        self.assertEqual(ng.get_output().shape, (2, 100))
+
+        # The IHC output of the window is that of a full run over the same bins
+        first = round(ng.window_start() / stim.time_resolution)
+        for cf_index, cf in enumerate(ng.get_cfs()):
+            ihc = ng.window_ihc(stim, index, cf_index, .2, .25, warmup=.05)
+            self.assertEqual(len(ihc), 100 * round(ng.bin_width / stim.time_resolution))
+            np.testing.assert_array_equal(ihc, bruce.inner_hair_cell(stim, cf, n_rep=1)[first:first + len(ihc)])
+
+        # The fibers of a window draw from generators seeded by the index, so a window is reproducible
+        first = ng.get_output().copy()
+        ng.create_window(stim, index, .2, .25, warmup=.05)
+        np.testing.assert_array_equal(ng.get_output(), first)
+
+    def test_neurogram_accuracy_budget(self):
+        stim = bruce.stimulus.ramped_sine_wave(.05, .1, int(100e3), 2.5e-3, 5e-3, int(5e3), 60.0)
+        ng = bruce.Neurogram(2, 1, 1, 1)
+        ng.accuracy_budget = 0.0
+        ng.create(stim)
+        self.assertEqual(ng.plan()["description"], "exact")
+        self.assertEqual(ng.plan()["power_law"], bruce.ACTUAL)
+
+        ng.accuracy_budget = 0.1
+        ng.create(stim, power_law=bruce.ACTUAL)
+        self.assertIn("approximate_power_law", ng.plan()["tiers"])
+        self.assertLessEqual(ng.plan()["estimated_error"], 0.1)
+        self.assertLess(ng.plan()["relative_cost"], 1.0)
+
+    @unittest.skipUnless(bruce.allocation_counting_supported(), "allocation counting is not supported")
+    def test_neurogram_allocations(self):
+        stim = bruce.stimulus.ramped_sine_wave(.05, .1, int(100e3), 2.5e-3, 5e-3, int(5e3), 60.0)
+        ng = bruce.Neurogram(2, 1, 1, 1)
+        bruce.set_profiling(True, allocations=True)
+        try:
+            ng.create(stim)
+        finally:
+            bruce.set_profiling(False)
+
+        profile = ng.profile()
+        self.assertGreater(profile["allocations"]["count"], 0)
+        self.assertGreater(profile["peak_rss"], 0)
+        self.assertGreater(profile["stages"]["mapping"]["allocations"]["bytes"], 0)
+
+    def test_pickle(self):
+        stim = bruce.stimulus.ramped_sine_wave(.05, .1, int(100e3), 2.5e-3, 5e-3, int(5e3), 60.0)
+        ng = bruce.Neurogram(2, 1, 1, 1)
+        ng.create(stim)
+
+        for protocol in (4, 5):
+            buffers = []
+            data = pickle.dumps((stim, ng), protocol=protocol, buffer_callback=buffers.append if protocol == 5 else None)
+            self.assertEqual(len(buffers), 2 if protocol == 5 else 0)
+
+            stim2, ng2 = pickle.loads(data, buffers=buffers)
+            self.assertTrue(np.array_equal(stim2.data, stim.data))
+            self.assertEqual(stim2.n_simulation_timesteps, stim.n_simulation_timesteps)
+            self.assertTrue(np.array_equal(ng2.get_output(), ng.get_output()))
+            self.assertTrue(np.array_equal(ng2.get_cfs(), ng.get_cfs()))
+            self.assertEqual(ng2.get_fibers(1)[0].spont, ng.get_fibers(1)[0].spont)
+
+        pla = bruce.map_to_synapse(bruce.inner_hair_cell(stim, 1e3), 100, 1e3, stim.time_resolution)
+        out = bruce.synapse(
+            pla, 1e3, 1, stim.n_simulation_timesteps, stim.time_resolution,
+            abs_refractory_period=0.7e-3, rel_refractory_period=0.6e-3
+        )
+        out2 = pickle.loads(pickle.dumps(out, protocol=5))
+        self.assertTrue(np.array_equal(out2.psth, out.psth))
+        self.assertTrue(np.array_equal(out2.spike_times, out.spike_times))
+
+    def test_pickle_corrupted_header(self):
+        ng = bruce.Neurogram(2, 1, 1, 1)
+        ng.create(bruce.stimulus.ramped_sine_wave(.05, .1, int(100e3), 2.5e-3, 5e-3, int(5e3), 60.0))
+        restore, (header, output) = ng.__reduce_ex__(4)
+        n_cf = len(ng.get_cfs())
+
+        # The header ends with the number of bins, the row stride and whether there is an output
+        for row_stride in (1, 2 ** 62):
+            corrupted = header[:-9] + struct.pack("<Q", row_stride) + header[-1:]
+            with self.assertRaises(RuntimeError):
+                restore(corrupted, output[:n_cf * 8])
+
+        # The number of cfs follows the magic, version, type and bin width
+        corrupted = header[:20] + struct.pack("<Q", 2 ** 61) + header[28:]
+        with self.assertRaises(RuntimeError):
+            restore(corrupted, output)
     
 
 if __name__ == "__main__":